@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Hashes a string together with its end, so that consecutive strings can not
+// run into each other.
+void UpdateHash(llvm::SHA1 &hasher, llvm::StringRef value)
+{
+  hasher.update(value);
+  hasher.update(llvm::StringRef("\0", 1));
+}
+
+std::string FinalHash(llvm::SHA1 &hasher)
+{
+  return llvm::toHex(hasher.final(), true);
+}
+
+// Optimised bitcode of single functions on local disk. The key is the hash
+// of everything the code of a function depends on, so an entry never has to
+// be invalidated, a changed function simply gets a different key. Entries
+// are written to a temporary file and renamed into place, builds running at
+// the same time never read half of one.
+class FunctionCache
+{
+protected:
+  std::string directory;
+  std::atomic<unsigned> hits;
+  std::atomic<unsigned> misses;
+
+  std::string getPath(const std::string &key)
+  {
+    return directory + "/" + key.substr(0, 2) + "/" + key.substr(2) + ".bc";
+  }
+
+public:
+  FunctionCache(std::string directory) : directory(std::move(directory)), hits(0), misses(0){};
+
+  unsigned getHits() { return hits; }
+  unsigned getMisses() { return misses; }
+
+  std::unique_ptr<llvm::MemoryBuffer> load(const std::string &key)
+  {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getFile(getPath(key));
+    if (!buffer)
+    {
+      misses++;
+      return nullptr;
+    }
+
+    hits++;
+    return std::move(*buffer);
+  }
+
+  bool store(const std::string &key, llvm::StringRef bitcode)
+  {
+    std::string path = getPath(key);
+    if (llvm::sys::fs::create_directories(llvm::sys::path::parent_path(path)))
+    {
+      return false;
+    }
+
+    int fd;
+    llvm::SmallString<128> temporaryPath;
+    if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, temporaryPath))
+    {
+      return false;
+    }
+
+    {
+      llvm::raw_fd_ostream output(fd, true);
+      output << bitcode;
+      if (output.has_error())
+      {
+        output.clear_error();
+        llvm::sys::fs::remove(temporaryPath);
+        return false;
+      }
+    }
+
+    if (llvm::sys::fs::rename(temporaryPath, path))
+    {
+      llvm::sys::fs::remove(temporaryPath);
+      return false;
+    }
+
+    return true;
+  }
+};
@@ -0,0 +1,434 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "../Optimizer/include.h"
+#include "../Runtime/include.h"
+
+// The JIT compiles for the same CPU, features and codegen level as the
+// machine the module was optimised for.
+llvm::orc::JITTargetMachineBuilder CreateJITTargetMachineBuilder(llvm::TargetMachine *targetMachine)
+{
+  llvm::orc::JITTargetMachineBuilder machineBuilder(targetMachine->getTargetTriple());
+  machineBuilder.setCPU(targetMachine->getTargetCPU().str());
+  machineBuilder.addFeatures(llvm::SubtargetFeatures(targetMachine->getTargetFeatureString()).getFeatures());
+  machineBuilder.setCodeGenOptLevel(targetMachine->getOptLevel());
+  machineBuilder.setRelocationModel(llvm::Reloc::PIC_);
+  return machineBuilder;
+}
+
+// Hands the module to an LLJIT instance, resolves extern declarations
+// against the symbols of this process and calls main. The time from creating
+// the JIT until main is compiled and about to run is reported on stderr.
+int RunModule(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context, llvm::TargetMachine *targetMachine)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> jit = llvm::orc::LLJITBuilder()
+                                                              .setJITTargetMachineBuilder(CreateJITTargetMachineBuilder(targetMachine))
+                                                              .create();
+  if (!jit)
+  {
+    llvm::logAllUnhandledErrors(jit.takeError(), llvm::errs(), "jit: ");
+    return 1;
+  }
+
+  llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator>> processSymbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess((*jit)->getDataLayout().getGlobalPrefix());
+  if (!processSymbols)
+  {
+    llvm::logAllUnhandledErrors(processSymbols.takeError(), llvm::errs(), "jit: ");
+    return 1;
+  }
+  (*jit)->getMainJITDylib().addGenerator(std::move(*processSymbols));
+  if (llvm::Error error = (*jit)->getMainJITDylib().define(llvm::orc::absoluteSymbols(GetRuntimeSymbols(**jit))))
+  {
+    llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "jit: ");
+    return 1;
+  }
+
+  if (llvm::Error error = (*jit)->addIRModule(llvm::orc::ThreadSafeModule(std::move(module), std::move(context))))
+  {
+    llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "jit: ");
+    return 1;
+  }
+
+  llvm::Expected<llvm::JITEvaluatedSymbol> mainSymbol = (*jit)->lookup("main");
+  if (!mainSymbol)
+  {
+    llvm::logAllUnhandledErrors(mainSymbol.takeError(), llvm::errs(), "jit: ");
+    return 1;
+  }
+
+  int (*mainFunction)() = (int (*)())mainSymbol->getAddress();
+  std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - start;
+  llvm::errs() << llvm::format("jit: main ready after %.3f ms\n", latency.count());
+
+  return mainFunction();
+}
+
+// Compiles modules whose identifier ends in "$tier0" without machine level
+// optimisation and every other module at the level of the machine builder.
+class TieredCompiler : public llvm::orc::IRCompileLayer::IRCompiler
+{
+private:
+  llvm::orc::JITTargetMachineBuilder machineBuilder;
+
+public:
+  TieredCompiler(llvm::orc::JITTargetMachineBuilder machineBuilder) : IRCompiler(llvm::orc::irManglingOptionsFromTargetOptions(machineBuilder.getOptions())),
+                                                                      machineBuilder(std::move(machineBuilder)){};
+
+  llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> operator()(llvm::Module &module) override
+  {
+    llvm::orc::JITTargetMachineBuilder builder = machineBuilder;
+    if (llvm::StringRef(module.getModuleIdentifier()).endswith("$tier0"))
+    {
+      builder.setCodeGenOptLevel(llvm::CodeGenOpt::None);
+    }
+
+    llvm::Expected<std::unique_ptr<llvm::TargetMachine>> targetMachine = builder.createTargetMachine();
+    if (!targetMachine)
+    {
+      return targetMachine.takeError();
+    }
+
+    return llvm::orc::SimpleCompiler(**targetMachine)(module);
+  }
+};
+
+// Runs a module in two tiers. Every function is first compiled at -O0 with an
+// entry counter and is called through an indirect stub. When a counter
+// reaches the threshold the function is queued for a background thread that
+// recompiles it from the pristine IR at the tier up level, with the other
+// functions available for inlining, and then points its stub at the new code.
+class TieredJIT
+{
+private:
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+  std::unique_ptr<llvm::orc::IndirectStubsManager> stubsManager;
+  llvm::TargetMachine *targetMachine;
+  llvm::OptimizationLevel tierUpLevel;
+  uint64_t threshold;
+
+  llvm::SmallVector<char, 0> bitcode;
+  std::vector<std::string> functionNames;
+
+  std::mutex queueMutex;
+  std::condition_variable queueCondition;
+  std::deque<unsigned> queue;
+  bool isStopping = false;
+  std::thread worker;
+
+  static void onTierUp(TieredJIT *engine, uint32_t index)
+  {
+    std::lock_guard<std::mutex> lock(engine->queueMutex);
+    engine->queue.push_back(index);
+    engine->queueCondition.notify_one();
+  }
+
+  void logError(llvm::Error error)
+  {
+    llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "tier: ");
+  }
+
+  llvm::Error defineAbsolute(const std::string &name, llvm::JITTargetAddress address)
+  {
+    llvm::JITEvaluatedSymbol symbol(address, llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+    return jit->getMainJITDylib().define(llvm::orc::absoluteSymbols({{jit->mangleAndIntern(name), symbol}}));
+  }
+
+  // Counts calls in a global next to the function. The counter is not atomic,
+  // racing threads may lose increments, which only delays the tier up.
+  void instrument(llvm::Module *module, llvm::Function *function, unsigned index)
+  {
+    llvm::LLVMContext &context = module->getContext();
+    llvm::Type *int64Ty = llvm::Type::getInt64Ty(context);
+    llvm::Type *int8PtrTy = llvm::Type::getInt8PtrTy(context);
+    llvm::Type *int32Ty = llvm::Type::getInt32Ty(context);
+
+    llvm::GlobalVariable *counter = new llvm::GlobalVariable(*module, int64Ty, false, llvm::GlobalValue::InternalLinkage, llvm::ConstantInt::get(int64Ty, 0), functionNames[index] + "$count");
+    llvm::FunctionCallee tierUp = module->getOrInsertFunction("__gearfuse_tier_up", llvm::FunctionType::get(llvm::Type::getVoidTy(context), {int8PtrTy, int32Ty}, false));
+
+    llvm::BasicBlock &entry = function->getEntryBlock();
+    llvm::BasicBlock::iterator insertPoint = entry.begin();
+    while (llvm::isa<llvm::AllocaInst>(insertPoint))
+    {
+      insertPoint++;
+    }
+
+    llvm::IRBuilder<> tierBuilder(&entry, insertPoint);
+    llvm::Value *count = tierBuilder.CreateAdd(tierBuilder.CreateLoad(int64Ty, counter), llvm::ConstantInt::get(int64Ty, 1), "count");
+    tierBuilder.CreateStore(count, counter);
+    llvm::Value *isHot = tierBuilder.CreateICmpEQ(count, llvm::ConstantInt::get(int64Ty, threshold), "is_hot");
+
+    llvm::Instruction *tierUpTerminator = llvm::SplitBlockAndInsertIfThen(isHot, &*tierBuilder.GetInsertPoint(), false);
+    tierBuilder.SetInsertPoint(tierUpTerminator);
+    llvm::Value *engine = llvm::ConstantExpr::getIntToPtr(llvm::ConstantInt::get(int64Ty, (uint64_t)this), int8PtrTy);
+    tierBuilder.CreateCall(tierUp, {engine, llvm::ConstantInt::get(int32Ty, index)});
+  }
+
+  // Rebuilds the pristine module in a fresh context, keeps the hot function
+  // as name$tier1 and turns every other definition into an
+  // available_externally copy, so it can be inlined but its calls still go
+  // through the stubs.
+  void tierUp(unsigned index)
+  {
+    auto start = std::chrono::steady_clock::now();
+    const std::string &name = functionNames[index];
+
+    std::unique_ptr<llvm::LLVMContext> tierContext(new llvm::LLVMContext());
+    llvm::Expected<std::unique_ptr<llvm::Module>> tierModule = llvm::parseBitcodeFile(llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()), name + "$tier1"), *tierContext);
+    if (!tierModule)
+    {
+      logError(tierModule.takeError());
+      return;
+    }
+
+    (*tierModule)->setModuleIdentifier(name + "$tier1");
+    for (llvm::Function &function : **tierModule)
+    {
+      if (function.isDeclaration())
+      {
+        continue;
+      }
+
+      if (function.getName() == name)
+      {
+        function.setName(name + "$tier1");
+        function.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      }
+      else
+      {
+        function.setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+      }
+    }
+
+    for (llvm::GlobalVariable &global : (*tierModule)->globals())
+    {
+      if (!global.isDeclaration())
+      {
+        global.setInitializer(nullptr);
+        global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      }
+    }
+
+    OptimizeModule(tierModule->get(), tierUpLevel, targetMachine);
+
+    if (llvm::Error error = jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(*tierModule), std::move(tierContext))))
+    {
+      logError(std::move(error));
+      return;
+    }
+
+    llvm::Expected<llvm::JITEvaluatedSymbol> symbol = jit->lookup(name + "$tier1");
+    if (!symbol)
+    {
+      logError(symbol.takeError());
+      return;
+    }
+
+    if (llvm::Error error = stubsManager->updatePointer(name, symbol->getAddress()))
+    {
+      logError(std::move(error));
+      return;
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    llvm::errs() << llvm::format("tier: %s recompiled after %llu calls in %.3f ms\n", name.c_str(), (unsigned long long)threshold, elapsed.count());
+  }
+
+  void work()
+  {
+    while (true)
+    {
+      unsigned index;
+      {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queueCondition.wait(lock, [this]
+                            { return isStopping || !queue.empty(); });
+        if (isStopping)
+        {
+          return;
+        }
+
+        index = queue.front();
+        queue.pop_front();
+      }
+
+      tierUp(index);
+    }
+  }
+
+public:
+  TieredJIT(llvm::TargetMachine *targetMachine, llvm::OptimizationLevel tierUpLevel, uint64_t threshold) : targetMachine(targetMachine),
+                                                                                                         tierUpLevel(tierUpLevel),
+                                                                                                         threshold(threshold){};
+
+  ~TieredJIT()
+  {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      isStopping = true;
+      queueCondition.notify_one();
+    }
+
+    if (worker.joinable())
+    {
+      worker.join();
+    }
+  }
+
+  llvm::Error addModule(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context)
+  {
+    llvm::orc::JITTargetMachineBuilder machineBuilder = CreateJITTargetMachineBuilder(targetMachine);
+    llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> createdJIT = llvm::orc::LLJITBuilder()
+                                                                       .setJITTargetMachineBuilder(machineBuilder)
+                                                                       .setCompileFunctionCreator([](llvm::orc::JITTargetMachineBuilder builder) -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>>
+                                                                                                  { return std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>(new TieredCompiler(std::move(builder))); })
+                                                                       .create();
+    if (!createdJIT)
+    {
+      return createdJIT.takeError();
+    }
+    jit = std::move(*createdJIT);
+
+    llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator>> processSymbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(jit->getDataLayout().getGlobalPrefix());
+    if (!processSymbols)
+    {
+      return processSymbols.takeError();
+    }
+    jit->getMainJITDylib().addGenerator(std::move(*processSymbols));
+    if (llvm::Error error = jit->getMainJITDylib().define(llvm::orc::absoluteSymbols(GetRuntimeSymbols(*jit))))
+    {
+      return error;
+    }
+
+    stubsManager = llvm::orc::createLocalIndirectStubsManagerBuilder(targetMachine->getTargetTriple())();
+    if (llvm::Error error = defineAbsolute("__gearfuse_tier_up", llvm::pointerToJITTargetAddress(&TieredJIT::onTierUp)))
+    {
+      return error;
+    }
+
+    // Tier one functions are built from this copy, before any instrumentation.
+    for (llvm::GlobalVariable &global : module->globals())
+    {
+      if (global.hasLocalLinkage())
+      {
+        global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      }
+    }
+
+    llvm::raw_svector_ostream bitcodeStream(bitcode);
+    llvm::WriteBitcodeToFile(*module, bitcodeStream);
+
+    // Calls are redirected to a declaration with the original name, which
+    // resolves to the stub, and the body moves to name$tier0.
+    std::vector<llvm::Function *> functions;
+    for (llvm::Function &function : *module)
+    {
+      if (!function.isDeclaration())
+      {
+        functions.push_back(&function);
+      }
+    }
+
+    for (unsigned i = 0; i < functions.size(); i++)
+    {
+      llvm::Function *function = functions[i];
+      std::string name = function->getName().str();
+      functionNames.push_back(name);
+
+      function->setName(name + "$tier0");
+      function->setLinkage(llvm::GlobalValue::ExternalLinkage);
+      llvm::Function *declaration = llvm::Function::Create(function->getFunctionType(), llvm::GlobalValue::ExternalLinkage, name, module.get());
+      declaration->setCallingConv(function->getCallingConv());
+      function->replaceAllUsesWith(declaration);
+
+      instrument(module.get(), function, i);
+
+      if (llvm::Error error = stubsManager->createStub(name, 0, llvm::JITSymbolFlags::Exported))
+      {
+        return error;
+      }
+
+      if (llvm::Error error = defineAbsolute(name, stubsManager->findStub(name, false).getAddress()))
+      {
+        return error;
+      }
+    }
+
+    module->setModuleIdentifier(module->getModuleIdentifier() + "$tier0");
+    if (llvm::Error error = jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(module), std::move(context))))
+    {
+      return error;
+    }
+
+    for (unsigned i = 0; i < functionNames.size(); i++)
+    {
+      llvm::Expected<llvm::JITEvaluatedSymbol> symbol = jit->lookup(functionNames[i] + "$tier0");
+      if (!symbol)
+      {
+        return symbol.takeError();
+      }
+
+      if (llvm::Error error = stubsManager->updatePointer(functionNames[i], symbol->getAddress()))
+      {
+        return error;
+      }
+    }
+
+    worker = std::thread(&TieredJIT::work, this);
+    return llvm::Error::success();
+  }
+
+  llvm::Expected<llvm::JITEvaluatedSymbol> lookup(const std::string &name)
+  {
+    return jit->lookup(name);
+  }
+};
+
+int RunModuleTiered(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context, llvm::TargetMachine *targetMachine, llvm::OptimizationLevel tierUpLevel, uint64_t threshold)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  TieredJIT tieredJIT(targetMachine, tierUpLevel, threshold);
+  if (llvm::Error error = tieredJIT.addModule(std::move(module), std::move(context)))
+  {
+    llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "jit: ");
+    return 1;
+  }
+
+  llvm::Expected<llvm::JITEvaluatedSymbol> mainSymbol = tieredJIT.lookup("main");
+  if (!mainSymbol)
+  {
+    llvm::logAllUnhandledErrors(mainSymbol.takeError(), llvm::errs(), "jit: ");
+    return 1;
+  }
+
+  int (*mainFunction)() = (int (*)())mainSymbol->getAddress();
+  std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - start;
+  llvm::errs() << llvm::format("jit: main ready after %.3f ms\n", latency.count());
+
+  return mainFunction();
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/Module.h"
+#include "llvm/LTO/Config.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Caching.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO/ThinLTOBitcodeWriter.h"
+#include "../Target/include.h"
+
+// Writes the module as bitcode together with its module summary. The thin
+// link only reads the summaries to decide which functions every module
+// imports from the others.
+std::string WriteThinLTOBitcode(llvm::Module *module)
+{
+  llvm::LoopAnalysisManager loopAnalysisManager;
+  llvm::FunctionAnalysisManager functionAnalysisManager;
+  llvm::CGSCCAnalysisManager cgsccAnalysisManager;
+  llvm::ModuleAnalysisManager moduleAnalysisManager;
+
+  llvm::PassBuilder passBuilder;
+  passBuilder.registerModuleAnalyses(moduleAnalysisManager);
+  passBuilder.registerCGSCCAnalyses(cgsccAnalysisManager);
+  passBuilder.registerFunctionAnalyses(functionAnalysisManager);
+  passBuilder.registerLoopAnalyses(loopAnalysisManager);
+  passBuilder.crossRegisterProxies(loopAnalysisManager, functionAnalysisManager, cgsccAnalysisManager, moduleAnalysisManager);
+
+  std::string bitcode;
+  llvm::raw_string_ostream output(bitcode);
+  llvm::ModulePassManager modulePassManager;
+  modulePassManager.addPass(llvm::ThinLTOBitcodeWriterPass(output, nullptr));
+  modulePassManager.run(*module, moduleAnalysisManager);
+  output.flush();
+  return bitcode;
+}
+
+// Links bitcode written by WriteThinLTOBitcode into native objects. After
+// the thin link every module is optimised and compiled on its own thread,
+// with the small functions it calls from other modules imported so they
+// can be inlined. Only main and the functions that are not hidden, the
+// exported ones, stay visible outside of the link. Everything else can be
+// internalised and dropped once it is inlined. With a cache
+// directory the objects of modules whose imports did not change are reused.
+// The context of every backend is passed to setupContext before its module
+// is optimised.
+bool ThinLink(std::vector<std::unique_ptr<llvm::MemoryBuffer>> &inputs,
+              std::string cpu,
+              const std::string &features,
+              llvm::OptimizationLevel level,
+              unsigned threads,
+              const std::string &objectPrefix,
+              const std::string &cacheDirectory,
+              std::vector<std::string> &objectPaths,
+              std::function<void(llvm::LLVMContext &)> setupContext = nullptr)
+{
+  llvm::lto::Config config;
+  std::string featureString = GetTargetFeatures(cpu, features);
+  if (cpu == "native")
+  {
+    cpu = llvm::sys::getHostCPUName().str();
+  }
+
+  config.CPU = cpu;
+  llvm::SmallVector<llvm::StringRef, 16> featureList;
+  llvm::SplitString(featureString, featureList, ",");
+  for (int i = 0; i < featureList.size(); i++)
+  {
+    config.MAttrs.push_back(featureList[i].str());
+  }
+  config.RelocModel = llvm::Reloc::PIC_;
+  config.OptLevel = level.getSpeedupLevel();
+  config.CGOptLevel = GetCodeGenOptLevel(level);
+  if (setupContext)
+  {
+    config.PreOptModuleHook = [setupContext](unsigned task, const llvm::Module &module)
+    {
+      setupContext(module.getContext());
+      return true;
+    };
+  }
+
+  // The modules mix typed pointers with the opaque pointers of the language,
+  // see Type/include.h. The backends create their contexts themselves, the
+  // option is the only way to let them read opaque pointers.
+  llvm::StringMap<llvm::cl::Option *> &options = llvm::cl::getRegisteredOptions();
+  if (options.count("opaque-pointers"))
+  {
+    static_cast<llvm::cl::opt<bool> *>(options["opaque-pointers"])->setValue(true);
+  }
+
+  llvm::lto::LTO lto(std::move(config), llvm::lto::createInProcessThinBackend(llvm::heavyweight_hardware_concurrency(threads)));
+
+  // A symbol may be defined strongly in at most one module, as with a
+  // linker. A strong definition prevails over linkonce and weak ones,
+  // otherwise the first of those is kept.
+  std::vector<std::unique_ptr<llvm::lto::InputFile>> files;
+  llvm::StringSet<> strongSymbols;
+  bool hasDuplicates = false;
+  for (int i = 0; i < inputs.size(); i++)
+  {
+    llvm::Expected<std::unique_ptr<llvm::lto::InputFile>> input = llvm::lto::InputFile::create(inputs[i]->getMemBufferRef());
+    if (!input)
+    {
+      llvm::logAllUnhandledErrors(input.takeError(), llvm::errs(), "thinlto: ");
+      return false;
+    }
+
+    for (const llvm::lto::InputFile::Symbol &symbol : (*input)->symbols())
+    {
+      if (!symbol.isUndefined() && !symbol.isWeak() && !strongSymbols.insert(symbol.getName()).second)
+      {
+        llvm::errs() << "thinlto: duplicate symbol: " << symbol.getName() << "\n";
+        hasDuplicates = true;
+      }
+    }
+
+    files.push_back(std::move(*input));
+  }
+
+  if (hasDuplicates)
+  {
+    return false;
+  }
+
+  llvm::StringSet<> definedSymbols;
+  for (int i = 0; i < files.size(); i++)
+  {
+    std::vector<llvm::lto::SymbolResolution> resolutions;
+    for (const llvm::lto::InputFile::Symbol &symbol : files[i]->symbols())
+    {
+      llvm::lto::SymbolResolution resolution;
+      if (!symbol.isUndefined())
+      {
+        bool isStrong = !symbol.isWeak();
+        resolution.Prevailing = (isStrong || !strongSymbols.count(symbol.getName())) && definedSymbols.insert(symbol.getName()).second;
+      }
+      resolution.FinalDefinitionInLinkageUnit = resolution.Prevailing;
+      resolution.VisibleToRegularObj = resolution.Prevailing && (symbol.getName() == "main" || symbol.getVisibility() != llvm::GlobalValue::HiddenVisibility);
+      resolutions.push_back(resolution);
+    }
+
+    if (llvm::Error error = lto.add(std::move(files[i]), resolutions))
+    {
+      llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "thinlto: ");
+      return false;
+    }
+  }
+
+  std::vector<std::string> paths(lto.getMaxTasks());
+  for (int i = 0; i < paths.size(); i++)
+  {
+    paths[i] = objectPrefix + ".lto." + std::to_string(i) + ".o";
+    llvm::sys::fs::remove(paths[i]);
+  }
+
+  llvm::AddStreamFn addStream = [&paths](unsigned task) -> llvm::Expected<std::unique_ptr<llvm::CachedFileStream>>
+  {
+    std::error_code errorCode;
+    std::unique_ptr<llvm::raw_fd_ostream> output(new llvm::raw_fd_ostream(paths[task], errorCode, llvm::sys::fs::OF_None));
+    if (errorCode)
+    {
+      return llvm::errorCodeToError(errorCode);
+    }
+
+    return std::unique_ptr<llvm::CachedFileStream>(new llvm::CachedFileStream(std::move(output), paths[task]));
+  };
+
+  llvm::FileCache cache;
+  if (!cacheDirectory.empty())
+  {
+    llvm::Expected<llvm::FileCache> localCache = llvm::localCache("ThinLTO", "Thin", cacheDirectory, [&paths](unsigned task, std::unique_ptr<llvm::MemoryBuffer> buffer)
+                                                                  {
+      std::error_code errorCode;
+      llvm::raw_fd_ostream output(paths[task], errorCode, llvm::sys::fs::OF_None);
+      if (!errorCode)
+      {
+        output << buffer->getBuffer();
+      } });
+    if (!localCache)
+    {
+      llvm::logAllUnhandledErrors(localCache.takeError(), llvm::errs(), "thinlto: ");
+      return false;
+    }
+
+    cache = std::move(*localCache);
+  }
+
+  if (llvm::Error error = lto.run(addStream, cache))
+  {
+    llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "thinlto: ");
+    return false;
+  }
+
+  // Tasks without any code do not write an object.
+  for (int i = 0; i < paths.size(); i++)
+  {
+    if (llvm::sys::fs::exists(paths[i]))
+    {
+      objectPaths.push_back(paths[i]);
+    }
+  }
+
+  return true;
+}
@@ -120,12 +120,13 @@ Token Lexer::read_token()
     token.value.push_back(current_char);
     next();
 
+    // The period of a range, 0..n, does not belong to the number.
     bool found_period = false;
     while (std::isdigit(current_char) || current_char == '.')
     {
       if (current_char == '.')
       {
-        if (!found_period)
+        if (!found_period && lookahead_char != '.')
         {
           found_period = true;
         }
@@ -171,6 +172,20 @@ Token Lexer::read_token()
     return token;
   }
 
+  // @soa, the value is the name without the @.
+  if (current_char == '@')
+  {
+    next();
+    while (std::isalpha(current_char) || std::isdigit(current_char) || current_char == '_')
+    {
+      token.value.push_back(current_char);
+      next();
+    }
+
+    token.type = Token::Type::ANNOTATION;
+    return token;
+  }
+
   if (one_character_tokens.count(current_char))
   {
     token.value.push_back(current_char);
@@ -237,6 +252,30 @@ Token Lexer::read_token()
     return token;
   }
 
+  if (current_char == '.')
+  {
+    token.value.push_back(current_char);
+    next();
+    if (current_char == '.')
+    {
+      token.value.push_back(current_char);
+      next();
+      if (current_char == '.')
+      {
+        token.value.push_back(current_char);
+        token.type = Token::Type::ELLIPSIS;
+        next();
+        return token;
+      }
+
+      token.type = Token::Type::DOUBLE_PERIOD;
+      return token;
+    }
+
+    token.type = Token::Type::PERIOD;
+    return token;
+  }
+
   if (current_char == '!')
   {
     token.value.push_back(current_char);
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Scalar/SROA.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Format.h"
+
+struct OptimizationLevelName
+{
+  const char *name;
+  llvm::OptimizationLevel level;
+};
+
+std::vector<OptimizationLevelName> optimizationLevels = {
+    {"-O0", llvm::OptimizationLevel::O0},
+    {"-O1", llvm::OptimizationLevel::O1},
+    {"-O2", llvm::OptimizationLevel::O2},
+    {"-O3", llvm::OptimizationLevel::O3},
+    {"-Os", llvm::OptimizationLevel::Os},
+    {"-Oz", llvm::OptimizationLevel::Oz},
+};
+
+bool ParseOptimizationLevel(const char *arg, llvm::OptimizationLevel &level)
+{
+  for (int i = 0; i < optimizationLevels.size(); i++)
+  {
+    if (strcmp(arg, optimizationLevels[i].name) == 0)
+    {
+      level = optimizationLevels[i].level;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Moves heap allocations that do not outlive their function into its frame,
+// see ASTNewExpression. InstCombine turns an allocation that is zeroed into
+// a calloc. An allocation of a known, small size moves when its
+// pointer is only loaded from, stored to, compared, freed or passed to
+// functions that neither keep nor free it. A pointer merged by a phi or a
+// select could still be used after the next allocation of the same site
+// reused the slot, so those stay on the heap. A tail call may not access
+// the frame of its caller, calls marked tail that take the pointer lose the
+// mark and a musttail call keeps the allocation on the heap. The pass runs
+// once inlining and the attributes of the callees are known, SROA then
+// splits the moved objects into registers.
+class StackPromotionPass : public llvm::PassInfoMixin<StackPromotionPass>
+{
+protected:
+  static const uint64_t maxSize = 4096;
+
+  static bool isCallTo(llvm::CallBase *call, llvm::StringRef name)
+  {
+    llvm::Function *callee = call->getCalledFunction();
+    return callee && callee->getName() == name;
+  }
+
+  // The size of an allocation, zero when it is unknown.
+  static uint64_t getAllocationSize(llvm::CallInst *call)
+  {
+    llvm::ConstantInt *size = call->arg_size() > 0 ? llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(0)) : nullptr;
+    if (size && isCallTo(call, "malloc"))
+    {
+      return size->getZExtValue();
+    }
+
+    llvm::ConstantInt *count = call->arg_size() > 1 ? llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(1)) : nullptr;
+    if (size && count && isCallTo(call, "calloc") && size->getZExtValue() <= maxSize && count->getZExtValue() <= maxSize)
+    {
+      return size->getZExtValue() * count->getZExtValue();
+    }
+
+    return 0;
+  }
+
+  bool isPromotable(llvm::CallInst *allocation, std::vector<llvm::CallInst *> &frees, std::vector<llvm::CallInst *> &tailCalls)
+  {
+    std::vector<llvm::Value *> pointers = {allocation};
+    while (!pointers.empty())
+    {
+      llvm::Value *pointer = pointers.back();
+      pointers.pop_back();
+      for (llvm::Use &use : pointer->uses())
+      {
+        llvm::Instruction *user = llvm::cast<llvm::Instruction>(use.getUser());
+        if (llvm::isa<llvm::GetElementPtrInst>(user) || llvm::isa<llvm::BitCastInst>(user))
+        {
+          pointers.push_back(user);
+        }
+        else if (llvm::isa<llvm::LoadInst>(user) || llvm::isa<llvm::ICmpInst>(user))
+        {
+          continue;
+        }
+        else if (llvm::StoreInst *store = llvm::dyn_cast<llvm::StoreInst>(user))
+        {
+          if (store->getValueOperand() == pointer)
+          {
+            return false;
+          }
+        }
+        else if (llvm::CallBase *call = llvm::dyn_cast<llvm::CallBase>(user))
+        {
+          if (isCallTo(call, "free") && pointer->stripPointerCasts() == allocation)
+          {
+            frees.push_back(llvm::cast<llvm::CallInst>(call));
+          }
+          else if (call->isLifetimeStartOrEnd() || llvm::isa<llvm::DbgInfoIntrinsic>(call))
+          {
+            continue;
+          }
+          else if (!call->isArgOperand(&use) || !call->doesNotCapture(call->getArgOperandNo(&use)) || !(call->hasFnAttr(llvm::Attribute::NoFree) || call->onlyReadsMemory()))
+          {
+            return false;
+          }
+          else if (llvm::CallInst *tailCall = llvm::dyn_cast<llvm::CallInst>(call))
+          {
+            if (tailCall->isMustTailCall())
+            {
+              return false;
+            }
+
+            if (tailCall->isTailCall())
+            {
+              tailCalls.push_back(tailCall);
+            }
+          }
+        }
+        else
+        {
+          return false;
+        }
+      }
+    }
+
+    return true;
+  }
+
+public:
+  llvm::PreservedAnalyses run(llvm::Function &function, llvm::FunctionAnalysisManager &analysisManager)
+  {
+    std::vector<llvm::CallInst *> allocations;
+    for (llvm::Instruction &instruction : llvm::instructions(function))
+    {
+      llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+      uint64_t size = call ? getAllocationSize(call) : 0;
+      if (size > 0 && size <= maxSize)
+      {
+        allocations.push_back(call);
+      }
+    }
+
+    bool isChanged = false;
+    for (llvm::CallInst *allocation : allocations)
+    {
+      std::vector<llvm::CallInst *> frees;
+      std::vector<llvm::CallInst *> tailCalls;
+      if (!isPromotable(allocation, frees, tailCalls))
+      {
+        continue;
+      }
+
+      uint64_t size = getAllocationSize(allocation);
+      llvm::IRBuilder<> entryBuilder(&function.getEntryBlock(), function.getEntryBlock().getFirstInsertionPt());
+      llvm::AllocaInst *slot = entryBuilder.CreateAlloca(llvm::ArrayType::get(entryBuilder.getInt8Ty(), size), nullptr, allocation->getName() + ".stack");
+      slot->setAlignment(llvm::Align(16));
+
+      llvm::IRBuilder<> builder(allocation);
+      if (isCallTo(allocation, "calloc"))
+      {
+        builder.CreateMemSet(slot, builder.getInt8(0), size, llvm::Align(16));
+      }
+
+      allocation->replaceAllUsesWith(builder.CreatePointerCast(slot, allocation->getType()));
+      for (llvm::CallInst *free : frees)
+      {
+        free->eraseFromParent();
+      }
+
+      for (llvm::CallInst *tailCall : tailCalls)
+      {
+        tailCall->setTailCallKind(llvm::CallInst::TCK_None);
+      }
+
+      allocation->eraseFromParent();
+      isChanged = true;
+    }
+
+    return isChanged ? llvm::PreservedAnalyses::none() : llvm::PreservedAnalyses::all();
+  }
+};
+
+// Runs the new pass manager's default pipeline for the given level. Codegen
+// already produces SSA form, only address taken variables are left in the
+// entry block allocas made by CreateEntryBlockAlloca for SROA to promote.
+// Modules headed for a ThinLTO link run the pre-link pipeline, which leaves
+// inlining across modules and the late loop passes to the link. Heap
+// allocations that stay in their function are moved to the frame on the
+// way, see StackPromotionPass.
+void OptimizeModule(llvm::Module *module, llvm::OptimizationLevel level, llvm::TargetMachine *targetMachine = nullptr, bool isThinLTOPreLink = false)
+{
+  llvm::LoopAnalysisManager loopAnalysisManager;
+  llvm::FunctionAnalysisManager functionAnalysisManager;
+  llvm::CGSCCAnalysisManager cgsccAnalysisManager;
+  llvm::ModuleAnalysisManager moduleAnalysisManager;
+
+  llvm::PassBuilder passBuilder(targetMachine);
+  passBuilder.registerModuleAnalyses(moduleAnalysisManager);
+  passBuilder.registerCGSCCAnalyses(cgsccAnalysisManager);
+  passBuilder.registerFunctionAnalyses(functionAnalysisManager);
+  passBuilder.registerLoopAnalyses(loopAnalysisManager);
+  passBuilder.crossRegisterProxies(loopAnalysisManager, functionAnalysisManager, cgsccAnalysisManager, moduleAnalysisManager);
+  passBuilder.registerScalarOptimizerLateEPCallback([](llvm::FunctionPassManager &functionPassManager, llvm::OptimizationLevel)
+                                                    {
+                                                      functionPassManager.addPass(StackPromotionPass());
+                                                      functionPassManager.addPass(llvm::SROAPass());
+                                                    });
+
+  llvm::ModulePassManager modulePassManager;
+  if (level == llvm::OptimizationLevel::O0)
+  {
+    modulePassManager = passBuilder.buildO0DefaultPipeline(level, isThinLTOPreLink);
+  }
+  else if (isThinLTOPreLink)
+  {
+    modulePassManager = passBuilder.buildThinLTOPreLinkDefaultPipeline(level);
+  }
+  else
+  {
+    modulePassManager = passBuilder.buildPerModuleDefaultPipeline(level);
+  }
+
+  modulePassManager.run(*module, moduleAnalysisManager);
+}
+
+unsigned CountInstructions(llvm::Module *module)
+{
+  unsigned count = 0;
+  for (llvm::Function &function : *module)
+  {
+    count += function.getInstructionCount();
+  }
+
+  return count;
+}
+
+// Optimises a copy of the module at every level and prints the time the
+// pipeline took against the number of IR instructions it left behind.
+void ReportOptimizationLevels(llvm::Module *module, llvm::TargetMachine *targetMachine = nullptr, llvm::raw_ostream &output = llvm::errs())
+{
+  output << "level  time (ms)  instructions\n";
+  output << llvm::format("%-5s  %9s  %12u\n", (const char *)"input", (const char *)"-", CountInstructions(module));
+
+  for (int i = 0; i < optimizationLevels.size(); i++)
+  {
+    std::unique_ptr<llvm::Module> copy = llvm::CloneModule(*module);
+
+    auto start = std::chrono::steady_clock::now();
+    OptimizeModule(copy.get(), optimizationLevels[i].level, targetMachine);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    output << llvm::format("%-5s  %9.3f  %12u\n", optimizationLevels[i].name, elapsed.count(), CountInstructions(copy.get()));
+  }
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ProfileSummary.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/ProfileCommon.h"
+
+// The counts of one function: how often it was entered, then how often
+// every conditional branch went each way, in the order the branches were
+// generated. The hash of the function's tree tells whether the counts still
+// fit the code.
+struct FunctionProfileData
+{
+  std::string hash;
+  std::vector<uint64_t> counts;
+};
+
+// A profile written by a program built with --profile-generate. Every line
+// holds one function: its name, its hash, the number of counters and the
+// counters.
+class ProfileData
+{
+protected:
+  std::map<std::string, FunctionProfileData> functions;
+  std::unique_ptr<llvm::ProfileSummary> summary;
+
+public:
+  static std::unique_ptr<ProfileData> load(const std::string &path)
+  {
+    std::ifstream input(path);
+    if (!input)
+    {
+      return nullptr;
+    }
+
+    std::unique_ptr<ProfileData> profile(new ProfileData());
+    llvm::InstrProfSummaryBuilder summaryBuilder(llvm::ProfileSummaryBuilder::DefaultCutoffs);
+    std::string line;
+    while (std::getline(input, line))
+    {
+      std::istringstream fields(line);
+      std::string name;
+      FunctionProfileData data;
+      size_t numOfCounters = 0;
+      if (!(fields >> name >> data.hash >> numOfCounters))
+      {
+        continue;
+      }
+
+      // Several runs of the program append to the same file, their counts
+      // add up.
+      data.counts.resize(numOfCounters);
+      for (size_t i = 0; i < numOfCounters && fields >> data.counts[i]; i++)
+      {
+      }
+
+      FunctionProfileData &merged = profile->functions[name];
+      if (merged.hash != data.hash)
+      {
+        merged = data;
+        continue;
+      }
+
+      for (size_t i = 0; i < merged.counts.size() && i < data.counts.size(); i++)
+      {
+        merged.counts[i] += data.counts[i];
+      }
+    }
+
+    for (std::map<std::string, FunctionProfileData>::iterator it = profile->functions.begin(); it != profile->functions.end(); it++)
+    {
+      summaryBuilder.addRecord(llvm::InstrProfRecord(it->second.counts));
+    }
+
+    profile->summary = summaryBuilder.getSummary();
+    return profile;
+  }
+
+  // Returns nothing when the function changed since the profile was taken.
+  const FunctionProfileData *lookup(const std::string &name, const std::string &hash)
+  {
+    std::map<std::string, FunctionProfileData>::iterator it = functions.find(name);
+    if (it == functions.end() || it->second.hash != hash)
+    {
+      return nullptr;
+    }
+
+    return &it->second;
+  }
+
+  // The summary tells the inliner and the block placement what hot and
+  // cold mean for this program.
+  void annotateModule(llvm::Module *module)
+  {
+    module->setProfileSummary(summary->getMD(module->getContext()), llvm::ProfileSummary::PSK_Instr);
+  }
+};
+
+enum class ProfileMode
+{
+  None,
+  Generate,
+  Use,
+};
+
+// Instruments or annotates the function being generated. With
+// --profile-generate the entry and both edges of every conditional branch
+// bump a counter. The counters live in a global of the function's own
+// module, next to a function that prints them, so partitions and cached
+// functions each carry their own. With --profile-use the counts become the
+// function entry count and the branch weights.
+class FunctionProfiler
+{
+protected:
+  ProfileMode mode;
+  llvm::Function *function;
+  std::string name;
+  std::string hash;
+  const FunctionProfileData *data = nullptr;
+  unsigned numOfBranches = 0;
+  llvm::GlobalVariable *counters = nullptr;
+
+  void increment(llvm::IRBuilderBase &builder, llvm::Value *index)
+  {
+    llvm::Type *int64Ty = builder.getInt64Ty();
+    llvm::Value *counter = builder.CreateInBoundsGEP(int64Ty, counters, index, "profile_counter");
+    llvm::Value *count = builder.CreateLoad(int64Ty, counter, "profile_count");
+    builder.CreateStore(builder.CreateAdd(count, builder.getInt64(1)), counter);
+  }
+
+public:
+  FunctionProfiler(ProfileMode mode, ProfileData *profile, llvm::Function *function, std::string hash) : mode(mode),
+                                                                                                       function(function),
+                                                                                                       name(function->getName().str()),
+                                                                                                       hash(std::move(hash))
+  {
+    if (mode == ProfileMode::Use && profile)
+    {
+      data = profile->lookup(name, this->hash);
+    }
+  }
+
+  static std::string getWriterName(const std::string &name)
+  {
+    return "__gearfuse_profile_write." + name;
+  }
+
+  // Called with the builder at the start of the entry block.
+  void enterFunction(llvm::IRBuilderBase &builder)
+  {
+    if (mode == ProfileMode::Generate)
+    {
+      // The real size is only known once the function is generated, see
+      // finishFunction.
+      counters = new llvm::GlobalVariable(*function->getParent(), builder.getInt64Ty(), false, llvm::GlobalValue::PrivateLinkage, builder.getInt64(0), "__gearfuse_profile_placeholder");
+      increment(builder, builder.getInt64(0));
+    }
+    else if (data && !data->counts.empty())
+    {
+      function->setEntryCount(data->counts[0]);
+    }
+  }
+
+  llvm::BranchInst *createCondBr(llvm::IRBuilderBase &builder, llvm::Value *condition, llvm::BasicBlock *trueBlock, llvm::BasicBlock *falseBlock)
+  {
+    unsigned trueIndex = 1 + 2 * numOfBranches;
+    numOfBranches++;
+
+    if (mode == ProfileMode::Generate)
+    {
+      increment(builder, builder.CreateSelect(condition, builder.getInt64(trueIndex), builder.getInt64(trueIndex + 1), "profile_index"));
+    }
+
+    llvm::BranchInst *branch = builder.CreateCondBr(condition, trueBlock, falseBlock);
+    if (data && trueIndex + 1 < data->counts.size())
+    {
+      // Weights are 32 bit, large counts are scaled down together.
+      uint64_t trueCount = data->counts[trueIndex];
+      uint64_t falseCount = data->counts[trueIndex + 1];
+      uint64_t scale = std::max(trueCount, falseCount) / UINT32_MAX + 1;
+      branch->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDBuilder(builder.getContext()).createBranchWeights(trueCount / scale, falseCount / scale));
+    }
+
+    return branch;
+  }
+
+  // Gives the counters their real size and emits the function that prints
+  // them in the profile format.
+  void finishFunction()
+  {
+    if (mode != ProfileMode::Generate)
+    {
+      return;
+    }
+
+    llvm::Module *module = function->getParent();
+    llvm::LLVMContext &context = module->getContext();
+    llvm::IRBuilder<> builder(context);
+    llvm::Type *int64Ty = builder.getInt64Ty();
+    llvm::Type *int8PtrTy = builder.getInt8PtrTy();
+
+    unsigned numOfCounters = 1 + 2 * numOfBranches;
+    llvm::ArrayType *countersTy = llvm::ArrayType::get(int64Ty, numOfCounters);
+    llvm::GlobalVariable *realCounters = new llvm::GlobalVariable(*module, countersTy, false, llvm::GlobalValue::PrivateLinkage, llvm::ConstantAggregateZero::get(countersTy), "__gearfuse_profile." + name);
+    counters->replaceAllUsesWith(llvm::ConstantExpr::getBitCast(realCounters, counters->getType()));
+    counters->eraseFromParent();
+    counters = realCounters;
+
+    llvm::FunctionCallee fprintf = module->getOrInsertFunction("fprintf", llvm::FunctionType::get(builder.getInt32Ty(), {int8PtrTy, int8PtrTy}, true));
+    // main calls its own writer before it is defined.
+    llvm::Function *writer = llvm::cast<llvm::Function>(module->getOrInsertFunction(getWriterName(name), llvm::FunctionType::get(builder.getVoidTy(), {int8PtrTy}, false)).getCallee());
+    writer->setVisibility(llvm::GlobalValue::HiddenVisibility);
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", writer));
+
+    llvm::Value *file = writer->getArg(0);
+    builder.CreateCall(fprintf, {file, builder.CreateGlobalStringPtr("%s %s %u"), builder.CreateGlobalStringPtr(name), builder.CreateGlobalStringPtr(hash), builder.getInt32(numOfCounters)});
+    llvm::Value *counterFormat = builder.CreateGlobalStringPtr(" %" PRIu64);
+    for (unsigned i = 0; i < numOfCounters; i++)
+    {
+      llvm::Value *counter = builder.CreateConstInBoundsGEP2_64(countersTy, counters, 0, i);
+      builder.CreateCall(fprintf, {file, counterFormat, builder.CreateLoad(int64Ty, counter)});
+    }
+
+    builder.CreateCall(fprintf, {file, builder.CreateGlobalStringPtr("\n")});
+    builder.CreateRetVoid();
+  }
+};
+
+// Emits the function main calls before it returns. It appends the counters
+// of every instrumented function to the profile file, so the counts of
+// several runs add up.
+llvm::Function *CreateProfileWriter(llvm::Module *module, const std::string &path, const std::vector<std::string> &names)
+{
+  llvm::LLVMContext &context = module->getContext();
+  llvm::IRBuilder<> builder(context);
+  llvm::Type *int8PtrTy = builder.getInt8PtrTy();
+
+  llvm::FunctionCallee fopen = module->getOrInsertFunction("fopen", llvm::FunctionType::get(int8PtrTy, {int8PtrTy, int8PtrTy}, false));
+  llvm::FunctionCallee fclose = module->getOrInsertFunction("fclose", llvm::FunctionType::get(builder.getInt32Ty(), {int8PtrTy}, false));
+  llvm::Function *writer = llvm::Function::Create(llvm::FunctionType::get(builder.getVoidTy(), false), llvm::GlobalValue::InternalLinkage, "__gearfuse_profile_write", module);
+
+  llvm::BasicBlock *entryBlock = llvm::BasicBlock::Create(context, "entry", writer);
+  llvm::BasicBlock *writeBlock = llvm::BasicBlock::Create(context, "write", writer);
+  llvm::BasicBlock *endBlock = llvm::BasicBlock::Create(context, "end", writer);
+  builder.SetInsertPoint(entryBlock);
+  llvm::Value *file = builder.CreateCall(fopen, {builder.CreateGlobalStringPtr(path), builder.CreateGlobalStringPtr("a")}, "file");
+  builder.CreateCondBr(builder.CreateIsNull(file), endBlock, writeBlock);
+
+  builder.SetInsertPoint(writeBlock);
+  for (int i = 0; i < names.size(); i++)
+  {
+    llvm::FunctionCallee functionWriter = module->getOrInsertFunction(FunctionProfiler::getWriterName(names[i]), llvm::FunctionType::get(builder.getVoidTy(), {int8PtrTy}, false));
+    builder.CreateCall(functionWriter, {file});
+  }
+
+  builder.CreateCall(fclose, {file});
+  builder.CreateBr(endBlock);
+
+  builder.SetInsertPoint(endBlock);
+  builder.CreateRetVoid();
+  return writer;
+}
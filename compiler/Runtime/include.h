@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+#include "../Cache/include.h"
+#include "parallel.cpp"
+
+// The libraries an executable with the runtime is linked with.
+std::vector<std::string> runtimeLibraries = {"stdc++", "pthread"};
+
+// Where the source of the runtime is found when it has to be compiled.
+// GEARFUSE_RUNTIME_DIR in the environment or at build time overrides the
+// directory of this file, which is relative when the compiler was built from
+// a relative path.
+std::string GetRuntimeSourcePath()
+{
+  if (const char *directory = std::getenv("GEARFUSE_RUNTIME_DIR"))
+  {
+    return std::string(directory) + "/parallel.cpp";
+  }
+
+#ifdef GEARFUSE_RUNTIME_DIR
+  return std::string(GEARFUSE_RUNTIME_DIR) + "/parallel.cpp";
+#else
+  return llvm::sys::path::parent_path(__FILE__).str() + "/parallel.cpp";
+#endif
+}
+
+// Compiles the runtime with the system C++ compiler. The object is written
+// to a temporary file and renamed into place, links running at the same
+// time never read half of one.
+bool CompileRuntime(const std::string &compiler, const std::string &sourcePath, const std::vector<llvm::StringRef> &flags, const std::string &objectPath)
+{
+  if (llvm::sys::fs::create_directories(llvm::sys::path::parent_path(objectPath)))
+  {
+    llvm::errs() << "could not create the directory of " << objectPath << "\n";
+    return false;
+  }
+
+  int fd;
+  llvm::SmallString<128> temporaryPath;
+  if (llvm::sys::fs::createUniqueFile(objectPath + ".%%%%%%.tmp", fd, temporaryPath))
+  {
+    llvm::errs() << "could not create " << objectPath << "\n";
+    return false;
+  }
+
+  llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+  std::vector<llvm::StringRef> args = {compiler};
+  args.insert(args.end(), flags.begin(), flags.end());
+  args.insert(args.end(), {"-c", sourcePath, "-o", temporaryPath});
+  std::string error;
+  if (llvm::sys::ExecuteAndWait(compiler, args, llvm::None, {}, 0, 0, &error) != 0)
+  {
+    llvm::errs() << "building the runtime failed" << (error.empty() ? "" : ": " + error) << "\n";
+    llvm::sys::fs::remove(temporaryPath);
+    return false;
+  }
+
+  if (llvm::sys::fs::rename(temporaryPath, objectPath))
+  {
+    llvm::sys::fs::remove(temporaryPath);
+    return false;
+  }
+
+  return true;
+}
+
+// The object of the runtime, for executables whose code calls it. It is
+// built once, never per link. GEARFUSE_RUNTIME_OBJECT in the environment or
+// at build time names an object installed with the compiler, built with
+//
+//   c++ -std=c++14 -O2 -fPIC -c Runtime/parallel.cpp -o parallel.o
+//
+// Without one the runtime is compiled on the first link that needs it and
+// kept in the cache directory, or in the cache directory of the user, under
+// the hash of its source and of the compiler command. Links after that
+// reuse the object until the source changes. Returns an empty path when
+// there is no runtime.
+std::string GetRuntimeObject(const std::string &cacheDirectory)
+{
+  const char *installedPath = std::getenv("GEARFUSE_RUNTIME_OBJECT");
+#ifdef GEARFUSE_RUNTIME_OBJECT
+  if (!installedPath)
+  {
+    installedPath = GEARFUSE_RUNTIME_OBJECT;
+  }
+#endif
+  if (installedPath)
+  {
+    if (!llvm::sys::fs::exists(installedPath))
+    {
+      llvm::errs() << "could not find the runtime object " << installedPath << "\n";
+      return "";
+    }
+
+    return installedPath;
+  }
+
+  llvm::ErrorOr<std::string> compiler = llvm::sys::findProgramByName("c++");
+  if (!compiler)
+  {
+    llvm::errs() << "could not find the system C++ compiler (c++) to build the runtime, set GEARFUSE_RUNTIME_OBJECT\n";
+    return "";
+  }
+
+  std::string sourcePath = GetRuntimeSourcePath();
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> source = llvm::MemoryBuffer::getFile(sourcePath);
+  if (!source)
+  {
+    llvm::errs() << "could not find the runtime source " << sourcePath << ", set GEARFUSE_RUNTIME_DIR or GEARFUSE_RUNTIME_OBJECT\n";
+    return "";
+  }
+
+  std::vector<llvm::StringRef> flags = {"-std=c++14", "-O2", "-fPIC"};
+  llvm::SHA1 hasher;
+  UpdateHash(hasher, (*source)->getBuffer());
+  UpdateHash(hasher, *compiler);
+  for (int i = 0; i < flags.size(); i++)
+  {
+    UpdateHash(hasher, flags[i]);
+  }
+
+  llvm::SmallString<128> directory(cacheDirectory);
+  if (directory.empty() && llvm::sys::path::cache_directory(directory))
+  {
+    llvm::sys::path::append(directory, "gearfuse");
+  }
+  else if (directory.empty())
+  {
+    llvm::sys::path::system_temp_directory(true, directory);
+    llvm::sys::path::append(directory, "gearfuse");
+  }
+
+  llvm::sys::path::append(directory, "runtime", "parallel-" + FinalHash(hasher) + ".o");
+  std::string objectPath = directory.str().str();
+  if (!llvm::sys::fs::exists(objectPath) && !CompileRuntime(*compiler, sourcePath, flags, objectPath))
+  {
+    return "";
+  }
+
+  return objectPath;
+}
+
+// Code run in process finds the runtime in the compiler itself.
+llvm::orc::SymbolMap GetRuntimeSymbols(llvm::orc::LLJIT &jit)
+{
+  llvm::orc::SymbolMap symbols;
+  symbols[jit.mangleAndIntern("__gearfuse_parallel_for")] = llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(&__gearfuse_parallel_for), llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+  return symbols;
+}
@@ -0,0 +1,334 @@
+// The runtime behind parallel for loops. The compiler includes it, so
+// programs run in process call it directly, and links the executables that
+// use it with an object built once, see Runtime/include.h.
+//
+// The loop body is outlined into a function that runs the iterations of a
+// range. The calling thread and the workers of the pool each own a queue of
+// ranges. An owner takes ranges from the back of its queue, idle workers
+// steal from the front of the others. With the static schedule the range is
+// dealt out once in chunks of the grain, or in one block per worker without
+// a grain. With the dynamic schedule a worker splits the range it took in
+// half and queues the second half until the range is no larger than the
+// grain, so idle workers always find large ranges to steal. A thread that
+// finds no range sleeps until one is queued or the loop is done.
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gearfuse_runtime
+{
+  typedef void (*ParallelBody)(void *context, int64_t begin, int64_t end);
+
+  enum ParallelSchedule
+  {
+    Static = 0,
+    Dynamic = 1,
+  };
+
+  struct Range
+  {
+    int64_t begin;
+    int64_t end;
+  };
+
+  class WorkQueue
+  {
+  protected:
+    std::mutex mutex;
+    std::deque<Range> ranges;
+
+  public:
+    void push(Range range)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ranges.push_back(range);
+    }
+
+    bool pop(Range &range)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (ranges.empty())
+      {
+        return false;
+      }
+
+      range = ranges.back();
+      ranges.pop_back();
+      return true;
+    }
+
+    bool isEmpty()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return ranges.empty();
+    }
+
+    bool steal(Range &range)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (ranges.empty())
+      {
+        return false;
+      }
+
+      range = ranges.front();
+      ranges.pop_front();
+      return true;
+    }
+  };
+
+  struct Job
+  {
+    ParallelBody body;
+    void *context;
+    int64_t grain;
+    ParallelSchedule schedule;
+    std::atomic<int64_t> remaining;
+  };
+
+  // Loops started from inside a loop body run on the thread they are started
+  // from.
+  thread_local bool isInsideLoop = false;
+
+  class ThreadPool
+  {
+  protected:
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+    std::condition_variable workCondition;
+    Job *job = nullptr;
+    uint64_t generation = 0;
+    unsigned numOfBusyWorkers = 0;
+    bool isStopping = false;
+
+    // One loop at a time, the queues belong to it.
+    std::mutex loopMutex;
+
+    void execute(Job &current, unsigned index, Range range)
+    {
+      if (current.schedule == Dynamic)
+      {
+        while (range.end - range.begin > current.grain)
+        {
+          int64_t middle = range.begin + (range.end - range.begin) / 2;
+          queues[index]->push({middle, range.end});
+          range.end = middle;
+          notifyWork();
+        }
+      }
+
+      current.body(current.context, range.begin, range.end);
+      if (current.remaining.fetch_sub(range.end - range.begin, std::memory_order_acq_rel) == range.end - range.begin)
+      {
+        notifyWork();
+      }
+    }
+
+    // Sleeping threads check the queues with the mutex held, taking it
+    // before notifying makes sure none of them misses the change.
+    void notifyWork()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+      }
+
+      workCondition.notify_all();
+    }
+
+    bool hasQueuedRanges()
+    {
+      for (size_t i = 0; i < queues.size(); i++)
+      {
+        if (!queues[i]->isEmpty())
+        {
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    bool steal(unsigned index, Range &range)
+    {
+      for (unsigned i = 1; i < queues.size(); i++)
+      {
+        if (queues[(index + i) % queues.size()]->steal(range))
+        {
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    void run(Job &current, unsigned index)
+    {
+      isInsideLoop = true;
+      Range range;
+      while (current.remaining.load(std::memory_order_acquire) > 0)
+      {
+        if (queues[index]->pop(range) || steal(index, range))
+        {
+          execute(current, index, range);
+        }
+        else
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          workCondition.wait(lock, [&]()
+                             { return current.remaining.load(std::memory_order_acquire) == 0 || hasQueuedRanges(); });
+        }
+      }
+
+      isInsideLoop = false;
+    }
+
+    void work(unsigned index)
+    {
+      uint64_t seenGeneration = 0;
+      while (true)
+      {
+        Job *current;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          wakeCondition.wait(lock, [&]()
+                             { return isStopping || generation != seenGeneration; });
+          if (isStopping)
+          {
+            return;
+          }
+
+          seenGeneration = generation;
+          current = job;
+          if (!current)
+          {
+            continue;
+          }
+
+          numOfBusyWorkers++;
+        }
+
+        run(*current, index);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--numOfBusyWorkers == 0)
+        {
+          doneCondition.notify_all();
+        }
+      }
+    }
+
+  public:
+    // GEARFUSE_THREADS overrides the number of threads, the calling thread
+    // included.
+    ThreadPool()
+    {
+      unsigned numOfThreads = std::max(1u, std::thread::hardware_concurrency());
+      if (const char *threadsVariable = std::getenv("GEARFUSE_THREADS"))
+      {
+        numOfThreads = std::max(1, std::atoi(threadsVariable));
+      }
+
+      for (unsigned i = 0; i < numOfThreads; i++)
+      {
+        queues.emplace_back(new WorkQueue());
+      }
+
+      for (unsigned i = 1; i < numOfThreads; i++)
+      {
+        threads.emplace_back(&ThreadPool::work, this, i);
+      }
+    }
+
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+      }
+
+      wakeCondition.notify_all();
+      for (size_t i = 0; i < threads.size(); i++)
+      {
+        threads[i].join();
+      }
+    }
+
+    unsigned getNumOfThreads() { return queues.size(); }
+
+    void parallelFor(int64_t begin, int64_t end, int64_t grain, ParallelSchedule schedule, ParallelBody body, void *context)
+    {
+      std::lock_guard<std::mutex> loopLock(loopMutex);
+      Job current;
+      current.body = body;
+      current.context = context;
+      current.schedule = schedule;
+      current.remaining.store(end - begin);
+
+      int64_t count = end - begin;
+      if (schedule == Dynamic)
+      {
+        // Without a grain every thread gets about eight ranges.
+        current.grain = grain > 0 ? grain : std::max<int64_t>(1, count / (8 * (int64_t)queues.size()));
+        queues[0]->push({begin, end});
+      }
+      else
+      {
+        current.grain = grain > 0 ? grain : (count + queues.size() - 1) / queues.size();
+        for (int64_t chunk = 0; begin + chunk * current.grain < end; chunk++)
+        {
+          int64_t chunkBegin = begin + chunk * current.grain;
+          queues[chunk % queues.size()]->push({chunkBegin, std::min(end, chunkBegin + current.grain)});
+        }
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &current;
+        generation++;
+      }
+
+      wakeCondition.notify_all();
+      run(current, 0);
+
+      // The job lives on this stack, no worker may still be reading it.
+      std::unique_lock<std::mutex> lock(mutex);
+      doneCondition.wait(lock, [&]()
+                         { return numOfBusyWorkers == 0; });
+      job = nullptr;
+    }
+  };
+
+  ThreadPool &GetThreadPool()
+  {
+    static ThreadPool pool;
+    return pool;
+  }
+}
+
+// Runs body over [begin, end) on the thread pool. schedule is 0 for static
+// and 1 for dynamic, grain is the chunk size, zero picks one.
+extern "C" void __gearfuse_parallel_for(int64_t begin, int64_t end, int64_t grain, int32_t schedule, gearfuse_runtime::ParallelBody body, void *context)
+{
+  if (end <= begin)
+  {
+    return;
+  }
+
+  if (gearfuse_runtime::isInsideLoop || gearfuse_runtime::GetThreadPool().getNumOfThreads() == 1)
+  {
+    body(context, begin, end);
+    return;
+  }
+
+  gearfuse_runtime::GetThreadPool().parallelFor(begin, end, grain, schedule == 1 ? gearfuse_runtime::Dynamic : gearfuse_runtime::Static, body, context);
+}
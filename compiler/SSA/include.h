@@ -0,0 +1,174 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/ValueHandle.h"
+
+// Builds SSA form while the code is generated, after Braun et al., "Simple
+// and Efficient Construction of Static Single Assignment Form". Every
+// variable keeps its current value per basic block, a read in a block
+// without one looks through the predecessors and places a phi where they
+// meet. A block is sealed once all of its predecessors are known, reads in
+// a block that is not sealed yet get a phi whose operands are filled in when
+// the block is sealed.
+class SSABuilder
+{
+protected:
+  std::map<const void *, std::map<llvm::BasicBlock *, llvm::Value *>> currentDefs;
+  std::map<llvm::BasicBlock *, std::map<const void *, llvm::PHINode *>> incompletePhis;
+  std::map<llvm::PHINode *, const void *> phiVariables;
+  std::set<llvm::BasicBlock *> sealedBlocks;
+
+  llvm::PHINode *createPhi(const void *variable, llvm::Type *type, llvm::BasicBlock *block, llvm::StringRef name)
+  {
+    llvm::PHINode *phi = block->empty() ? llvm::PHINode::Create(type, 0, name, block)
+                                        : llvm::PHINode::Create(type, 0, name, &block->front());
+    phiVariables[phi] = variable;
+    return phi;
+  }
+
+  llvm::Value *readVariableRecursive(const void *variable, llvm::Type *type, llvm::BasicBlock *block, llvm::StringRef name)
+  {
+    llvm::Value *value;
+    if (!isSealed(block))
+    {
+      llvm::PHINode *phi = createPhi(variable, type, block, name);
+      incompletePhis[block][variable] = phi;
+      value = phi;
+    }
+    else if (llvm::BasicBlock *predecessor = block->getSinglePredecessor())
+    {
+      value = readVariable(variable, type, predecessor, name);
+    }
+    else if (llvm::pred_empty(block))
+    {
+      value = llvm::UndefValue::get(type);
+    }
+    else
+    {
+      // The phi is written first so that reads around a loop end at it.
+      llvm::PHINode *phi = createPhi(variable, type, block, name);
+      writeVariable(variable, block, phi);
+      value = addPhiOperands(variable, phi);
+    }
+
+    writeVariable(variable, block, value);
+    return value;
+  }
+
+  llvm::Value *addPhiOperands(const void *variable, llvm::PHINode *phi)
+  {
+    llvm::BasicBlock *block = phi->getParent();
+    for (llvm::BasicBlock *predecessor : llvm::predecessors(block))
+    {
+      phi->addIncoming(readVariable(variable, phi->getType(), predecessor, phi->getName()), predecessor);
+    }
+
+    return tryRemoveTrivialPhi(phi);
+  }
+
+  // A phi that only merges one value, and maybe itself, is that value.
+  llvm::Value *tryRemoveTrivialPhi(llvm::PHINode *phi)
+  {
+    llvm::Value *same = nullptr;
+    for (llvm::Value *operand : phi->incoming_values())
+    {
+      if (operand == same || operand == phi)
+      {
+        continue;
+      }
+
+      if (same)
+      {
+        return phi;
+      }
+
+      same = operand;
+    }
+
+    if (!same)
+    {
+      same = llvm::UndefValue::get(phi->getType());
+    }
+
+    llvm::SmallVector<llvm::WeakVH, 8> users;
+    for (llvm::User *user : phi->users())
+    {
+      if (user != phi && llvm::isa<llvm::PHINode>(user))
+      {
+        users.push_back(user);
+      }
+    }
+
+    std::map<llvm::BasicBlock *, llvm::Value *> &defs = currentDefs[phiVariables[phi]];
+    for (std::map<llvm::BasicBlock *, llvm::Value *>::iterator it = defs.begin(); it != defs.end(); it++)
+    {
+      if (it->second == phi)
+      {
+        it->second = same;
+      }
+    }
+
+    phiVariables.erase(phi);
+    phi->replaceAllUsesWith(same);
+    phi->eraseFromParent();
+
+    // Phis that used this one may have become trivial as well.
+    for (int i = 0; i < users.size(); i++)
+    {
+      llvm::PHINode *user = llvm::dyn_cast_or_null<llvm::PHINode>(users[i]);
+      if (user && isSealed(user->getParent()) && phiVariables.count(user))
+      {
+        tryRemoveTrivialPhi(user);
+      }
+    }
+
+    return same;
+  }
+
+public:
+  void writeVariable(const void *variable, llvm::BasicBlock *block, llvm::Value *value)
+  {
+    currentDefs[variable][block] = value;
+  }
+
+  llvm::Value *readVariable(const void *variable, llvm::Type *type, llvm::BasicBlock *block, llvm::StringRef name = "")
+  {
+    std::map<llvm::BasicBlock *, llvm::Value *> &defs = currentDefs[variable];
+    std::map<llvm::BasicBlock *, llvm::Value *>::iterator it = defs.find(block);
+    if (it != defs.end())
+    {
+      return it->second;
+    }
+
+    return readVariableRecursive(variable, type, block, name);
+  }
+
+  bool isSealed(llvm::BasicBlock *block)
+  {
+    return sealedBlocks.count(block);
+  }
+
+  // Called once no more edges into the block will be added.
+  void sealBlock(llvm::BasicBlock *block)
+  {
+    std::map<llvm::BasicBlock *, std::map<const void *, llvm::PHINode *>>::iterator it = incompletePhis.find(block);
+    sealedBlocks.insert(block);
+    if (it == incompletePhis.end())
+    {
+      return;
+    }
+
+    std::map<const void *, llvm::PHINode *> phis = std::move(it->second);
+    incompletePhis.erase(it);
+    for (std::map<const void *, llvm::PHINode *>::iterator phi = phis.begin(); phi != phis.end(); phi++)
+    {
+      addPhiOperands(phi->first, phi->second);
+    }
+  }
+};
@@ -6,9 +6,11 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Support/raw_ostream.h"
 
-std::unique_ptr<llvm::LLVMContext> context(new llvm::LLVMContext());
-std::unique_ptr<llvm::IRBuilder<>> builder(new llvm::IRBuilder<>(*context));
-std::unique_ptr<llvm::Module> module(new llvm::Module("main.gc", *context));
+// Every thread generates code into its own context and module, see
+// CodegenPartitions.
+thread_local std::unique_ptr<llvm::LLVMContext> context(new llvm::LLVMContext());
+thread_local std::unique_ptr<llvm::IRBuilder<>> builder(new llvm::IRBuilder<>(*context));
+thread_local std::unique_ptr<llvm::Module> module(new llvm::Module("main.gc", *context));
 
 static llvm::AllocaInst *CreateEntryBlockAlloca(llvm::Function *function, llvm::Type *type, llvm::StringRef var_name)
 {
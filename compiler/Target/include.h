@@ -0,0 +1,145 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+llvm::CodeGenOpt::Level GetCodeGenOptLevel(llvm::OptimizationLevel level)
+{
+  if (level == llvm::OptimizationLevel::O0)
+  {
+    return llvm::CodeGenOpt::None;
+  }
+  else if (level == llvm::OptimizationLevel::O1)
+  {
+    return llvm::CodeGenOpt::Less;
+  }
+  else if (level == llvm::OptimizationLevel::O3)
+  {
+    return llvm::CodeGenOpt::Aggressive;
+  }
+
+  return llvm::CodeGenOpt::Default;
+}
+
+// "native" picks the host CPU and every feature it reports, so AVX2 or
+// AVX-512 are used when the machine that compiles has them. Explicit
+// features are appended after the host ones and so take precedence.
+std::string GetTargetFeatures(const std::string &cpu, const std::string &features)
+{
+  std::string result;
+  if (cpu == "native")
+  {
+    llvm::StringMap<bool> hostFeatures;
+    if (llvm::sys::getHostCPUFeatures(hostFeatures))
+    {
+      for (auto &feature : hostFeatures)
+      {
+        result += (result.empty() ? "" : ",") + std::string(feature.second ? "+" : "-") + feature.first().str();
+      }
+    }
+  }
+
+  if (!features.empty())
+  {
+    result += (result.empty() ? "" : ",") + features;
+  }
+
+  return result;
+}
+
+// Creates a machine for the host triple. An empty cpu means the baseline
+// CPU of the triple.
+llvm::TargetMachine *CreateTargetMachine(std::string cpu, const std::string &features, llvm::OptimizationLevel level)
+{
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+
+  std::string triple = llvm::sys::getDefaultTargetTriple();
+  std::string error;
+  const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+  if (!target)
+  {
+    llvm::errs() << error << "\n";
+    return nullptr;
+  }
+
+  std::string featureString = GetTargetFeatures(cpu, features);
+  if (cpu == "native")
+  {
+    cpu = llvm::sys::getHostCPUName().str();
+  }
+  else if (cpu.empty())
+  {
+    cpu = "generic";
+  }
+
+  llvm::TargetOptions options;
+  return target->createTargetMachine(triple, cpu, featureString, options, llvm::Reloc::PIC_, llvm::None, GetCodeGenOptLevel(level));
+}
+
+bool EmitObjectFile(llvm::Module *module, llvm::TargetMachine *targetMachine, const std::string &path)
+{
+  std::error_code errorCode;
+  llvm::raw_fd_ostream output(path, errorCode, llvm::sys::fs::OF_None);
+  if (errorCode)
+  {
+    llvm::errs() << "could not open " << path << ": " << errorCode.message() << "\n";
+    return false;
+  }
+
+  llvm::legacy::PassManager passManager;
+  if (targetMachine->addPassesToEmitFile(passManager, output, nullptr, llvm::CGFT_ObjectFile))
+  {
+    llvm::errs() << "the target can not emit object files\n";
+    return false;
+  }
+
+  passManager.run(*module);
+  output.flush();
+  return true;
+}
+
+// Links through the system C compiler driver so the C runtime and the
+// default libraries are found the same way they are for C programs.
+bool LinkExecutable(const std::vector<std::string> &objectPaths, const std::string &outputPath, const std::vector<std::string> &libraries = {})
+{
+  llvm::ErrorOr<std::string> linker = llvm::sys::findProgramByName("cc");
+  if (!linker)
+  {
+    llvm::errs() << "could not find the system linker (cc)\n";
+    return false;
+  }
+
+  std::vector<std::string> args = {*linker};
+  args.insert(args.end(), objectPaths.begin(), objectPaths.end());
+  args.push_back("-o");
+  args.push_back(outputPath);
+  for (int i = 0; i < libraries.size(); i++)
+  {
+    args.push_back("-l" + libraries[i]);
+  }
+
+  std::vector<llvm::StringRef> argRefs(args.begin(), args.end());
+  std::string error;
+  int result = llvm::sys::ExecuteAndWait(*linker, argRefs, llvm::None, {}, 0, 0, &error);
+  if (result != 0)
+  {
+    llvm::errs() << "linking failed" << (error.empty() ? "" : ": " + error) << "\n";
+    return false;
+  }
+
+  return true;
+}
@@ -15,6 +15,7 @@ public:
     KEYWORD_RETURN,
     KEYWORD_IF,
     KEYWORD_WHILE,
+    KEYWORD_FOR,
     KEYWORD_DO,
     KEYWORD_ELSE,
     KEYWORD_FUNCTION,
@@ -39,6 +40,7 @@ public:
 
     /* ------------- IDENTIFIER --------------- */
     IDENTIFIER,
+    ANNOTATION,
 
     /* ------------- LITERALS --------------- */
     LITERAL_INT,
@@ -63,6 +65,7 @@ public:
     MULTI_LINE_COMMENT,
     ELLIPSIS,
     PERIOD,
+    DOUBLE_PERIOD,
     LINE_BREAK,
     TAB,
 
@@ -244,9 +247,11 @@ std::map<std::string, Token::Type> keywords = {
     {"return", Token::Type::KEYWORD_RETURN},
     {"if", Token::Type::KEYWORD_IF},
     {"while", Token::Type::KEYWORD_WHILE},
+    {"for", Token::Type::KEYWORD_FOR},
     {"do", Token::Type::KEYWORD_DO},
     {"else", Token::Type::KEYWORD_ELSE},
     {"of", Token::Type::KEYWORD_OF},
+    {"in", Token::Type::KEYWORD_IN},
     {"sint1", Token::Type::KEYWORD_SINT1},
     {"sint8", Token::Type::KEYWORD_SINT8},
     {"sint16", Token::Type::KEYWORD_SINT16},
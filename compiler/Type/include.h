@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include "assert.h"
+#include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Type.h"
 #include "../Settings/include.h"
 
@@ -16,6 +17,8 @@ class PointerType;
 class VoidType;
 class FunctionType;
 class ArrayType;
+class SliceType;
+class ClassType;
 
 class Type
 {
@@ -37,6 +40,7 @@ public:
     FixedVectorTyID,
     ScalableVectorTyID,
     TypedPointerTyID,
+    SliceTyID,
   };
 
 protected:
@@ -73,11 +77,16 @@ public:
   static Float128Type *getFloat128Ty();
 
   static IntegerType *getIntegerTy(unsigned numOfBits);
+  static IntegerType *getIntegerTy(unsigned numOfBits, bool IsSigned);
   static IntegerType *getInteger1Ty();
   static IntegerType *getInteger8Ty();
   static IntegerType *getInteger16Ty();
   static IntegerType *getInteger32Ty();
   static IntegerType *getInteger64Ty();
+  static IntegerType *getUnsignedInteger8Ty();
+  static IntegerType *getUnsignedInteger16Ty();
+  static IntegerType *getUnsignedInteger32Ty();
+  static IntegerType *getUnsignedInteger64Ty();
 
   static FunctionType *getFunctionTy(std::vector<Type *> Params, Type *Result, bool IsVarArgs);
   static FunctionType *getFunctionTy(std::vector<Type *> Params, Type *Result);
@@ -90,6 +99,11 @@ public:
   static VoidType *getVoidTy();
 
   static ArrayType *getArrayTy(Type *ElTy, uint64_t NumElements);
+  static ArrayType *getArrayTy(Type *ElTy, uint64_t NumElements, bool IsSoA);
+  static SliceType *getSliceTy(Type *ElTy);
+
+  static ClassType *getClassTy(std::string Name, ClassType *Base, bool IsFinal);
+  static ClassType *getClassTy(std::string Name);
 
   bool isFloat16Ty() { return getTypeID() == TypeID::Float16TyID; }
   bool isFloat32Ty() { return getTypeID() == TypeID::Float32TyID; }
@@ -102,9 +116,13 @@ public:
   bool isVoidTy() { return getTypeID() == TypeID::VoidTyID; }
   bool isStructTy() { return getTypeID() == TypeID::StructTyID; }
   bool isArrayTy() { return getTypeID() == TypeID::ArrayTyID; }
+  bool isSliceTy() { return getTypeID() == TypeID::SliceTyID; }
 
   bool isFloatTy() { return isFloat16Ty() || isFloat32Ty() || isFloat64Ty() || isFloat80Ty() || isFloat128Ty(); }
   bool isNumberTy() { return isFloatTy() || isIntegerTy(); }
+  bool isBoolTy() { return isIntegerTy() && getSubclassData() == 1; }
+  bool isSignedIntegerTy();
+  bool isUnsignedIntegerTy() { return isIntegerTy() && !isSignedIntegerTy(); }
 
   unsigned getSubclassData() const { return SubclassData; }
   virtual llvm::Type *getLLVMTy() = 0;
@@ -212,17 +230,28 @@ public:
 class IntegerType : public Type
 {
 protected:
-  explicit IntegerType(unsigned numOfBits) : Type(TypeID::IntegerTyID)
+  bool IsSigned;
+
+  // int1 is the boolean type, it is always unsigned so it widens with zext.
+  explicit IntegerType(unsigned numOfBits, bool IsSigned = true) : Type(TypeID::IntegerTyID), IsSigned(IsSigned && numOfBits != 1)
   {
     setSubclassData(numOfBits);
   }
 
 public:
   static IntegerType *get(unsigned numOfBits) { return new IntegerType(numOfBits); }
-  IntegerType *copy() override { return new IntegerType(getSubclassData()); }
+  static IntegerType *get(unsigned numOfBits, bool IsSigned) { return new IntegerType(numOfBits, IsSigned); }
+  IntegerType *copy() override { return new IntegerType(getSubclassData(), IsSigned); }
+
+  bool isSigned() const { return IsSigned; }
+
+  bool isEquals(Type *type) override
+  {
+    return Type::isEquals(type) && IsSigned == type->isSignedIntegerTy();
+  }
 
   llvm::Type *getLLVMTy() override { return llvm::Type::getIntNTy(*context, getSubclassData()); }
-  std::string getManglingName() override { return "int" + std::to_string(getSubclassData()); }
+  std::string getManglingName() override { return (IsSigned ? "int" : "uint") + std::to_string(getSubclassData()); }
 };
 
 class PointerType : public Type
@@ -313,31 +342,245 @@ public:
   }
 };
 
+// An array of objects in the struct-of-arrays layout, @soa [T; N], keeps
+// every field of its elements in an array of its own, so a loop over one
+// field reads only that field. The table of a polymorphic class is the same
+// for every element and is not stored.
 class ArrayType : public Type
 {
 protected:
   uint64_t NumElements;
-  ArrayType(Type *ElTy, uint64_t NumElements) : Type(TypeID::ArrayTyID, ElTy->getSubclassData() * NumElements), NumElements(NumElements)
+  bool IsSoA;
+  ArrayType(Type *ElTy, uint64_t NumElements, bool IsSoA = false) : Type(TypeID::ArrayTyID, ElTy->getSubclassData() * NumElements), NumElements(NumElements), IsSoA(IsSoA && ElTy->isStructTy())
   {
     ContainedTys.push_back(ElTy);
   }
 
 public:
-  static ArrayType *get(Type *ElTy, uint64_t NumElements) { return new ArrayType(ElTy, NumElements); }
-  ArrayType *copy() override { return new ArrayType(getElementTy(), NumElements); }
+  static ArrayType *get(Type *ElTy, uint64_t NumElements, bool IsSoA = false) { return new ArrayType(ElTy, NumElements, IsSoA); }
+  ArrayType *copy() override { return new ArrayType(getElementTy(), NumElements, IsSoA); }
+
+  bool isSoA() const { return IsSoA; }
+
+  bool isEquals(Type *type) override
+  {
+    return Type::isEquals(type) && IsSoA == ((ArrayType *)type)->IsSoA;
+  }
 
-  llvm::ArrayType *getLLVMTy() override
+  // The first field of the elements in the LLVM struct of the layout, which
+  // skips the table of a polymorphic class.
+  unsigned getFirstSoAField()
   {
-    return llvm::ArrayType::get(getElementTy()->getLLVMTy(), NumElements);
+    return getElementTy()->getLLVMTy()->getStructNumElements() - getElementTy()->getContainedTysLength();
+  }
+
+  llvm::Type *getLLVMTy() override
+  {
+    if (!IsSoA)
+    {
+      return llvm::ArrayType::get(getElementTy()->getLLVMTy(), NumElements);
+    }
+
+    llvm::StructType *ElementTy = (llvm::StructType *)getElementTy()->getLLVMTy();
+    std::vector<llvm::Type *> Columns;
+    for (unsigned i = getFirstSoAField(); i < ElementTy->getNumElements(); i++)
+    {
+      Columns.push_back(llvm::ArrayType::get(ElementTy->getElementType(i), NumElements));
+    }
+
+    return llvm::StructType::get(*context, Columns);
   }
 
   unsigned getNumElements() const { return NumElements; }
   std::string getManglingName() override
   {
-    return "[" + getElementTy()->getManglingName() + "]";
+    return std::string(IsSoA ? "@soa " : "") + "[" + getElementTy()->getManglingName() + "; " + std::to_string(NumElements) + "]";
+  }
+};
+
+// A view of consecutive elements of an array, [T], the address of the first
+// and the number of elements. It does not own the elements, so passing one
+// copies neither them nor the array.
+class SliceType : public Type
+{
+protected:
+  SliceType(Type *ElTy) : Type(TypeID::SliceTyID, 0)
+  {
+    ContainedTys.push_back(ElTy);
+  }
+
+public:
+  static SliceType *get(Type *ElTy) { return new SliceType(ElTy); }
+  SliceType *copy() override { return new SliceType(getElementTy()); }
+
+  llvm::StructType *getLLVMTy() override
+  {
+    return llvm::StructType::get(*context, {llvm::PointerType::get(*context, 0), llvm::Type::getInt64Ty(*context)});
   }
+
+  std::string getManglingName() override { return "[" + getElementTy()->getManglingName() + "]"; }
 };
 
+// A class, compared by name. The fields of the base come first, so a
+// pointer to an object is a pointer to its base as well. The objects of a
+// class with virtual methods start with a pointer to the table of its
+// methods, which only the class without a base may add. A class is complete
+// before other classes derive from it.
+class ClassType : public Type
+{
+protected:
+  std::string Name;
+  ClassType *Base;
+  bool IsFinal;
+  std::vector<std::string> FieldNames;
+  std::vector<std::string> VirtualMethods;
+  std::vector<ClassType *> Subclasses;
+
+  ClassType(std::string Name, ClassType *Base, bool IsFinal) : Type(TypeID::StructTyID, 0), Name(std::move(Name)), Base(Base), IsFinal(IsFinal)
+  {
+    if (Base)
+    {
+      ContainedTys = Base->ContainedTys;
+      FieldNames = Base->FieldNames;
+      VirtualMethods = Base->VirtualMethods;
+      Base->Subclasses.push_back(this);
+    }
+  }
+
+public:
+  static ClassType *get(std::string Name, ClassType *Base = nullptr, bool IsFinal = false) { return new ClassType(std::move(Name), Base, IsFinal); }
+  ClassType *copy() override { return this; }
+
+  const std::string &getName() const { return Name; }
+  ClassType *getBase() const { return Base; }
+  bool isFinal() const { return IsFinal; }
+  const std::vector<ClassType *> &getSubclasses() const { return Subclasses; }
+
+  void addField(std::string FieldName, Type *FieldTy)
+  {
+    FieldNames.push_back(std::move(FieldName));
+    ContainedTys.push_back(FieldTy);
+  }
+
+  // The index of a field in the LLVM struct, -1 when there is none.
+  int getFieldIndex(const std::string &FieldName) const
+  {
+    for (int i = FieldNames.size() - 1; i >= 0; i--)
+    {
+      if (FieldNames[i] == FieldName)
+      {
+        return i + (isPolymorphic() ? 1 : 0);
+      }
+    }
+
+    return -1;
+  }
+
+  Type *getFieldType(const std::string &FieldName)
+  {
+    int index = getFieldIndex(FieldName);
+    return index < 0 ? nullptr : getContainedType(index - (isPolymorphic() ? 1 : 0));
+  }
+
+  // A method that overrides one of the base only reuses its slot. False
+  // when the class can not have virtual methods.
+  bool addVirtualMethod(const std::string &MethodName)
+  {
+    if (getVirtualMethodIndex(MethodName) >= 0)
+    {
+      return true;
+    }
+
+    if (Base && !Base->isPolymorphic())
+    {
+      return false;
+    }
+
+    VirtualMethods.push_back(MethodName);
+    return true;
+  }
+
+  int getVirtualMethodIndex(const std::string &MethodName) const
+  {
+    for (int i = 0; i < VirtualMethods.size(); i++)
+    {
+      if (VirtualMethods[i] == MethodName)
+      {
+        return i;
+      }
+    }
+
+    return -1;
+  }
+
+  const std::vector<std::string> &getVirtualMethods() const { return VirtualMethods; }
+  bool isPolymorphic() const { return !VirtualMethods.empty(); }
+
+  bool isDerivedFrom(ClassType *Other)
+  {
+    for (ClassType *current = this; current; current = current->Base)
+    {
+      if (current->isEquals(Other))
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  bool isEquals(Type *type) override
+  {
+    return type->isStructTy() && ((ClassType *)type)->Name == Name;
+  }
+
+  llvm::StructType *getLLVMTy() override
+  {
+    llvm::StructType *StructTy = llvm::StructType::getTypeByName(*context, "class." + Name);
+    if (StructTy)
+    {
+      return StructTy;
+    }
+
+    std::vector<llvm::Type *> Fields;
+    if (isPolymorphic())
+    {
+      Fields.push_back(llvm::PointerType::get(*context, 0));
+    }
+
+    for (int i = 0; i < ContainedTys.size(); i++)
+    {
+      Fields.push_back(ContainedTys[i]->getLLVMTy());
+    }
+
+    return llvm::StructType::create(*context, Fields, "class." + Name);
+  }
+
+  std::string getManglingName() override { return Name; }
+
+  // The fields and methods, what the code that uses the class depends on.
+  std::string getLayoutName()
+  {
+    std::string result = Name + (IsFinal ? " final {" : " {");
+    for (int i = 0; i < FieldNames.size(); i++)
+    {
+      result += FieldNames[i] + ": " + ContainedTys[i]->getManglingName() + ", ";
+    }
+
+    for (int i = 0; i < VirtualMethods.size(); i++)
+    {
+      result += "virtual " + VirtualMethods[i] + ", ";
+    }
+
+    return result + "}";
+  }
+};
+
+bool Type::isSignedIntegerTy()
+{
+  return isIntegerTy() && ((IntegerType *)this)->isSigned();
+}
+
 Float16Type *Type::getFloat16Ty()
 {
   return Float16Type::get();
@@ -368,6 +611,11 @@ IntegerType *Type::getIntegerTy(unsigned numOfBits)
   return IntegerType::get(numOfBits);
 }
 
+IntegerType *Type::getIntegerTy(unsigned numOfBits, bool IsSigned)
+{
+  return IntegerType::get(numOfBits, IsSigned);
+}
+
 IntegerType *Type::getInteger1Ty()
 {
   return getIntegerTy(1);
@@ -393,6 +641,26 @@ IntegerType *Type::getInteger64Ty()
   return getIntegerTy(64);
 }
 
+IntegerType *Type::getUnsignedInteger8Ty()
+{
+  return getIntegerTy(8, false);
+}
+
+IntegerType *Type::getUnsignedInteger16Ty()
+{
+  return getIntegerTy(16, false);
+}
+
+IntegerType *Type::getUnsignedInteger32Ty()
+{
+  return getIntegerTy(32, false);
+}
+
+IntegerType *Type::getUnsignedInteger64Ty()
+{
+  return getIntegerTy(64, false);
+}
+
 FunctionType *Type::getFunctionTy(std::vector<Type *> Params, Type *Result, bool IsVarArgs)
 {
   return FunctionType::get(std::move(Params), Result, IsVarArgs);
@@ -431,4 +699,24 @@ VoidType *Type::getVoidTy()
 ArrayType *Type::getArrayTy(Type *ElTy, uint64_t NumElements)
 {
   return ArrayType::get(ElTy, NumElements);
-}
\ No newline at end of file
+}
+
+ArrayType *Type::getArrayTy(Type *ElTy, uint64_t NumElements, bool IsSoA)
+{
+  return ArrayType::get(ElTy, NumElements, IsSoA);
+}
+
+SliceType *Type::getSliceTy(Type *ElTy)
+{
+  return SliceType::get(ElTy);
+}
+
+ClassType *Type::getClassTy(std::string Name, ClassType *Base, bool IsFinal)
+{
+  return ClassType::get(std::move(Name), Base, IsFinal);
+}
+
+ClassType *Type::getClassTy(std::string Name)
+{
+  return ClassType::get(std::move(Name));
+}
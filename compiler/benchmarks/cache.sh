@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+# Builds a program of many functions with an empty function cache, then
+# again with the cache filled, and times both builds. Then checks that
+# exporting one function, which changes how it is called, builds it and its
+# caller again while every other function is reused.
+#
+#   compiler/benchmarks/cache.sh <path to the compiler> [functions] [runs]
+set -e
+
+compiler=$(realpath "${1:?usage: cache.sh <compiler> [functions] [runs]}")
+functions=${2:-3000}
+runs=${3:-3}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+# The compiler does not report success in its exit code, the output file
+# does. Prints the wall time of the build in milliseconds, the argument is
+# appended to the options of the sample and the cache report is left in
+# cache.log.
+build() {
+  rm -f sample.o
+  local start=$(date +%s%N)
+  "$compiler" --sample=functions=$functions$1 -O2 --cache-dir=cache -c -o sample.o >/dev/null 2>cache.log || true
+  local time=$((($(date +%s%N) - start) / 1000000))
+  if [[ ! -f sample.o ]]; then
+    echo "building the sample failed" >&2
+    exit 1
+  fi
+  echo "$time"
+}
+
+# Prints the best time of the builds, with an empty cache before each one
+# when the argument is cold.
+best() {
+  local best=
+  for ((i = 0; i < runs; i++)); do
+    if [[ $1 == cold ]]; then
+      rm -rf cache
+    fi
+    local time=$(build)
+    if [[ -z $best || $time -lt $best ]]; then
+      best=$time
+    fi
+  done
+  echo "$best"
+}
+
+cold=$(best cold)
+build >/dev/null
+warm=$(best warm)
+echo "functions:     $functions"
+echo "empty cache:   $cold ms"
+echo "filled cache:  $warm ms"
+speedup=$((cold * 100 / warm))
+printf "speedup:       %d.%02dx\n" $((speedup / 100)) $((speedup % 100))
+
+exported=$((functions / 2))
+build ",exported=$exported" >/dev/null
+reused=$(sed -n 's/^cache: \([0-9]*\) of .*/\1/p' cache.log)
+echo "exporting f$exported: $reused of $functions functions reused"
+if [[ $reused != $((functions - 2)) ]]; then
+  echo "f$exported and its caller f$((exported + 1)) should have been built again" >&2
+  exit 1
+fi
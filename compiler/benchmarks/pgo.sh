@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+# Builds the branchy sample once with -O2, once instrumented and once with
+# the profile of a training run, then times both optimised builds.
+#
+#   compiler/benchmarks/pgo.sh <path to the compiler> [runs]
+set -e
+
+compiler=$(realpath "${1:?usage: pgo.sh <compiler> [runs]}")
+runs=${2:-5}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+# The compiler does not report success in its exit code, the output file
+# does.
+build() {
+  local output=$1
+  shift
+  "$compiler" --sample=branchy -O2 "$@" -o "$output" >/dev/null || true
+  if [[ ! -x $output ]]; then
+    echo "building $output failed" >&2
+    exit 1
+  fi
+}
+
+build plain
+build instrumented --profile-generate=branchy.profile
+./instrumented || true
+build optimized --profile-use=branchy.profile
+
+# Prints the best wall time of a program in milliseconds.
+best() {
+  local best=
+  for ((i = 0; i < runs; i++)); do
+    local start=$(date +%s%N)
+    "./$1" || true
+    local time=$((($(date +%s%N) - start) / 1000000))
+    if [[ -z $best || $time -lt $best ]]; then
+      best=$time
+    fi
+  done
+  echo "$best"
+}
+
+plain=$(best plain)
+optimized=$(best optimized)
+echo "-O2:                $plain ms"
+echo "-O2 --profile-use:  $optimized ms"
+speedup=$((plain * 100 / optimized))
+printf "speedup:            %d.%02dx\n" $((speedup / 100)) $((speedup % 100))
@@ -1,7 +1,33 @@
 #include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+#include <thread>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "llvm/Support/DivisionByConstantInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "./Settings/include.h"
 #include "./Type/include.h"
 #include "./Token/include.h"
+#include "./Optimizer/include.h"
+#include "./Target/include.h"
+#include "./JIT/include.h"
+#include "./SSA/include.h"
+#include "./Cache/include.h"
+#include "./LTO/include.h"
+#include "./Profile/include.h"
+#include "./Runtime/include.h"
+#include "llvm/IR/Verifier.h"
 // #include "./AST/include.h"
 
 void TestTypes(std::vector<Type *> types)
@@ -47,6 +73,11 @@ Type *getTypeFromTwoTypes(Type *type1, Type *type2)
   {
     return type1->copy();
   }
+  else if (type1->isIntegerTy() && type2->isIntegerTy() && type1->getSubclassData() == type2->getSubclassData())
+  {
+    // As in C, the unsigned type wins over a signed type of the same width.
+    return type1->isUnsignedIntegerTy() ? type1->copy() : type2->copy();
+  }
   else if (type1->isNumberTy() && type2->isNumberTy())
   {
     if (type1->getSubclassData() > type2->getSubclassData())
@@ -73,6 +104,232 @@ Type *getTypeFromTwoTypes(Type *type1, Type *type2)
   }
 }
 
+thread_local SSABuilder *globalSSABuilder(new SSABuilder());
+
+// Whether an error was reported while generating the program, the compile
+// fails then. Partitions are generated on threads of their own.
+std::atomic<bool> globalHasErrors(false);
+
+void ReportError(const std::string &message)
+{
+  llvm::errs() << "error: " << message << "\n";
+  globalHasErrors = true;
+}
+
+ProfileMode globalProfileMode = ProfileMode::None;
+ProfileData *globalProfileData = nullptr;
+thread_local FunctionProfiler *globalFunctionProfiler = nullptr;
+
+// Conditional branches go through the profiler of the function being
+// generated, so that they are counted or get their weights.
+llvm::BranchInst *CreateProfiledCondBr(llvm::Value *condition, llvm::BasicBlock *trueBlock, llvm::BasicBlock *falseBlock)
+{
+  if (globalFunctionProfiler)
+  {
+    return globalFunctionProfiler->createCondBr(*builder, condition, trueBlock, falseBlock);
+  }
+
+  return builder->CreateCondBr(condition, trueBlock, falseBlock);
+}
+
+// The loop ID of a latch branch, llvm.loop metadata. The first operand of
+// the distinct node is the node itself, the others are the properties of
+// the loop.
+llvm::MDNode *CreateLoopID(std::vector<llvm::Metadata *> properties)
+{
+  properties.insert(properties.begin(), nullptr);
+  llvm::MDNode *loopID = llvm::MDNode::getDistinct(*context, properties);
+  loopID->replaceOperandWith(0, loopID);
+  return loopID;
+}
+
+// The source annotations of a loop, @vectorize(width=8), @unroll(4) and
+// @interleave(2). They become properties of its loop ID. Zero leaves the
+// choice to the optimiser, one turns the transformation off.
+struct LoopHints
+{
+  unsigned vectorizeWidth = 0;
+  unsigned unrollCount = 0;
+  unsigned interleaveCount = 0;
+
+  std::string getManglingName()
+  {
+    return std::to_string(vectorizeWidth) + "," + std::to_string(unrollCount) + "," + std::to_string(interleaveCount);
+  }
+
+  std::vector<llvm::Metadata *> getProperties()
+  {
+    std::vector<llvm::Metadata *> properties;
+    llvm::Type *int32Ty = builder->getInt32Ty();
+    auto property = [&](const char *name, llvm::Constant *value)
+    {
+      properties.push_back(llvm::MDNode::get(*context, {llvm::MDString::get(*context, name), llvm::ConstantAsMetadata::get(value)}));
+    };
+
+    if (vectorizeWidth == 1)
+    {
+      property("llvm.loop.vectorize.enable", builder->getFalse());
+    }
+    else if (vectorizeWidth > 1)
+    {
+      property("llvm.loop.vectorize.enable", builder->getTrue());
+      property("llvm.loop.vectorize.width", llvm::ConstantInt::get(int32Ty, vectorizeWidth));
+    }
+
+    if (interleaveCount > 0)
+    {
+      property("llvm.loop.interleave.count", llvm::ConstantInt::get(int32Ty, interleaveCount));
+    }
+
+    if (unrollCount == 1)
+    {
+      properties.push_back(llvm::MDNode::get(*context, llvm::MDString::get(*context, "llvm.loop.unroll.disable")));
+    }
+    else if (unrollCount > 1)
+    {
+      property("llvm.loop.unroll.count", llvm::ConstantInt::get(int32Ty, unrollCount));
+    }
+
+    return properties;
+  }
+};
+
+// Self-recursive tail calls of the function being generated jump back to
+// this block instead, see ASTFunction::codegen.
+thread_local llvm::BasicBlock *globalTailRecurseBlock = nullptr;
+
+bool globalReportTailCalls = false;
+std::mutex globalReportMutex;
+
+// With --report-tail-calls every call that is returned, or used by a
+// return, tells whether it became a jump.
+void ReportTailCall(llvm::Function *caller, const std::string &callee, const std::string &result)
+{
+  if (!globalReportTailCalls)
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(globalReportMutex);
+  llvm::errs() << "tail call: " << caller->getName() << " -> " << callee << ": " << result << "\n";
+}
+
+bool globalReportLoops = false;
+
+// With --report-loops the vectoriser and the unroller tell what they did to
+// every loop, and the loops whose hints could not be followed are reported.
+// Remarks are named after the function and the header block of the loop.
+class LoopRemarkHandler : public llvm::DiagnosticHandler
+{
+protected:
+  static bool isLoopPass(llvm::StringRef passName)
+  {
+    // Remarks of loops with hints are always printed, they have no pass name.
+    return passName.empty() || passName == "loop-vectorize" || passName == "loop-unroll" || passName == "transform-warning";
+  }
+
+public:
+  bool isAnalysisRemarkEnabled(llvm::StringRef passName) const override { return isLoopPass(passName); }
+  bool isMissedOptRemarkEnabled(llvm::StringRef passName) const override { return isLoopPass(passName); }
+  bool isPassedOptRemarkEnabled(llvm::StringRef passName) const override { return isLoopPass(passName); }
+  bool isAnyRemarkEnabled() const override { return true; }
+
+  bool handleDiagnostics(const llvm::DiagnosticInfo &info) override
+  {
+    const llvm::DiagnosticInfoIROptimization *remark = llvm::dyn_cast<llvm::DiagnosticInfoIROptimization>(&info);
+    if (!remark || !isLoopPass(remark->getPassName()))
+    {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(globalReportMutex);
+    llvm::errs() << "loop: " << remark->getFunction().getName();
+    if (const llvm::Value *header = remark->getCodeRegion())
+    {
+      llvm::errs() << " " << header->getName();
+    }
+
+    llvm::errs() << ": " << remark->getMsg() << "\n";
+    return true;
+  }
+};
+
+// Called by every thread that optimises a module, each has a context of its
+// own. The backends of the thin link create their contexts themselves.
+void EnableLoopRemarks(llvm::LLVMContext &moduleContext)
+{
+  if (globalReportLoops)
+  {
+    moduleContext.setDiagnosticHandler(std::unique_ptr<llvm::DiagnosticHandler>(new LoopRemarkHandler()));
+  }
+}
+
+class ASTNumberExpression;
+
+// A number known while compiling, the value of a folded literal or of an
+// expression in ComptimeInterpreter. Integers are kept wrapped to the width
+// of their type and floats rounded to it. Without a type it is unknown.
+struct ComptimeValue
+{
+  Type *type = nullptr;
+  int64_t intValue = 0;
+  double floatValue = 0.0;
+
+  static ComptimeValue integer(int64_t value, Type *type);
+  static ComptimeValue floating(double value, Type *type);
+
+  bool isKnown() const { return type; }
+  ASTNumberExpression *toExpression() const;
+};
+
+// Runs the functions of the program while compiling, see
+// ASTCallExpression::fold. Every call gets a frame with the values of its
+// variables. The interpreter gives up, leaving the call to run time, when
+// the program takes too many steps or recurses too deep.
+class ComptimeInterpreter
+{
+protected:
+  std::vector<llvm::DenseMap<const void *, ComptimeValue>> frames;
+  uint64_t numOfSteps = 0;
+
+public:
+  static const uint64_t maxSteps = 1 << 22;
+  static const unsigned maxDepth = 512;
+
+  ComptimeValue returnValue;
+  bool isReturning = false;
+
+  bool step() { return ++numOfSteps <= maxSteps; }
+
+  bool enterCall()
+  {
+    if (frames.size() >= maxDepth)
+    {
+      return false;
+    }
+
+    frames.emplace_back();
+    return true;
+  }
+
+  void leaveCall()
+  {
+    frames.pop_back();
+    isReturning = false;
+  }
+
+  void setVariable(const void *variable, const ComptimeValue &value)
+  {
+    frames.back()[variable] = value;
+  }
+
+  ComptimeValue getVariable(const void *variable)
+  {
+    llvm::DenseMap<const void *, ComptimeValue>::iterator it = frames.back().find(variable);
+    return it == frames.back().end() ? ComptimeValue() : it->second;
+  }
+};
+
 class ASTNode
 {
 public:
@@ -81,6 +338,7 @@ public:
     ASTExpressionID,
     ASTBinaryExpressionID,
     ASTUnaryExpressionID,
+    ASTCastExpressionID,
     ASTBlockID,
     ASTCallExpressionID,
     ASTStringExpressionID,
@@ -88,12 +346,24 @@ public:
     ASTIntNumberExpressionID,
     ASTFloatNumberExpressionID,
     ASTIdentifierExpressionID,
+    ASTArrayExpressionID,
+    ASTMemberExpressionID,
+    ASTMethodCallExpressionID,
+    ASTReferenceExpressionID,
+    ASTNewExpressionID,
+    ASTIndexExpressionID,
+    ASTSliceExpressionID,
+    ASTLengthExpressionID,
     ASTFucntionID,
     ASTPrototypeID,
     ASTReturnStatementID,
     ASTVariableStatementID,
     ASTAssignVariableStatementID,
     ASTMutateVariableStatementID,
+    ASTMemberAssignStatementID,
+    ASTIndexAssignStatementID,
+    ASTObjectStatementID,
+    ASTDeleteStatementID,
     ASTForStatementID,
     ASTIfStatementID,
     ASTWhileStatementID,
@@ -115,6 +385,15 @@ public:
 
   virtual std::vector<ASTNode *> getChildrenShow() { return std::vector<ASTNode *>(); };
   virtual llvm::Value *codegen() = 0;
+
+  // Adds everything the generated code of this node depends on, apart from
+  // its children.
+  virtual void hash(llvm::SHA1 &hasher)
+  {
+    UpdateHash(hasher, showKind);
+    UpdateHash(hasher, showValue);
+  }
+
   ASTNodeID getASTNodeID() { return ID; }
 };
 
@@ -122,12 +401,19 @@ class ASTStatement : public ASTNode
 {
 public:
   ASTStatement(ASTNodeID ID, std::string showKind = "", std::string showValue = "") : ASTNode(ID, showKind, showValue){};
+
+  virtual void evaluateType(){};
+  virtual ASTStatement *fold() { return this; }
+
+  // Runs the statement in the interpreter, false when it can not be run
+  // while compiling.
+  virtual bool interpret(ComptimeInterpreter &interpreter) { return false; }
 };
 
 class ASTExpression : public ASTStatement
 {
 protected:
-  Type *type;
+  Type *type = nullptr;
 
   explicit ASTExpression(ASTNodeID ID, std::string showKind = "", std::string showValue = "") : ASTStatement(ID, showKind, showValue){};
   explicit ASTExpression(Type *type, ASTNodeID ID, std::string showKind = "", std::string showValue = "") : type(type), ASTStatement(ID, showKind, showValue){};
@@ -135,7 +421,22 @@ protected:
 public:
   Type *getType() { return type; }
   virtual void setType(Type *type) { this->type = type; }
-  virtual void evaluateType(){};
+  virtual ASTExpression *fold() override { return this; }
+
+  // The value of the expression in the interpreter, unknown when it can not
+  // be computed while compiling.
+  virtual ComptimeValue evaluate(ComptimeInterpreter &interpreter) { return ComptimeValue(); }
+
+  bool interpret(ComptimeInterpreter &interpreter) override
+  {
+    return evaluate(interpreter).isKnown();
+  }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTStatement::hash(hasher);
+    UpdateHash(hasher, type ? type->getManglingName() : "");
+  }
 };
 
 class ASTNumberExpression : public ASTExpression
@@ -154,477 +455,6387 @@ public:
 
     this->type = type;
   }
+
+  virtual int64_t getIntValue() = 0;
+  virtual double getFloatValue() = 0;
+
+  ComptimeValue getValue()
+  {
+    return getType()->isFloatTy() ? ComptimeValue::floating(getFloatValue(), getType()) : ComptimeValue::integer(getIntValue(), getType());
+  }
+
+  ComptimeValue evaluate(ComptimeInterpreter &interpreter) override
+  {
+    return getValue();
+  }
+
+  static ASTNumberExpression *asNumber(ASTExpression *expression)
+  {
+    if (expression->getASTNodeID() == ASTNode::ASTIntNumberExpressionID || expression->getASTNodeID() == ASTNode::ASTFloatNumberExpressionID)
+    {
+      return (ASTNumberExpression *)expression;
+    }
+
+    return nullptr;
+  }
 };
 
 class ASIntTNumberExpression : public ASTNumberExpression
 {
+protected:
+  int64_t value;
+
+  static std::string showInteger(int64_t value, Type *type)
+  {
+    int64_t wrapped = wrap(value, type->getSubclassData(), type->isSignedIntegerTy());
+    return type->isSignedIntegerTy() ? std::to_string(wrapped) : std::to_string((uint64_t)wrapped);
+  }
+
 public:
-  ASIntTNumberExpression(Token token) : ASTNumberExpression(token, Type::getInteger32Ty(), ASTNode::ASTIntNumberExpressionID, "IntNumberExpression"){};
+  ASIntTNumberExpression(Token token) : ASTNumberExpression(token, Type::getInteger32Ty(), ASTNode::ASTIntNumberExpressionID, "IntNumberExpression"),
+                                        value(std::strtoll(token.value.c_str(), nullptr, 10)){};
+  ASIntTNumberExpression(int64_t value, Type *type) : ASTNumberExpression(Token(showInteger(value, type), Token::Type::LITERAL_INT), type, ASTNode::ASTIntNumberExpressionID, "IntNumberExpression"),
+                                                      value(value){};
+
+  // Sign or zero extends the low numOfBits bits of value, which is how LLVM
+  // reads an iN constant created with ConstantInt::get(..., isSigned).
+  static int64_t wrap(int64_t value, unsigned numOfBits, bool isSigned)
+  {
+    if (numOfBits >= 64)
+    {
+      return value;
+    }
+
+    if (!isSigned)
+    {
+      return (int64_t)((uint64_t)value & ((1ULL << numOfBits) - 1));
+    }
+
+    return (int64_t)((uint64_t)value << (64 - numOfBits)) >> (64 - numOfBits);
+  }
+
+  int64_t getIntValue() override { return getType()->isIntegerTy() ? wrap(value, getType()->getSubclassData(), getType()->isSignedIntegerTy()) : value; }
+  double getFloatValue() override { return (double)value; }
+
   llvm::Value *codegen() override
   {
-    return llvm::ConstantInt::get(getType()->getLLVMTy(), std::stol(token.value), true);
+    if (getType()->isFloatTy())
+    {
+      return llvm::ConstantFP::get(getType()->getLLVMTy(), (double)value);
+    }
+
+    return llvm::ConstantInt::get(getType()->getLLVMTy(), value, getType()->isSignedIntegerTy());
   }
 };
 
 class ASFloatTNumberExpression : public ASTNumberExpression
 {
+protected:
+  double value;
+
+  static std::string showFloat(double value, Type *type)
+  {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.*g", type->isFloat32Ty() ? 9 : 17, value);
+    return buffer;
+  }
+
 public:
-  ASFloatTNumberExpression(Token token) : ASTNumberExpression(token, Type::getFloat32Ty(), ASTNode::ASTFloatNumberExpressionID, "FloatNumberExpression"){};
+  ASFloatTNumberExpression(Token token) : ASTNumberExpression(token, Type::getFloat32Ty(), ASTNode::ASTFloatNumberExpressionID, "FloatNumberExpression"),
+                                          value(std::strtod(token.value.c_str(), nullptr)){};
+  ASFloatTNumberExpression(double value, Type *type) : ASTNumberExpression(Token(showFloat(round(value, type), type), Token::Type::LITERAL_FLOAT), type, ASTNode::ASTFloatNumberExpressionID, "FloatNumberExpression"),
+                                                       value(round(value, type)){};
+
+  static double round(double value, Type *type)
+  {
+    return type->isFloat32Ty() ? (double)(float)value : value;
+  }
+
+  int64_t getIntValue() override { return (int64_t)value; }
+  double getFloatValue() override { return round(value, getType()); }
+
   llvm::Value *codegen() override
   {
-    return llvm::ConstantFP::get(getType()->getLLVMTy(), std::stof(token.value));
+    return llvm::ConstantFP::get(getType()->getLLVMTy(), value);
   }
 };
 
-class ASTBinaryExpression : public ASTExpression
+ComptimeValue ComptimeValue::integer(int64_t value, Type *type)
+{
+  ComptimeValue result;
+  result.type = type;
+  result.intValue = ASIntTNumberExpression::wrap(value, type->getSubclassData(), type->isSignedIntegerTy());
+  return result;
+}
+
+ComptimeValue ComptimeValue::floating(double value, Type *type)
+{
+  ComptimeValue result;
+  result.type = type;
+  result.floatValue = ASFloatTNumberExpression::round(value, type);
+  return result;
+}
+
+ASTNumberExpression *ComptimeValue::toExpression() const
+{
+  if (type->isFloatTy())
+  {
+    return new ASFloatTNumberExpression(floatValue, type);
+  }
+
+  return new ASIntTNumberExpression(intValue, type);
+}
+
+class ASTCastExpression : public ASTExpression
 {
 protected:
-  Token operatorToken;
-  ASTExpression *leftOperand;
-  ASTExpression *rightOperand;
+  ASTExpression *operand;
 
 public:
-  ASTBinaryExpression(Token operatorToken,
-                      ASTExpression *leftOperand,
-                      ASTExpression *rightOperand) : operatorToken(operatorToken),
-                                                     leftOperand(leftOperand),
-                                                     rightOperand(rightOperand),
-                                                     ASTExpression(ASTNodeID::ASTBinaryExpressionID, "BinaryExpression", operatorToken.value){};
+  ASTCastExpression(ASTExpression *operand, Type *type) : operand(operand),
+                                                          ASTExpression(type, ASTNode::ASTCastExpressionID, "CastExpression", type->getManglingName()){};
+
+  ASTExpression *getOperand() { return operand; }
+
+  // Returns an expression of the given type. Number literals are retyped in
+  // place, anything else is wrapped in a cast, so the operand is never
+  // visited again.
+  static ASTExpression *convert(ASTExpression *expression, Type *type)
+  {
+    Type *expressionType = expression->getType();
+    if (!expressionType || !type || expressionType->isEquals(type))
+    {
+      return expression;
+    }
+
+    if (!type->isBoolTy() && type->isNumberTy())
+    {
+      if (expression->getASTNodeID() == ASTNode::ASTIntNumberExpressionID ||
+          (expression->getASTNodeID() == ASTNode::ASTFloatNumberExpressionID && type->isFloatTy()))
+      {
+        expression->setType(type);
+        return expression;
+      }
+    }
+
+    return new ASTCastExpression(expression, type);
+  }
+
+  void evaluateType() override
+  {
+    operand->evaluateType();
+  }
+
   std::vector<ASTNode *> getChildrenShow() override
   {
     std::vector<ASTNode *> children;
-    children.push_back(leftOperand);
-    children.push_back(rightOperand);
+    children.push_back(operand);
     return std::move(children);
   }
 
-  void evaluateType() override
+  ASTExpression *fold() override
   {
-    leftOperand->evaluateType();
-    rightOperand->evaluateType();
+    operand = operand->fold();
 
-    if (leftOperand->getType()->isIntegerTy() && rightOperand->getType()->isIntegerTy() && operatorToken.type == Token::Type::BACKSLASH)
+    ASTNumberExpression *number = ASTNumberExpression::asNumber(operand);
+    if (!number)
     {
-      setType(Type::getFloat64Ty());
+      return this;
     }
-    else
+
+    ComptimeValue value = foldValue(number->getValue());
+    if (!value.isKnown())
     {
-      setType(getTypeFromTwoTypes(leftOperand->getType(), rightOperand->getType()));
+      return this;
     }
+
+    return value.toExpression();
   }
 
-  void setType(Type *type) override
+  ComptimeValue evaluate(ComptimeInterpreter &interpreter) override
   {
-    leftOperand->setType(type);
-    rightOperand->setType(type);
-    this->type = type;
+    ComptimeValue operandValue = operand->evaluate(interpreter);
+    return operandValue.isKnown() ? foldValue(operandValue) : ComptimeValue();
   }
 
-  llvm::Value *codegen() override
+  // Converts a number the way the generated code does. The result is
+  // unknown where that is undefined.
+  ComptimeValue foldValue(const ComptimeValue &operandValue)
   {
-    Type *leftOperandType = leftOperand->getType();
-    Type *rightOperandType = rightOperand->getType();
+    Type *operandType = operand->getType();
+    if (getType()->isBoolTy())
+    {
+      bool value = operandType->isFloatTy() ? operandValue.floatValue != 0.0 : operandValue.intValue != 0;
+      return ComptimeValue::integer(value, getType());
+    }
 
-    llvm::Value *leftValue = leftOperand->codegen();
-    llvm::Value *rightValue = rightOperand->codegen();
+    if (operandType->isIntegerTy() && (getType()->isFloat32Ty() || getType()->isFloat64Ty()))
+    {
+      int64_t value = operandValue.intValue;
+      return ComptimeValue::floating(operandType->isSignedIntegerTy() ? (double)value : (double)(uint64_t)value, getType());
+    }
+    else if ((operandType->isFloat32Ty() || operandType->isFloat64Ty()) && getType()->isIntegerTy())
+    {
+      // fptosi and fptoui are poison outside of the target range, so leave
+      // those to LLVM.
+      double value = operandValue.floatValue;
+      if (getType()->isSignedIntegerTy())
+      {
+        double limit = std::ldexp(1.0, getType()->getSubclassData() - 1);
+        if (!(value > -limit - 1.0 && value < limit))
+        {
+          return ComptimeValue();
+        }
 
-    if (!leftValue || !rightValue)
+        return ComptimeValue::integer((int64_t)value, getType());
+      }
+
+      double limit = std::ldexp(1.0, getType()->getSubclassData());
+      if (!(value > -1.0 && value < limit))
+      {
+        return ComptimeValue();
+      }
+
+      return ComptimeValue::integer((int64_t)(uint64_t)value, getType());
+    }
+    else if (operandType->isIntegerTy() && getType()->isIntegerTy())
+    {
+      return ComptimeValue::integer(operandValue.intValue, getType());
+    }
+    else if ((operandType->isFloat32Ty() || operandType->isFloat64Ty()) && (getType()->isFloat32Ty() || getType()->isFloat64Ty()))
+    {
+      return ComptimeValue::floating(operandValue.floatValue, getType());
+    }
+
+    return ComptimeValue();
+  }
+
+  llvm::Value *codegen() override
+  {
+    Type *operandType = operand->getType();
+    llvm::Value *operandValue = operand->codegen();
+
+    if (!operandValue)
     {
       return nullptr;
     }
 
-    if (leftOperandType->isFloatTy() && rightOperandType->isFloatTy())
+    llvm::Type *llvmType = getType()->getLLVMTy();
+    if (getType()->isBoolTy())
     {
-      switch (operatorToken.type)
+      if (operandType->isFloatTy())
       {
-      case Token::Type::PLUS:
-        return builder->CreateFAdd(leftValue, rightValue, "add_tmp");
-      case Token::Type::HYPHEN:
-        return builder->CreateFSub(leftValue, rightValue, "sub_tmp");
-      case Token::Type::ASTERISK:
-        return builder->CreateFMul(leftValue, rightValue, "mul_tmp");
-      case Token::Type::BACKSLASH:
-        return builder->CreateFDiv(leftValue, rightValue, "div_tmp");
-      case Token::Type::PERCENT:
-        return builder->CreateFRem(leftValue, rightValue, "rem_tmp");
+        return builder->CreateFCmpUNE(operandValue, llvm::ConstantFP::get(operandValue->getType(), 0.0), "to_bool_tmp");
+      }
+
+      return builder->CreateICmpNE(operandValue, llvm::ConstantInt::get(operandValue->getType(), 0), "to_bool_tmp");
+    }
+
+    if (operandType->isIntegerTy() && getType()->isFloatTy())
+    {
+      if (operandType->isUnsignedIntegerTy())
+      {
+        return builder->CreateUIToFP(operandValue, llvmType, "uint_to_float_tmp");
+      }
+
+      return builder->CreateSIToFP(operandValue, llvmType, "sint_to_float_tmp");
+    }
+    else if (operandType->isFloatTy() && getType()->isIntegerTy())
+    {
+      if (getType()->isUnsignedIntegerTy())
+      {
+        return builder->CreateFPToUI(operandValue, llvmType, "float_to_uint_tmp");
+      }
+
+      return builder->CreateFPToSI(operandValue, llvmType, "float_to_sint_tmp");
+    }
+    else if (operandType->isIntegerTy() && getType()->isIntegerTy())
+    {
+      return builder->CreateIntCast(operandValue, llvmType, operandType->isSignedIntegerTy(), "int_cast_tmp");
+    }
+    else if (operandType->isFloatTy() && getType()->isFloatTy())
+    {
+      return builder->CreateFPCast(operandValue, llvmType, "float_cast_tmp");
+    }
+    else if (operandType->isPointerTy() && getType()->isPointerTy())
+    {
+      // Pointers are untyped, a pointer to an object points to its base too.
+      return operandValue;
+    }
+
+    return nullptr;
+  }
+};
+
+class ASTBinaryExpression : public ASTExpression
+{
+protected:
+  Token operatorToken;
+  ASTExpression *leftOperand;
+  ASTExpression *rightOperand;
+
+public:
+  ASTBinaryExpression(Token operatorToken,
+                      ASTExpression *leftOperand,
+                      ASTExpression *rightOperand) : operatorToken(operatorToken),
+                                                     leftOperand(leftOperand),
+                                                     rightOperand(rightOperand),
+                                                     ASTExpression(ASTNodeID::ASTBinaryExpressionID, "BinaryExpression", operatorToken.value){};
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(leftOperand);
+    children.push_back(rightOperand);
+    return std::move(children);
+  }
+
+  // Operands are typed first and then converted to the operand type of the
+  // operator, so every node is typed exactly once.
+  void evaluateType() override
+  {
+    leftOperand->evaluateType();
+    rightOperand->evaluateType();
+
+    Type *leftOperandType = leftOperand->getType();
+    Type *rightOperandType = rightOperand->getType();
+    if (!leftOperandType || !rightOperandType)
+    {
+      return;
+    }
+
+    Type *operandType;
+    if (operatorToken.type == Token::Type::DOUBLE_AMPERSAND || operatorToken.type == Token::Type::DOUBLE_VBAR)
+    {
+      operandType = Type::getInteger1Ty();
+    }
+    else
+    {
+      operandType = getTypeFromTwoTypes(leftOperandType, rightOperandType);
+    }
+
+    if (operandType->isVoidTy())
+    {
+      return;
+    }
+
+    leftOperand = ASTCastExpression::convert(leftOperand, operandType);
+    rightOperand = ASTCastExpression::convert(rightOperand, operandType);
+
+    if (operatorToken.is_binary_operator_once())
+    {
+      setType(Type::getInteger1Ty());
+    }
+    else
+    {
+      setType(operandType);
+    }
+  }
+
+  ASTExpression *fold() override
+  {
+    leftOperand = leftOperand->fold();
+    rightOperand = rightOperand->fold();
+
+    if (!getType())
+    {
+      return this;
+    }
+
+    ASTNumberExpression *leftNumber = ASTNumberExpression::asNumber(leftOperand);
+    ASTNumberExpression *rightNumber = ASTNumberExpression::asNumber(rightOperand);
+    if (leftNumber && rightNumber)
+    {
+      ComptimeValue value = foldValues(leftNumber->getValue(), rightNumber->getValue());
+      if (value.isKnown())
+      {
+        return value.toExpression();
+      }
+    }
+
+    return simplify(leftNumber, rightNumber);
+  }
+
+  // The right operand of && and || is only run when it decides the result,
+  // as in the generated code.
+  ComptimeValue evaluate(ComptimeInterpreter &interpreter) override
+  {
+    if (!getType())
+    {
+      return ComptimeValue();
+    }
+
+    ComptimeValue leftValue = leftOperand->evaluate(interpreter);
+    if (!leftValue.isKnown())
+    {
+      return ComptimeValue();
+    }
+
+    bool isAnd = operatorToken.type == Token::Type::DOUBLE_AMPERSAND;
+    if ((isAnd || operatorToken.type == Token::Type::DOUBLE_VBAR) && (leftValue.intValue != 0) != isAnd)
+    {
+      return ComptimeValue::integer(!isAnd, getType());
+    }
+
+    ComptimeValue rightValue = rightOperand->evaluate(interpreter);
+    if (!rightValue.isKnown())
+    {
+      return ComptimeValue();
+    }
+
+    return foldValues(leftValue, rightValue);
+  }
+
+  ComptimeValue foldValues(const ComptimeValue &leftValue, const ComptimeValue &rightValue)
+  {
+    Type *operandType = leftOperand->getType();
+    if (operandType->isIntegerTy())
+    {
+      // Arithmetic is done on uint64_t so overflow wraps instead of being UB,
+      // the result is then truncated to the width of the type.
+      int64_t left = leftValue.intValue;
+      int64_t right = rightValue.intValue;
+      bool isSigned = operandType->isSignedIntegerTy();
+      switch (operatorToken.type)
+      {
+      case Token::Type::PLUS:
+        return ComptimeValue::integer((int64_t)((uint64_t)left + (uint64_t)right), getType());
+      case Token::Type::HYPHEN:
+        return ComptimeValue::integer((int64_t)((uint64_t)left - (uint64_t)right), getType());
+      case Token::Type::ASTERISK:
+        return ComptimeValue::integer((int64_t)((uint64_t)left * (uint64_t)right), getType());
+      case Token::Type::BACKSLASH:
+      case Token::Type::DOUBLE_BACKSLASH:
+      case Token::Type::PERCENT:
+      {
+        // Division by zero and MIN / -1 are undefined, keep them for runtime.
+        if (right == 0 || (isSigned && right == -1))
+        {
+          return ComptimeValue();
+        }
+
+        if (!isSigned)
+        {
+          uint64_t quotient = (uint64_t)left / (uint64_t)right;
+          uint64_t remainder = (uint64_t)left % (uint64_t)right;
+          return ComptimeValue::integer(operatorToken.type == Token::Type::PERCENT ? remainder : quotient, getType());
+        }
+
+        int64_t quotient = left / right;
+        int64_t remainder = left % right;
+        if (operatorToken.type == Token::Type::PERCENT)
+        {
+          return ComptimeValue::integer(remainder, getType());
+        }
+
+        if (operatorToken.type == Token::Type::DOUBLE_BACKSLASH && remainder != 0 && (remainder < 0) != (right < 0))
+        {
+          quotient--;
+        }
+
+        return ComptimeValue::integer(quotient, getType());
+      }
       case Token::Type::DOUBLE_AMPERSAND:
-        return builder->CreateLogicalAnd(leftValue, rightValue, "and_tmp");
+        return ComptimeValue::integer(left != 0 && right != 0, getType());
       case Token::Type::DOUBLE_VBAR:
-        return builder->CreateLogicalOr(leftValue, rightValue, "or_tmp");
+        return ComptimeValue::integer(left != 0 || right != 0, getType());
       case Token::Type::DOUBLE_EQUALS:
-        return builder->CreateFCmpOEQ(leftValue, rightValue, "equal_to_tmp");
+        return ComptimeValue::integer(left == right, getType());
       case Token::Type::EXCLAMATION_EQUALS:
-        return builder->CreateFCmpONE(leftValue, rightValue, "not_equal_to_tmp");
+        return ComptimeValue::integer(left != right, getType());
       case Token::Type::RIGHT_ANGULAR_BRACKET:
-        return builder->CreateFCmpOGT(leftValue, rightValue, "greater_than_tmp");
+        return ComptimeValue::integer(isSigned ? left > right : (uint64_t)left > (uint64_t)right, getType());
       case Token::Type::LEFT_ANGULAR_BRACKET:
-        return builder->CreateFCmpOLT(leftValue, rightValue, "lower_than_tmp");
+        return ComptimeValue::integer(isSigned ? left < right : (uint64_t)left < (uint64_t)right, getType());
       case Token::Type::LEFT_ANGULAR_BRACKET_EQUALS:
-        return builder->CreateFCmpOLE(leftValue, rightValue, "lower_than_or_equal_to_tmp");
+        return ComptimeValue::integer(isSigned ? left <= right : (uint64_t)left <= (uint64_t)right, getType());
       case Token::Type::RIGHT_ANGULAR_BRACKET_EQUALS:
-        return builder->CreateFCmpOGE(leftValue, rightValue, "greater_than_or_equal_to_tmp");
+        return ComptimeValue::integer(isSigned ? left >= right : (uint64_t)left >= (uint64_t)right, getType());
       default:
-        return nullptr;
+        return ComptimeValue();
       }
     }
-    else if (leftOperandType->isIntegerTy() && rightOperandType->isIntegerTy())
+    else if (operandType->isFloat32Ty() || operandType->isFloat64Ty())
     {
+      // Comparisons are ordered, as in codegen, so any NaN operand gives false.
+      double left = leftValue.floatValue;
+      double right = rightValue.floatValue;
+      bool isOrdered = !std::isnan(left) && !std::isnan(right);
       switch (operatorToken.type)
       {
       case Token::Type::PLUS:
-        return builder->CreateAdd(leftValue, rightValue, "add_tmp");
+        return ComptimeValue::floating(left + right, getType());
       case Token::Type::HYPHEN:
-        return builder->CreateSub(leftValue, rightValue, "sub_tmp");
+        return ComptimeValue::floating(left - right, getType());
       case Token::Type::ASTERISK:
-        return builder->CreateMul(leftValue, rightValue, "mul_tmp");
+        return ComptimeValue::floating(left * right, getType());
+      case Token::Type::BACKSLASH:
+        return ComptimeValue::floating(left / right, getType());
+      case Token::Type::DOUBLE_BACKSLASH:
+        return ComptimeValue::floating(std::floor(left / right), getType());
       case Token::Type::PERCENT:
-        return builder->CreateSRem(leftValue, rightValue, "rem_tmp");
-      case Token::Type::DOUBLE_AMPERSAND:
-        return builder->CreateLogicalAnd(leftValue, rightValue, "and_tmp");
-      case Token::Type::DOUBLE_VBAR:
-        return builder->CreateLogicalOr(leftValue, rightValue, "or_tmp");
+        return ComptimeValue::floating(std::fmod(left, right), getType());
       case Token::Type::DOUBLE_EQUALS:
-        return builder->CreateICmpEQ(leftValue, rightValue, "equal_to_tmp");
+        return ComptimeValue::integer(isOrdered && left == right, getType());
       case Token::Type::EXCLAMATION_EQUALS:
-        return builder->CreateICmpNE(leftValue, rightValue, "not_equal_to_tmp");
+        return ComptimeValue::integer(isOrdered && left != right, getType());
       case Token::Type::RIGHT_ANGULAR_BRACKET:
-        return builder->CreateICmpSGT(leftValue, rightValue, "greater_than_tmp");
+        return ComptimeValue::integer(isOrdered && left > right, getType());
       case Token::Type::LEFT_ANGULAR_BRACKET:
-        return builder->CreateICmpSLT(leftValue, rightValue, "lower_than_tmp");
+        return ComptimeValue::integer(isOrdered && left < right, getType());
       case Token::Type::LEFT_ANGULAR_BRACKET_EQUALS:
-        return builder->CreateICmpSLE(leftValue, rightValue, "lower_than_or_equal_to_tmp");
+        return ComptimeValue::integer(isOrdered && left <= right, getType());
       case Token::Type::RIGHT_ANGULAR_BRACKET_EQUALS:
-        return builder->CreateICmpSGE(leftValue, rightValue, "greater_than_or_equal_to_tmp");
+        return ComptimeValue::integer(isOrdered && left >= right, getType());
       default:
-        return nullptr;
+        return ComptimeValue();
       }
     }
 
-    return nullptr;
+    return ComptimeValue();
   }
-};
 
-class ASTUnaryExpression : public ASTExpression
-{
-private:
-  Token operatorToken;
-  ASTExpression *operand;
+  // x + 0 is not an identity for floats, since -0.0 + 0.0 is +0.0.
+  ASTExpression *simplify(ASTNumberExpression *leftNumber, ASTNumberExpression *rightNumber)
+  {
+    Type *operandType = leftOperand->getType();
+    if (operandType->isIntegerTy())
+    {
+      bool isLeftZero = leftNumber && leftNumber->getIntValue() == 0;
+      bool isRightZero = rightNumber && rightNumber->getIntValue() == 0;
+      bool isLeftOne = leftNumber && leftNumber->getIntValue() == 1;
+      bool isRightOne = rightNumber && rightNumber->getIntValue() == 1;
+      switch (operatorToken.type)
+      {
+      case Token::Type::PLUS:
+        return isRightZero ? leftOperand : isLeftZero ? rightOperand
+                                                      : this;
+      case Token::Type::HYPHEN:
+        return isRightZero ? leftOperand : this;
+      case Token::Type::ASTERISK:
+        return isRightOne ? leftOperand : isLeftOne ? rightOperand
+                                                    : this;
+      case Token::Type::BACKSLASH:
+      case Token::Type::DOUBLE_BACKSLASH:
+        return isRightOne ? leftOperand : this;
+      default:
+        return this;
+      }
+    }
+    else if (operandType->isFloatTy())
+    {
+      bool isRightZero = rightNumber && rightNumber->getFloatValue() == 0.0;
+      bool isLeftOne = leftNumber && leftNumber->getFloatValue() == 1.0;
+      bool isRightOne = rightNumber && rightNumber->getFloatValue() == 1.0;
+      switch (operatorToken.type)
+      {
+      case Token::Type::HYPHEN:
+        return isRightZero && !std::signbit(rightNumber->getFloatValue()) ? leftOperand : this;
+      case Token::Type::ASTERISK:
+        return isRightOne ? leftOperand : isLeftOne ? rightOperand
+                                                    : this;
+      case Token::Type::BACKSLASH:
+        return isRightOne ? leftOperand : this;
+      default:
+        return this;
+      }
+    }
 
-public:
-  ASTUnaryExpression(Token operatorToken,
-                     ASTExpression *operand) : operatorToken(operatorToken),
-                                               operand(operand),
-                                               ASTExpression(ASTNode::ASTUnaryExpressionID, "UnaryExpression", operatorToken.value){};
-  std::vector<ASTNode *> getChildrenShow() override
+    return this;
+  }
+
+  // Truncating (or, for //, flooring) signed division. A constant divisor
+  // d > 1 becomes shifts when it is a power of two and a multiply by a magic
+  // number otherwise, the same lowering LLVM's DAGCombiner uses for sdiv.
+  llvm::Value *createSignedDivision(llvm::Value *leftValue, llvm::Value *rightValue, bool isFloor)
   {
-    std::vector<ASTNode *> children;
-    children.push_back(operand);
-    return std::move(children);
+    llvm::Type *llvmType = leftValue->getType();
+    unsigned numOfBits = llvmType->getIntegerBitWidth();
+    llvm::Value *zero = llvm::ConstantInt::get(llvmType, 0);
+
+    ASTNumberExpression *divisor = ASTNumberExpression::asNumber(rightOperand);
+    if (!divisor || numOfBits < 2 || divisor->getIntValue() < 1)
+    {
+      llvm::Value *quotient = builder->CreateSDiv(leftValue, rightValue, "div_tmp");
+      if (!isFloor)
+      {
+        return quotient;
+      }
+
+      // sdiv rounds towards zero, step down when the remainder is non-zero
+      // and its sign differs from the divisor's.
+      llvm::Value *remainder = builder->CreateSRem(leftValue, rightValue, "rem_tmp");
+      llvm::Value *isInexact = builder->CreateICmpNE(remainder, zero, "is_inexact_tmp");
+      llvm::Value *isSignDifferent = builder->CreateICmpSLT(builder->CreateXor(remainder, rightValue), zero, "is_sign_different_tmp");
+      llvm::Value *adjustment = builder->CreateZExt(builder->CreateAnd(isInexact, isSignDifferent), llvmType);
+      return builder->CreateSub(quotient, adjustment, "floor_div_tmp");
+    }
+
+    int64_t value = divisor->getIntValue();
+    if (value == 1)
+    {
+      return leftValue;
+    }
+
+    if ((value & (value - 1)) == 0)
+    {
+      unsigned shiftAmount = llvm::Log2_64(value);
+      if (isFloor)
+      {
+        return builder->CreateAShr(leftValue, shiftAmount, "floor_div_tmp");
+      }
+
+      // Negative dividends are biased by value - 1 so the shift rounds
+      // towards zero.
+      llvm::Value *sign = builder->CreateAShr(leftValue, numOfBits - 1, "sign_tmp");
+      llvm::Value *bias = builder->CreateLShr(sign, numOfBits - shiftAmount, "bias_tmp");
+      return builder->CreateAShr(builder->CreateAdd(leftValue, bias), shiftAmount, "div_tmp");
+    }
+
+    llvm::SignedDivisionByConstantInfo magics = llvm::SignedDivisionByConstantInfo::get(llvm::APInt(numOfBits, value, true));
+    llvm::Type *wideType = llvm::Type::getIntNTy(*context, numOfBits * 2);
+    llvm::Value *magic = llvm::ConstantInt::get(wideType, magics.Magic.sext(numOfBits * 2));
+    llvm::Value *product = builder->CreateMul(builder->CreateSExt(leftValue, wideType), magic, "magic_mul_tmp");
+    llvm::Value *quotient = builder->CreateTrunc(builder->CreateLShr(product, numOfBits), llvmType, "mul_high_tmp");
+    if (magics.Magic.isNegative())
+    {
+      quotient = builder->CreateAdd(quotient, leftValue);
+    }
+
+    if (magics.ShiftAmount > 0)
+    {
+      quotient = builder->CreateAShr(quotient, magics.ShiftAmount);
+    }
+
+    quotient = builder->CreateAdd(quotient, builder->CreateLShr(quotient, numOfBits - 1), "div_tmp");
+    if (!isFloor)
+    {
+      return quotient;
+    }
+
+    // The divisor is positive here, so only a negative remainder needs the
+    // quotient to step down.
+    llvm::Value *remainder = builder->CreateSub(leftValue, builder->CreateMul(quotient, rightValue), "rem_tmp");
+    llvm::Value *adjustment = builder->CreateZExt(builder->CreateICmpSLT(remainder, zero, "is_negative_tmp"), llvmType);
+    return builder->CreateSub(quotient, adjustment, "floor_div_tmp");
   }
 
-  void setType(Type *type) override
+  llvm::Value *createUnsignedDivision(llvm::Value *leftValue, llvm::Value *rightValue)
   {
-    operand->setType(type);
-    this->type = type;
+    llvm::Type *llvmType = leftValue->getType();
+    unsigned numOfBits = llvmType->getIntegerBitWidth();
+
+    ASTNumberExpression *divisor = ASTNumberExpression::asNumber(rightOperand);
+    if (!divisor || numOfBits < 2 || divisor->getIntValue() == 0)
+    {
+      return builder->CreateUDiv(leftValue, rightValue, "div_tmp");
+    }
+
+    uint64_t value = (uint64_t)divisor->getIntValue();
+    if (value == 1)
+    {
+      return leftValue;
+    }
+
+    if (llvm::isPowerOf2_64(value))
+    {
+      return builder->CreateLShr(leftValue, llvm::Log2_64(value), "div_tmp");
+    }
+
+    llvm::UnsignedDivisonByConstantInfo magics = llvm::UnsignedDivisonByConstantInfo::get(llvm::APInt(numOfBits, value));
+    llvm::Type *wideType = llvm::Type::getIntNTy(*context, numOfBits * 2);
+    llvm::Value *magic = llvm::ConstantInt::get(wideType, magics.Magic.zext(numOfBits * 2));
+    llvm::Value *product = builder->CreateMul(builder->CreateZExt(leftValue, wideType), magic, "magic_mul_tmp");
+    llvm::Value *quotient = builder->CreateTrunc(builder->CreateLShr(product, numOfBits), llvmType, "mul_high_tmp");
+    if (!magics.IsAdd)
+    {
+      return builder->CreateLShr(quotient, magics.ShiftAmount, "div_tmp");
+    }
+
+    // The magic number needs numOfBits + 1 bits, add the missing top bit back
+    // as ((x - q) / 2 + q) without overflowing.
+    llvm::Value *halfDifference = builder->CreateLShr(builder->CreateSub(leftValue, quotient), 1);
+    return builder->CreateLShr(builder->CreateAdd(halfDifference, quotient), magics.ShiftAmount - 1, "div_tmp");
   }
 
-  void evaluateType() override
+  // Upper bound on the number of low bits an unsigned operand can have set:
+  // literals use only their active bits and zero extended values only the
+  // width they were extended from.
+  static unsigned getActiveBits(ASTExpression *expression)
   {
-    operand->evaluateType();
-    setType(operand->getType());
+    unsigned numOfBits = expression->getType()->getSubclassData();
+    ASTNumberExpression *number = ASTNumberExpression::asNumber(expression);
+    if (number)
+    {
+      uint64_t value = (uint64_t)number->getIntValue();
+      return value == 0 ? 0 : llvm::Log2_64(value) + 1;
+    }
+
+    if (expression->getASTNodeID() == ASTNode::ASTCastExpressionID)
+    {
+      Type *operandType = ((ASTCastExpression *)expression)->getOperand()->getType();
+      if (operandType->isUnsignedIntegerTy() && operandType->getSubclassData() < numOfBits)
+      {
+        return operandType->getSubclassData();
+      }
+    }
+
+    return numOfBits;
+  }
+
+  // The number of bits a signed operand needs, the sign bit included. Like
+  // getActiveBits, literals and values extended from a narrower type need
+  // fewer than their type.
+  static unsigned getSignificantBits(ASTExpression *expression)
+  {
+    unsigned numOfBits = expression->getType()->getSubclassData();
+    ASTNumberExpression *number = ASTNumberExpression::asNumber(expression);
+    if (number)
+    {
+      int64_t value = number->getIntValue();
+      uint64_t magnitude = value < 0 ? ~(uint64_t)value : (uint64_t)value;
+      return (magnitude == 0 ? 0 : llvm::Log2_64(magnitude) + 1) + 1;
+    }
+
+    if (expression->getASTNodeID() == ASTNode::ASTCastExpressionID)
+    {
+      Type *operandType = ((ASTCastExpression *)expression)->getOperand()->getType();
+      unsigned operandBits = operandType->getSubclassData() + (operandType->isUnsignedIntegerTy() ? 1 : 0);
+      if (operandType->isIntegerTy() && operandBits < numOfBits)
+      {
+        return operandBits;
+      }
+    }
+
+    return numOfBits;
+  }
+
+  // Arithmetic wraps in two's complement, as the folder and the interpreter
+  // compute it, so nuw and nsw are only attached when the operands are known
+  // to be too narrow to overflow.
+  bool hasNoSignedWrap()
+  {
+    unsigned numOfBits = leftOperand->getType()->getSubclassData();
+    unsigned leftBits = getSignificantBits(leftOperand);
+    unsigned rightBits = getSignificantBits(rightOperand);
+    switch (operatorToken.type)
+    {
+    case Token::Type::PLUS:
+    case Token::Type::HYPHEN:
+      return std::max(leftBits, rightBits) < numOfBits;
+    case Token::Type::ASTERISK:
+      return leftBits + rightBits <= numOfBits;
+    default:
+      return false;
+    }
+  }
+
+  bool hasNoUnsignedWrap()
+  {
+    unsigned numOfBits = leftOperand->getType()->getSubclassData();
+    unsigned leftActiveBits = getActiveBits(leftOperand);
+    unsigned rightActiveBits = getActiveBits(rightOperand);
+    switch (operatorToken.type)
+    {
+    case Token::Type::PLUS:
+      return std::max(leftActiveBits, rightActiveBits) < numOfBits;
+    case Token::Type::ASTERISK:
+      return leftActiveBits + rightActiveBits <= numOfBits;
+    default:
+      return false;
+    }
+  }
+
+  // The right operand of && and || is only evaluated when the left one does
+  // not decide the result already, the results of both paths meet in a phi.
+  llvm::Value *createShortCircuit(bool isAnd)
+  {
+    llvm::Value *leftValue = leftOperand->codegen();
+    if (!leftValue)
+    {
+      return nullptr;
+    }
+
+    // A constant left operand picks the path without a branch.
+    if (llvm::ConstantInt *leftConstant = llvm::dyn_cast<llvm::ConstantInt>(leftValue))
+    {
+      if (leftConstant->isOne() != isAnd)
+      {
+        return leftConstant;
+      }
+
+      return rightOperand->codegen();
+    }
+
+    llvm::BasicBlock *leftBlock = builder->GetInsertBlock();
+    llvm::Function *function = leftBlock->getParent();
+    llvm::BasicBlock *rightBlock = llvm::BasicBlock::Create(*context, isAnd ? "and_rhs" : "or_rhs", function);
+    llvm::BasicBlock *endBlock = llvm::BasicBlock::Create(*context, isAnd ? "and_end" : "or_end");
+    if (isAnd)
+    {
+      CreateProfiledCondBr(leftValue, rightBlock, endBlock);
+    }
+    else
+    {
+      CreateProfiledCondBr(leftValue, endBlock, rightBlock);
+    }
+
+    globalSSABuilder->sealBlock(rightBlock);
+    builder->SetInsertPoint(rightBlock);
+    llvm::Value *rightValue = rightOperand->codegen();
+    if (!rightValue)
+    {
+      return nullptr;
+    }
+
+    // The right operand may have branched itself, the edge comes from the
+    // block it ended in.
+    rightBlock = builder->GetInsertBlock();
+    builder->CreateBr(endBlock);
+
+    function->getBasicBlockList().push_back(endBlock);
+    globalSSABuilder->sealBlock(endBlock);
+    builder->SetInsertPoint(endBlock);
+    llvm::PHINode *phi = builder->CreatePHI(builder->getInt1Ty(), 2, isAnd ? "and_tmp" : "or_tmp");
+    phi->addIncoming(builder->getInt1(!isAnd), leftBlock);
+    phi->addIncoming(rightValue, rightBlock);
+    return phi;
+  }
+
+  llvm::Value *codegen() override
+  {
+    if (operatorToken.type == Token::Type::DOUBLE_AMPERSAND || operatorToken.type == Token::Type::DOUBLE_VBAR)
+    {
+      return createShortCircuit(operatorToken.type == Token::Type::DOUBLE_AMPERSAND);
+    }
+
+    Type *leftOperandType = leftOperand->getType();
+    Type *rightOperandType = rightOperand->getType();
+
+    llvm::Value *leftValue = leftOperand->codegen();
+    llvm::Value *rightValue = rightOperand->codegen();
+
+    if (!leftValue || !rightValue)
+    {
+      return nullptr;
+    }
+
+    if (leftOperandType->isFloatTy() && rightOperandType->isFloatTy())
+    {
+      switch (operatorToken.type)
+      {
+      case Token::Type::PLUS:
+        return builder->CreateFAdd(leftValue, rightValue, "add_tmp");
+      case Token::Type::HYPHEN:
+        return builder->CreateFSub(leftValue, rightValue, "sub_tmp");
+      case Token::Type::ASTERISK:
+        return builder->CreateFMul(leftValue, rightValue, "mul_tmp");
+      case Token::Type::BACKSLASH:
+        return builder->CreateFDiv(leftValue, rightValue, "div_tmp");
+      case Token::Type::DOUBLE_BACKSLASH:
+        return builder->CreateUnaryIntrinsic(llvm::Intrinsic::floor, builder->CreateFDiv(leftValue, rightValue, "div_tmp"), nullptr, "floor_div_tmp");
+      case Token::Type::PERCENT:
+        return builder->CreateFRem(leftValue, rightValue, "rem_tmp");
+      case Token::Type::DOUBLE_EQUALS:
+        return builder->CreateFCmpOEQ(leftValue, rightValue, "equal_to_tmp");
+      case Token::Type::EXCLAMATION_EQUALS:
+        return builder->CreateFCmpONE(leftValue, rightValue, "not_equal_to_tmp");
+      case Token::Type::RIGHT_ANGULAR_BRACKET:
+        return builder->CreateFCmpOGT(leftValue, rightValue, "greater_than_tmp");
+      case Token::Type::LEFT_ANGULAR_BRACKET:
+        return builder->CreateFCmpOLT(leftValue, rightValue, "lower_than_tmp");
+      case Token::Type::LEFT_ANGULAR_BRACKET_EQUALS:
+        return builder->CreateFCmpOLE(leftValue, rightValue, "lower_than_or_equal_to_tmp");
+      case Token::Type::RIGHT_ANGULAR_BRACKET_EQUALS:
+        return builder->CreateFCmpOGE(leftValue, rightValue, "greater_than_or_equal_to_tmp");
+      default:
+        return nullptr;
+      }
+    }
+    else if (leftOperandType->isIntegerTy() && rightOperandType->isIntegerTy())
+    {
+      bool isSigned = leftOperandType->isSignedIntegerTy();
+      switch (operatorToken.type)
+      {
+      case Token::Type::PLUS:
+        return builder->CreateAdd(leftValue, rightValue, "add_tmp", !isSigned && hasNoUnsignedWrap(), isSigned && hasNoSignedWrap());
+      case Token::Type::HYPHEN:
+        return builder->CreateSub(leftValue, rightValue, "sub_tmp", false, isSigned && hasNoSignedWrap());
+      case Token::Type::ASTERISK:
+        return builder->CreateMul(leftValue, rightValue, "mul_tmp", !isSigned && hasNoUnsignedWrap(), isSigned && hasNoSignedWrap());
+      case Token::Type::BACKSLASH:
+        return isSigned ? createSignedDivision(leftValue, rightValue, false) : createUnsignedDivision(leftValue, rightValue);
+      case Token::Type::DOUBLE_BACKSLASH:
+        return isSigned ? createSignedDivision(leftValue, rightValue, true) : createUnsignedDivision(leftValue, rightValue);
+      case Token::Type::PERCENT:
+        if (!isSigned)
+        {
+          return builder->CreateURem(leftValue, rightValue, "rem_tmp");
+        }
+
+        return builder->CreateSRem(leftValue, rightValue, "rem_tmp");
+      case Token::Type::DOUBLE_EQUALS:
+        return builder->CreateICmpEQ(leftValue, rightValue, "equal_to_tmp");
+      case Token::Type::EXCLAMATION_EQUALS:
+        return builder->CreateICmpNE(leftValue, rightValue, "not_equal_to_tmp");
+      case Token::Type::RIGHT_ANGULAR_BRACKET:
+        if (!isSigned)
+        {
+          return builder->CreateICmpUGT(leftValue, rightValue, "greater_than_tmp");
+        }
+
+        return builder->CreateICmpSGT(leftValue, rightValue, "greater_than_tmp");
+      case Token::Type::LEFT_ANGULAR_BRACKET:
+        if (!isSigned)
+        {
+          return builder->CreateICmpULT(leftValue, rightValue, "lower_than_tmp");
+        }
+
+        return builder->CreateICmpSLT(leftValue, rightValue, "lower_than_tmp");
+      case Token::Type::LEFT_ANGULAR_BRACKET_EQUALS:
+        if (!isSigned)
+        {
+          return builder->CreateICmpULE(leftValue, rightValue, "lower_than_or_equal_to_tmp");
+        }
+
+        return builder->CreateICmpSLE(leftValue, rightValue, "lower_than_or_equal_to_tmp");
+      case Token::Type::RIGHT_ANGULAR_BRACKET_EQUALS:
+        if (!isSigned)
+        {
+          return builder->CreateICmpUGE(leftValue, rightValue, "greater_than_or_equal_to_tmp");
+        }
+
+        return builder->CreateICmpSGE(leftValue, rightValue, "greater_than_or_equal_to_tmp");
+      default:
+        return nullptr;
+      }
+    }
+
+    return nullptr;
+  }
+};
+
+class ASTUnaryExpression : public ASTExpression
+{
+private:
+  Token operatorToken;
+  ASTExpression *operand;
+
+public:
+  ASTUnaryExpression(Token operatorToken,
+                     ASTExpression *operand) : operatorToken(operatorToken),
+                                               operand(operand),
+                                               ASTExpression(ASTNode::ASTUnaryExpressionID, "UnaryExpression", operatorToken.value){};
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(operand);
+    return std::move(children);
+  }
+
+  void evaluateType() override
+  {
+    operand->evaluateType();
+    setType(operand->getType());
+  }
+
+  ASTExpression *fold() override
+  {
+    operand = operand->fold();
+
+    if (!getType())
+    {
+      return this;
+    }
+
+    if (operatorToken.type == Token::Type::PLUS)
+    {
+      return operand;
+    }
+
+    ASTNumberExpression *number = ASTNumberExpression::asNumber(operand);
+    if (number)
+    {
+      ComptimeValue value = foldValue(number->getValue());
+      if (value.isKnown())
+      {
+        return value.toExpression();
+      }
+    }
+
+    if (operand->getASTNodeID() == ASTNode::ASTUnaryExpressionID)
+    {
+      ASTUnaryExpression *inner = (ASTUnaryExpression *)operand;
+      if (operatorToken.type == inner->operatorToken.type && operatorToken.type != Token::Type::PLUS)
+      {
+        return inner->operand;
+      }
+    }
+
+    return this;
+  }
+
+  ComptimeValue foldValue(const ComptimeValue &operandValue)
+  {
+    if (operatorToken.type == Token::Type::PLUS)
+    {
+      return operandValue;
+    }
+
+    if (getType()->isIntegerTy())
+    {
+      switch (operatorToken.type)
+      {
+      case Token::Type::HYPHEN:
+        return ComptimeValue::integer((int64_t)(0 - (uint64_t)operandValue.intValue), getType());
+      case Token::Type::EXCLAMATION:
+        return ComptimeValue::integer(~operandValue.intValue, getType());
+      default:
+        return ComptimeValue();
+      }
+    }
+    else if ((getType()->isFloat32Ty() || getType()->isFloat64Ty()) && operatorToken.type == Token::Type::HYPHEN)
+    {
+      return ComptimeValue::floating(-operandValue.floatValue, getType());
+    }
+
+    return ComptimeValue();
+  }
+
+  ComptimeValue evaluate(ComptimeInterpreter &interpreter) override
+  {
+    ComptimeValue operandValue = getType() ? operand->evaluate(interpreter) : ComptimeValue();
+    return operandValue.isKnown() ? foldValue(operandValue) : ComptimeValue();
+  }
+
+  llvm::Value *codegen() override
+  {
+    Type *operandType = operand->getType();
+    llvm::Value *operandValue = operand->codegen();
+
+    if (!operandValue)
+    {
+      return nullptr;
+    }
+
+    if (getType()->isNumberTy())
+    {
+      switch (operatorToken.type)
+      {
+      case Token::Type::PLUS:
+        return operandValue;
+      case Token::Type::HYPHEN:
+        if (getType()->isFloatTy())
+        {
+          return builder->CreateFNeg(operandValue, "negative_tmp");
+        }
+
+        return builder->CreateNeg(operandValue, "negative_tmp");
+      case Token::Type::EXCLAMATION:
+        return builder->CreateNot(operandValue, "not_tmp");
+      default:
+        return nullptr;
+      }
+    }
+
+    return nullptr;
+  }
+};
+
+class ASTVariableStatement : public ASTStatement
+{
+protected:
+  Token token;
+  Type *type;
+  llvm::AllocaInst *value = nullptr;
+  bool isAddressTaken = false;
+  bool isNoAlias = false;
+
+public:
+  ASTVariableStatement(Token token,
+                       Type *type,
+                       ASTNodeID ID = ASTNode::ASTVariableStatementID,
+                       std::string showKind = "VariableStatement") : token(token),
+                                                                     type(type),
+                                                                     ASTStatement(ID, showKind, token.value){};
+
+  std::string getName() { return token.value; }
+  Type *getType() { return type; }
+  llvm::AllocaInst *getAlocatedValue() { return value; }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTStatement::hash(hasher);
+    UpdateHash(hasher, type ? type->getManglingName() : "");
+    UpdateHash(hasher, isAddressTaken ? "address_taken" : "");
+    UpdateHash(hasher, isNoAlias ? "noalias" : "");
+  }
+
+  // Only a variable whose address is taken lives in memory, every other one
+  // is an SSA value.
+  void markAddressTaken() { isAddressTaken = true; }
+  bool getIsAddressTaken() { return isAddressTaken; }
+
+  // A pointer argument that no other argument or global points into while
+  // the function runs.
+  void markNoAlias() { isNoAlias = true; }
+  bool getIsNoAlias() { return isNoAlias; }
+
+  llvm::Value *define(llvm::Value *newValue)
+  {
+    if (!isAddressTaken)
+    {
+      globalSSABuilder->writeVariable(this, builder->GetInsertBlock(), newValue);
+      return newValue;
+    }
+
+    if (!value)
+    {
+      value = CreateEntryBlockAlloca(builder->GetInsertBlock()->getParent(), type->getLLVMTy(), token.value);
+    }
+
+    return builder->CreateStore(newValue, value);
+  }
+
+  llvm::Value *load()
+  {
+    if (!isAddressTaken)
+    {
+      return globalSSABuilder->readVariable(this, type->getLLVMTy(), builder->GetInsertBlock(), token.value);
+    }
+
+    if (!value)
+    {
+      return nullptr;
+    }
+
+    return builder->CreateLoad(value->getAllocatedType(), value, token.value);
+  }
+
+  // A declaration without a value leaves the variable unknown.
+  bool interpret(ComptimeInterpreter &interpreter) override
+  {
+    interpreter.setVariable(this, ComptimeValue());
+    return true;
+  }
+
+  // The memory of a variable whose address is taken, in the frame of the
+  // function.
+  llvm::AllocaInst *allocate()
+  {
+    if (isAddressTaken && !value)
+    {
+      value = CreateEntryBlockAlloca(builder->GetInsertBlock()->getParent(), type->getLLVMTy(), token.value);
+    }
+
+    return value;
+  }
+
+  // The address as a value of a pointer type of the language, which is
+  // untyped, see PointerType.
+  llvm::Value *getAddress()
+  {
+    return builder->CreatePointerCast(allocate(), llvm::PointerType::get(*context, 0), token.value + "_address");
+  }
+
+  virtual llvm::Value *codegen() override
+  {
+    return allocate();
+  }
+};
+
+ASTVariableStatement *currentVariable;
+class ASTFunction;
+class ASTIndexExpression;
+class ASTBlock : public ASTNode
+{
+protected:
+  std::vector<ASTStatement *> body;
+  std::map<std::string, ASTVariableStatement *> namedVariables;
+
+  // The objects constructed in the block so far while it is generated.
+  std::vector<ASTVariableStatement *> objects;
+
+public:
+  ASTBlock(std::vector<ASTStatement *> body, std::string showKind = "Block") : body(std::move(body)), ASTNode(ASTNode::ASTBlockID, showKind){};
+  ASTBlock(std::string showKind = "Block") : ASTNode(ASTNode::ASTBlockID, showKind){};
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    // printf("------ DEBUGING ------");
+    for (int i = 0; i < body.size(); i++)
+    {
+      children.push_back(body[i]);
+    }
+
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override;
+
+  void evaluateType()
+  {
+    for (int i = 0; i < body.size(); i++)
+    {
+      body[i]->evaluateType();
+    }
+  }
+
+  // Runs after evaluateType, every expression is typed and converted by then.
+  void fold()
+  {
+    for (int i = 0; i < body.size(); i++)
+    {
+      body[i] = body[i]->fold();
+    }
+  }
+
+  // Stops after a return, like codegen.
+  bool interpret(ComptimeInterpreter &interpreter)
+  {
+    for (int i = 0; i < body.size() && !interpreter.isReturning; i++)
+    {
+      if (!interpreter.step() || !body[i]->interpret(interpreter))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  void newNamedVariable(ASTVariableStatement *variable)
+  {
+    namedVariables[variable->getName()] = variable;
+    currentVariable = variable;
+  }
+
+  ASTVariableStatement *namedVariable(std::string variableName)
+  {
+    currentVariable = namedVariables[variableName];
+    return currentVariable;
+  }
+
+  void pushStatement(ASTStatement *statement)
+  {
+    body.push_back(statement);
+  }
+
+  void addObject(ASTVariableStatement *object) { objects.push_back(object); }
+  bool hasObjectsToDestroy();
+  void destroyObjects(bool isEnd);
+
+  // Removes the function definitions from the block, so they can be
+  // generated separately from the statements around them.
+  std::vector<ASTFunction *> takeFunctions()
+  {
+    std::vector<ASTFunction *> functions;
+    std::vector<ASTStatement *> statements;
+    for (int i = 0; i < body.size(); i++)
+    {
+      if (body[i]->getASTNodeID() == ASTNode::ASTFucntionID)
+      {
+        functions.push_back((ASTFunction *)body[i]);
+      }
+      else
+      {
+        statements.push_back(body[i]);
+      }
+    }
+
+    body = std::move(statements);
+    return functions;
+  }
+};
+
+class BlockStack
+{
+protected:
+  std::vector<ASTBlock *> blocks;
+
+public:
+  BlockStack() = default;
+  ASTBlock *getCurrentBlock() { return blocks.back(); }
+  void pushBlock(ASTBlock *block) { blocks.push_back(block); }
+  void popBlock() { blocks.pop_back(); }
+  unsigned size() { return blocks.size(); }
+  ASTBlock *getBlock(unsigned i) { return blocks[i]; }
+
+  ASTVariableStatement *namedVariable(std::string variableName)
+  {
+    for (int i = blocks.size() - 1; i >= 0; i--)
+    {
+      ASTVariableStatement *variable = blocks[i]->namedVariable(variableName);
+      if (variable)
+      {
+        return variable;
+      }
+    }
+
+    return nullptr;
+  }
+};
+
+thread_local BlockStack *globalBlockStack(new BlockStack());
+
+// The number of blocks around the function being generated, a return leaves
+// the blocks above.
+thread_local unsigned globalFunctionBlockDepth = 0;
+
+llvm::Value *ASTBlock::codegen()
+{
+  globalBlockStack->pushBlock(this);
+  objects.clear();
+
+  // Nothing after a return is reachable, stop before emitting past the
+  // terminator.
+  llvm::Value *FnIR = nullptr;
+  for (int i = 0; i < body.size() && !builder->GetInsertBlock()->getTerminator(); i++)
+  {
+    FnIR = body[i]->codegen();
+  }
+
+  if (!builder->GetInsertBlock()->getTerminator())
+  {
+    destroyObjects(true);
+  }
+
+  globalBlockStack->popBlock();
+
+  return FnIR;
+}
+
+class ASTAssignVariableStatement : public ASTVariableStatement
+{
+protected:
+  ASTExpression *expression;
+  ASTVariableStatement *variable;
+
+public:
+  // Without a type the statement assigns to the variable already declared
+  // with that name, otherwise it declares a new one.
+  ASTAssignVariableStatement(ASTExpression *expression,
+                             Token token,
+                             Type *type = nullptr,
+                             ASTNodeID ID = ASTNode::ASTAssignVariableStatementID,
+                             std::string showKind = "AssignVariableStatement") : expression(expression),
+                                                                                 variable(this),
+                                                                                 ASTVariableStatement(token, type, ID, showKind)
+  {
+    if (type)
+    {
+      globalBlockStack->getCurrentBlock()->newNamedVariable(this);
+    }
+    else if ((variable = globalBlockStack->namedVariable(token.value)))
+    {
+      this->type = variable->getType();
+    }
+  };
+
+  // The statement itself when it declares the variable.
+  ASTVariableStatement *getAssignedVariable() { return variable; }
+
+  virtual void evaluateType() override
+  {
+    expression->evaluateType();
+    if (variable)
+    {
+      expression = ASTCastExpression::convert(expression, getType());
+    }
+  }
+
+  ASTStatement *fold() override
+  {
+    expression = expression->fold();
+    return this;
+  }
+
+  bool interpret(ComptimeInterpreter &interpreter) override
+  {
+    ComptimeValue value = variable ? expression->evaluate(interpreter) : ComptimeValue();
+    if (!value.isKnown())
+    {
+      return false;
+    }
+
+    interpreter.setVariable(variable, value);
+    return true;
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(expression);
+    return std::move(children);
+  }
+
+  virtual llvm::Value *codegen() override
+  {
+    if (!variable)
+    {
+      return nullptr;
+    }
+
+    llvm::Value *expressionValue = expression->codegen();
+    if (!expressionValue)
+    {
+      return nullptr;
+    }
+
+    return variable->define(expressionValue);
+  }
+};
+
+class ASTIdentifierExpression : public ASTExpression
+{
+protected:
+  Token token;
+  ASTVariableStatement *foundVariable;
+
+public:
+  ASTIdentifierExpression(Token token) : token(token), ASTExpression(ASTNode::ASTIdentifierExpressionID, "IdentifierExpression", token.value)
+  {
+    foundVariable = globalBlockStack->namedVariable(token.value);
+    if (foundVariable)
+    {
+      setType(foundVariable->getType());
+    }
+  };
+
+  ASTVariableStatement *getVariable() { return foundVariable; }
+
+  ComptimeValue evaluate(ComptimeInterpreter &interpreter) override
+  {
+    return foundVariable ? interpreter.getVariable(foundVariable) : ComptimeValue();
+  }
+
+  llvm::Value *codegen() override
+  {
+    if (!foundVariable)
+    {
+      return nullptr;
+    }
+
+    return foundVariable->load();
+  }
+};
+
+// [a, b, c], an array value of a fixed number of elements.
+class ASTArrayExpression : public ASTExpression
+{
+protected:
+  std::vector<ASTExpression *> elements;
+
+public:
+  ASTArrayExpression(Type *elementType, std::vector<ASTExpression *> elements) : elements(std::move(elements)),
+                                                                                 ASTExpression(ASTNode::ASTArrayExpressionID, "ArrayExpression")
+  {
+    setType(Type::getArrayTy(elementType, this->elements.size()));
+  };
+
+  void evaluateType() override
+  {
+    for (int i = 0; i < elements.size(); i++)
+    {
+      elements[i]->evaluateType();
+      elements[i] = ASTCastExpression::convert(elements[i], type->getElementTy());
+    }
+  }
+
+  ASTExpression *fold() override
+  {
+    for (int i = 0; i < elements.size(); i++)
+    {
+      elements[i] = elements[i]->fold();
+    }
+
+    return this;
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    return std::vector<ASTNode *>(elements.begin(), elements.end());
+  }
+
+  // Constant elements fold into a constant array.
+  llvm::Value *codegen() override
+  {
+    llvm::Value *array = llvm::UndefValue::get(type->getLLVMTy());
+    for (int i = 0; i < elements.size(); i++)
+    {
+      llvm::Value *element = elements[i]->codegen();
+      if (!element)
+      {
+        return nullptr;
+      }
+
+      array = builder->CreateInsertValue(array, element, i);
+    }
+
+    return array;
+  }
+};
+
+// Hashes a tree with everything its generated code depends on.
+std::string HashTree(ASTNode *root, const std::string &flags)
+{
+  llvm::SHA1 hasher;
+  UpdateHash(hasher, flags);
+
+  std::vector<ASTNode *> stack = {root};
+  while (!stack.empty())
+  {
+    ASTNode *node = stack.back();
+    stack.pop_back();
+    node->hash(hasher);
+
+    std::vector<ASTNode *> children = node->getChildrenShow();
+    UpdateHash(hasher, std::to_string(children.size()));
+    stack.insert(stack.end(), children.rbegin(), children.rend());
+  }
+
+  return FinalHash(hasher);
+}
+
+// The annotations a function is declared with. Calls of a const function
+// whose arguments are all literals are run while compiling, see
+// ASTCallExpression::fold. The others become LLVM attributes, see
+// ASTPrototype::codegen. Only exported functions can be called from outside
+// of the program, the others are internal to it.
+struct FunctionAttributes
+{
+  bool isConst = false;
+  bool isInline = false;
+  bool isNoInline = false;
+  bool isPure = false;
+  bool isCold = false;
+  bool isExported = false;
+
+  std::string getManglingName()
+  {
+    return std::string(isConst ? "c" : "") + (isInline ? "i" : "") + (isNoInline ? "n" : "") +
+           (isPure ? "p" : "") + (isCold ? "k" : "") + (isExported ? "e" : "");
+  }
+};
+
+// Whether every function is defined in the module it is called from. Only
+// then can functions get internal linkage while they are generated, the
+// modules of the partitions and of the cache call each other.
+bool globalIsSingleModule = false;
+
+class ASTPrototype : public ASTStatement
+{
+protected:
+  Token token;
+  std::vector<ASTVariableStatement *> args;
+  Type *returnType;
+  FunctionAttributes attributes;
+  ASTFunction *definition = nullptr;
+
+public:
+  ASTPrototype(Token token,
+               std::vector<ASTVariableStatement *> args,
+               Type *returnType,
+               FunctionAttributes attributes = FunctionAttributes());
+
+  std::string getName() { return token.value; }
+  Type *getReturnType() { return returnType; }
+  unsigned getNumArgs() { return args.size(); }
+  ASTVariableStatement *getArg(unsigned i) { return args[i]; }
+  bool getIsConst() { return attributes.isConst; }
+  bool getIsExported() { return attributes.isExported; }
+  ASTFunction *getDefinition() { return definition; }
+  void setDefinition(ASTFunction *function) { definition = function; }
+
+  bool interpret(ComptimeInterpreter &interpreter) override { return true; }
+
+  FunctionType *getFunctionType()
+  {
+    std::vector<Type *> params;
+    for (int i = 0; i < args.size(); i++)
+    {
+      params.push_back(args[i]->getType());
+    }
+
+    return Type::getFunctionTy(std::move(params), returnType);
+  }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTStatement::hash(hasher);
+    UpdateHash(hasher, getFunctionType()->getManglingName());
+    UpdateHash(hasher, attributes.getManglingName());
+  }
+
+  // Adds everything the declaration in a calling module depends on, see
+  // codegen: the calling convention follows from the attributes and from
+  // whether the function is defined in the program.
+  void hashDeclaration(llvm::SHA1 &hasher)
+  {
+    UpdateHash(hasher, getFunctionType()->getManglingName());
+    UpdateHash(hasher, attributes.getManglingName());
+    UpdateHash(hasher, definition ? "defined" : "");
+    for (int i = 0; i < args.size(); i++)
+    {
+      UpdateHash(hasher, args[i]->getIsNoAlias() ? "noalias" : "");
+    }
+  }
+
+  // Arguments are looked up like any other variable of the function's block.
+  void declareArgs(ASTBlock *block)
+  {
+    for (int i = 0; i < args.size(); i++)
+    {
+      block->newNamedVariable(args[i]);
+    }
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    for (int i = 0; i < args.size(); i++)
+    {
+      children.push_back(args[i]);
+    }
+
+    return std::move(children);
+  }
+
+  llvm::Function *codegen() override
+  {
+    llvm::Function *function = module->getFunction(getName());
+    if (function)
+    {
+      return function;
+    }
+
+    // Apart from exported functions and functions defined outside of the
+    // program only generated code calls these, the fast calling convention
+    // lets the backend turn more tail calls into jumps.
+    function = llvm::Function::Create(getFunctionType()->getLLVMTy(), llvm::GlobalValue::ExternalLinkage, getName(), module.get());
+    function->setCallingConv(attributes.isExported || !definition ? llvm::CallingConv::C : llvm::CallingConv::Fast);
+    for (int i = 0; i < args.size(); i++)
+    {
+      function->getArg(i)->setName(args[i]->getName());
+      if (args[i]->getIsNoAlias() && args[i]->getType()->isPointerTy())
+      {
+        function->addParamAttr(i, llvm::Attribute::NoAlias);
+      }
+    }
+
+    if (attributes.isInline)
+    {
+      function->addFnAttr(llvm::Attribute::AlwaysInline);
+    }
+    else if (attributes.isNoInline)
+    {
+      function->addFnAttr(llvm::Attribute::NoInline);
+    }
+
+    // A pure function only reads memory and returns, unused calls can be
+    // dropped and repeated ones merged.
+    if (attributes.isPure)
+    {
+      function->setOnlyReadsMemory();
+      function->setDoesNotThrow();
+      function->addFnAttr(llvm::Attribute::WillReturn);
+    }
+
+    if (attributes.isCold)
+    {
+      function->addFnAttr(llvm::Attribute::Cold);
+    }
+
+    // Functions that are not exported stay inside of the program, so unused
+    // ones are dropped and the optimiser may change how they are called.
+    // They are internal when the whole program is one module, see
+    // setDefinitionLinkage, and hidden until the modules are linked
+    // otherwise, see InternalizeFunctions. A prototype without a definition
+    // is defined outside of the program.
+    if (!attributes.isExported && definition)
+    {
+      function->setVisibility(llvm::GlobalValue::HiddenVisibility);
+    }
+
+    return function;
+  }
+
+  // Called once the function is defined in the module.
+  void setDefinitionLinkage(llvm::Function *function)
+  {
+    if (!attributes.isExported && globalIsSingleModule)
+    {
+      function->setLinkage(llvm::GlobalValue::InternalLinkage);
+      function->setVisibility(llvm::GlobalValue::DefaultVisibility);
+    }
+  }
+};
+
+ASTPrototype *currentPrototype;
+std::map<std::string, ASTPrototype *> globalPrototypes;
+
+ASTPrototype::ASTPrototype(Token token,
+                           std::vector<ASTVariableStatement *> args,
+                           Type *returnType,
+                           FunctionAttributes attributes) : token(token),
+                                                           args(std::move(args)),
+                                                           returnType(returnType),
+                                                           attributes(attributes),
+                                                           ASTStatement(ASTNode::ASTPrototypeID, "Prototype", token.value)
+{
+  globalPrototypes[token.value] = this;
+  currentPrototype = this;
+}
+
+// The class of an object or of the object a pointer points to.
+ClassType *GetClassType(Type *type)
+{
+  if (type && type->isPointerTy())
+  {
+    type = type->getElementTy();
+  }
+
+  return type && type->isStructTy() ? (ClassType *)type : nullptr;
+}
+
+// The type of an array or of the array a pointer points to.
+ArrayType *GetArrayType(Type *type)
+{
+  if (type && type->isPointerTy())
+  {
+    type = type->getElementTy();
+  }
+
+  return type && type->isArrayTy() ? (ArrayType *)type : nullptr;
+}
+
+// Methods are functions named Class.method, a class has the methods of its
+// bases it does not define itself.
+ASTPrototype *FindMethod(ClassType *classType, const std::string &name, bool isInherited = true)
+{
+  for (ClassType *current = classType; current; current = isInherited ? current->getBase() : nullptr)
+  {
+    std::map<std::string, ASTPrototype *>::iterator it = globalPrototypes.find(current->getName() + "." + name);
+    if (it != globalPrototypes.end())
+    {
+      return it->second;
+    }
+  }
+
+  return nullptr;
+}
+
+// Declares a method, a function whose first argument, this, points to the
+// object. Constructors and destructors are always inlined. A virtual method
+// gets a slot in the table of the class, a method of a subclass with the
+// same name overrides it.
+ASTPrototype *DeclareMethod(ClassType *classType,
+                            Token token,
+                            std::vector<ASTVariableStatement *> args,
+                            Type *returnType,
+                            FunctionAttributes attributes = FunctionAttributes(),
+                            bool isVirtual = false)
+{
+  if (token.value == "constructor" || token.value == "destructor")
+  {
+    attributes.isInline = true;
+    attributes.isNoInline = false;
+  }
+
+  if (isVirtual && !classType->addVirtualMethod(token.value))
+  {
+    llvm::errs() << classType->getName() << "." << token.value << " can not be virtual, " << classType->getBase()->getName() << " has no virtual methods\n";
+  }
+
+  args.insert(args.begin(), new ASTVariableStatement(Token("this", Token::Type::IDENTIFIER), Type::getPointerTy(classType, 0)));
+  return new ASTPrototype(Token(classType->getName() + "." + token.value, token.type), std::move(args), returnType, attributes);
+}
+
+// Whether a subclass overrides the method, only then is it called through
+// the table of the object.
+bool IsOverridden(ClassType *classType, const std::string &name)
+{
+  for (ClassType *subclass : classType->getSubclasses())
+  {
+    if (FindMethod(subclass, name, false) || IsOverridden(subclass, name))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// The table of the virtual methods of a class, defined in every module that
+// constructs objects of the class.
+llvm::GlobalVariable *GetVTable(ClassType *classType)
+{
+  std::string name = classType->getName() + ".vtable";
+  llvm::GlobalVariable *table = module->getGlobalVariable(name, true);
+  if (table)
+  {
+    return table;
+  }
+
+  llvm::PointerType *ptrTy = llvm::PointerType::get(*context, 0);
+  std::vector<llvm::Constant *> slots;
+  for (const std::string &method : classType->getVirtualMethods())
+  {
+    ASTPrototype *prototype = FindMethod(classType, method);
+    slots.push_back(prototype ? llvm::ConstantExpr::getPointerCast(prototype->codegen(), ptrTy) : llvm::ConstantPointerNull::get(ptrTy));
+  }
+
+  llvm::ArrayType *tableTy = llvm::ArrayType::get(ptrTy, slots.size());
+  table = new llvm::GlobalVariable(*module, tableTy, true, globalIsSingleModule ? llvm::GlobalValue::InternalLinkage : llvm::GlobalValue::LinkOnceODRLinkage,
+                                   llvm::ConstantArray::get(tableTy, slots), name);
+  table->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+  return table;
+}
+
+// What an object holds before its constructor runs, zeros and the table of
+// its class.
+llvm::Constant *GetInitialObject(ClassType *classType)
+{
+  llvm::StructType *structTy = classType->getLLVMTy();
+  if (!classType->isPolymorphic())
+  {
+    return llvm::Constant::getNullValue(structTy);
+  }
+
+  std::vector<llvm::Constant *> fields = {llvm::ConstantExpr::getPointerCast(GetVTable(classType), structTy->getElementType(0))};
+  for (unsigned i = 1; i < structTy->getNumElements(); i++)
+  {
+    fields.push_back(llvm::Constant::getNullValue(structTy->getElementType(i)));
+  }
+
+  return llvm::ConstantStruct::get(structTy, fields);
+}
+
+// Whether memory of zeros holds a value of the type, which it does not for
+// objects that point to the table of their class.
+bool IsZeroValid(Type *type)
+{
+  bool isSoA = type->isArrayTy() && static_cast<ArrayType *>(type)->isSoA();
+  if (type->isArrayTy() && !isSoA)
+  {
+    return IsZeroValid(type->getElementTy());
+  }
+
+  // The struct-of-arrays layout keeps only the fields.
+  ClassType *classType = isSoA ? (ClassType *)type->getElementTy() : (type->isStructTy() ? (ClassType *)type : nullptr);
+  if (!classType)
+  {
+    return true;
+  }
+
+  if (classType->isPolymorphic() && !isSoA)
+  {
+    return false;
+  }
+
+  for (unsigned i = 0; i < classType->getContainedTysLength(); i++)
+  {
+    if (!IsZeroValid(classType->getContainedType(i)))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Addresses inside objects and arrays are computed from typed pointers, the
+// loop vectoriser of LLVM 14 checks the accesses of a loop for overlaps only
+// through those. The pointers of the language are untyped, see PointerType.
+llvm::Value *CreateTypedAddress(llvm::Type *type, llvm::Value *address)
+{
+  return builder->CreatePointerCast(address, type->getPointerTo());
+}
+
+llvm::Value *CodegenArrayElementAddress(ArrayType *arrayType, llvm::Value *array, llvm::Value *index)
+{
+  llvm::Type *arrayTy = arrayType->getLLVMTy();
+  return builder->CreateInBoundsGEP(arrayTy, CreateTypedAddress(arrayTy, array), {builder->getInt64(0), index}, "element_address");
+}
+
+// The address of field of an element in an array in memory of the
+// struct-of-arrays layout, field is its index in the LLVM struct of the
+// class.
+llvm::Value *CodegenSoAFieldAddress(ArrayType *arrayType, llvm::Value *array, llvm::Value *index, unsigned field)
+{
+  llvm::Type *arrayTy = arrayType->getLLVMTy();
+  return builder->CreateInBoundsGEP(arrayTy, CreateTypedAddress(arrayTy, array), {builder->getInt64(0), builder->getInt32(field - arrayType->getFirstSoAField()), index}, "field_address");
+}
+
+// Traps unless the condition holds, a check that is known to pass generates
+// nothing. The trap is not profiled, it is never expected to run.
+void CodegenBoundsCheck(llvm::Value *isInBounds)
+{
+  if (llvm::isa<llvm::ConstantInt>(isInBounds) && llvm::cast<llvm::ConstantInt>(isInBounds)->isOne())
+  {
+    return;
+  }
+
+  llvm::Function *function = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *failBasicBlock = llvm::BasicBlock::Create(*context, "bounds_fail", function);
+  llvm::BasicBlock *okBasicBlock = llvm::BasicBlock::Create(*context, "bounds_ok", function);
+  builder->CreateCondBr(isInBounds, okBasicBlock, failBasicBlock, llvm::MDBuilder(*context).createBranchWeights(2000, 1));
+  globalSSABuilder->sealBlock(failBasicBlock);
+  globalSSABuilder->sealBlock(okBasicBlock);
+
+  builder->SetInsertPoint(failBasicBlock);
+  builder->CreateIntrinsic(llvm::Intrinsic::trap, {}, {});
+  builder->CreateUnreachable();
+  builder->SetInsertPoint(okBasicBlock);
+}
+
+// Element index of an array in memory. An element of the struct-of-arrays
+// layout is gathered from its fields.
+llvm::Value *CodegenArrayElement(ArrayType *arrayType, llvm::Value *array, llvm::Value *index, const std::string &name)
+{
+  if (!arrayType->isSoA())
+  {
+    return builder->CreateLoad(arrayType->getElementTy()->getLLVMTy(), CodegenArrayElementAddress(arrayType, array, index), name);
+  }
+
+  ClassType *classType = (ClassType *)arrayType->getElementTy();
+  llvm::StructType *structTy = classType->getLLVMTy();
+  llvm::Value *element = GetInitialObject(classType);
+  for (unsigned i = arrayType->getFirstSoAField(); i < structTy->getNumElements(); i++)
+  {
+    llvm::Value *field = builder->CreateLoad(structTy->getElementType(i), CodegenSoAFieldAddress(arrayType, array, index, i));
+    element = builder->CreateInsertValue(element, field, i, name);
+  }
+
+  return element;
+}
+
+// Stores element index of an array in memory, scattered into its fields in
+// the struct-of-arrays layout.
+void CodegenArrayElementStore(ArrayType *arrayType, llvm::Value *array, llvm::Value *index, llvm::Value *element)
+{
+  if (!arrayType->isSoA())
+  {
+    builder->CreateStore(element, CodegenArrayElementAddress(arrayType, array, index));
+    return;
+  }
+
+  llvm::StructType *structTy = (llvm::StructType *)arrayType->getElementTy()->getLLVMTy();
+  for (unsigned i = arrayType->getFirstSoAField(); i < structTy->getNumElements(); i++)
+  {
+    builder->CreateStore(builder->CreateExtractValue(element, i), CodegenSoAFieldAddress(arrayType, array, index, i));
+  }
+}
+
+bool HasDestructor(ClassType *classType)
+{
+  return FindMethod(classType, "destructor");
+}
+
+// The constructors that construct an object of the class, those of its
+// bases first. The last one takes the arguments. It is the constructor of
+// the class, or the one it inherits from its nearest base that has one.
+// The constructors of further bases run without arguments, those that take
+// some are left out and reported by CheckConstructors.
+std::vector<ASTPrototype *> GetConstructors(ClassType *classType)
+{
+  std::vector<ASTPrototype *> constructors;
+  for (ClassType *current = classType; current; current = current->getBase())
+  {
+    ASTPrototype *constructor = FindMethod(current, "constructor", false);
+    if (constructor && (constructors.empty() || constructor->getNumArgs() == 1))
+    {
+      constructors.insert(constructors.begin(), constructor);
+    }
+  }
+
+  return constructors;
+}
+
+// Reports the constructors of further bases that take arguments. Nothing
+// passes them any, so objects of the class can not be constructed.
+void CheckConstructors(ClassType *classType)
+{
+  ASTPrototype *nearest = FindMethod(classType, "constructor");
+  for (ClassType *current = classType; current; current = current->getBase())
+  {
+    ASTPrototype *constructor = FindMethod(current, "constructor", false);
+    if (constructor && constructor != nearest && constructor->getNumArgs() != 1)
+    {
+      ReportError(classType->getName() + " can not be constructed, the constructor of its base " + current->getName() + " takes arguments");
+    }
+  }
+}
+
+// Runs the constructors of the object, the reverse of DestroyObject.
+void ConstructObject(ClassType *classType, llvm::Value *address, std::vector<llvm::Value *> args)
+{
+  std::vector<ASTPrototype *> constructors = GetConstructors(classType);
+  args.insert(args.begin(), address);
+  for (int i = 0; i < constructors.size(); i++)
+  {
+    llvm::Function *function = constructors[i]->codegen();
+    llvm::ArrayRef<llvm::Value *> argValues = i + 1 == constructors.size() ? llvm::ArrayRef<llvm::Value *>(args) : llvm::ArrayRef<llvm::Value *>(address);
+    builder->CreateCall(function, argValues)->setCallingConv(function->getCallingConv());
+  }
+}
+
+// Adds what objects of the class generate where they are constructed,
+// copied or destroyed. That is the layout, the table the methods in its
+// slots resolve to, and the constructors and destructors that run. The
+// table is defined in every module that needs it, so every copy of it has
+// to agree.
+void HashClass(llvm::SHA1 &hasher, ClassType *classType)
+{
+  UpdateHash(hasher, classType->getLayoutName());
+  for (const std::string &method : classType->getVirtualMethods())
+  {
+    ASTPrototype *prototype = FindMethod(classType, method);
+    UpdateHash(hasher, prototype ? prototype->getName() : "");
+    if (prototype)
+    {
+      prototype->hashDeclaration(hasher);
+    }
+  }
+
+  std::vector<ASTPrototype *> constructors = GetConstructors(classType);
+  for (ClassType *current = classType; current; current = current->getBase())
+  {
+    ASTPrototype *destructor = FindMethod(current, "destructor", false);
+    if (destructor)
+    {
+      constructors.push_back(destructor);
+    }
+  }
+
+  for (int i = 0; i < constructors.size(); i++)
+  {
+    UpdateHash(hasher, constructors[i]->getName());
+    constructors[i]->hashDeclaration(hasher);
+  }
+}
+
+// Runs the destructor of the class, then the ones of its bases.
+void DestroyObject(ClassType *classType, llvm::Value *address)
+{
+  for (ClassType *current = classType; current; current = current->getBase())
+  {
+    ASTPrototype *destructor = FindMethod(current, "destructor", false);
+    if (destructor)
+    {
+      llvm::Function *function = destructor->codegen();
+      builder->CreateCall(function, {address})->setCallingConv(function->getCallingConv());
+    }
+  }
+}
+
+bool ASTBlock::hasObjectsToDestroy()
+{
+  return llvm::any_of(objects, [](ASTVariableStatement *object)
+                      { return HasDestructor((ClassType *)object->getType()); });
+}
+
+// Destroys the objects constructed so far, the last one first. Where the
+// block ends the frame can reuse their memory.
+void ASTBlock::destroyObjects(bool isEnd)
+{
+  for (int i = objects.size() - 1; i >= 0; i--)
+  {
+    if (HasDestructor((ClassType *)objects[i]->getType()))
+    {
+      DestroyObject((ClassType *)objects[i]->getType(), objects[i]->getAddress());
+    }
+
+    if (isEnd)
+    {
+      builder->CreateLifetimeEnd(objects[i]->allocate());
+    }
+  }
+}
+
+// A return leaves every block of the function.
+bool HasFunctionObjectsToDestroy()
+{
+  for (unsigned i = globalFunctionBlockDepth; i < globalBlockStack->size(); i++)
+  {
+    if (globalBlockStack->getBlock(i)->hasObjectsToDestroy())
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void DestroyFunctionObjects()
+{
+  for (int i = globalBlockStack->size() - 1; i >= (int)globalFunctionBlockDepth; i--)
+  {
+    globalBlockStack->getBlock(i)->destroyObjects(false);
+  }
+}
+
+class ASTFunction : public ASTStatement
+{
+protected:
+  ASTPrototype *prototype;
+  ASTBlock *block;
+
+public:
+  ASTFunction(ASTPrototype *prototype, ASTBlock *block) : prototype(prototype),
+                                                          block(block),
+                                                          ASTStatement(ASTNode::ASTFucntionID, "Function", prototype->getName())
+  {
+    prototype->setDefinition(this);
+  };
+
+  std::string getName() { return prototype->getName(); }
+  ASTPrototype *getPrototype() { return prototype; }
+
+  // The key of the function in the FunctionCache. It covers the whole tree
+  // of the function, the signatures of the functions it calls and the flags
+  // the code is generated with.
+  std::string getCacheKey(const std::string &flags)
+  {
+    return HashTree(this, flags);
+  }
+
+  void evaluateType() override
+  {
+    block->evaluateType();
+  }
+
+  ASTStatement *fold() override
+  {
+    block->fold();
+    return this;
+  }
+
+  bool interpret(ComptimeInterpreter &interpreter) override { return true; }
+
+  // Runs the function in the interpreter. The result is unknown when the
+  // function does not return a value that can be computed while compiling.
+  ComptimeValue call(ComptimeInterpreter &interpreter, const std::vector<ComptimeValue> &argValues)
+  {
+    if (argValues.size() != prototype->getNumArgs() || !interpreter.enterCall())
+    {
+      return ComptimeValue();
+    }
+
+    for (int i = 0; i < argValues.size(); i++)
+    {
+      interpreter.setVariable(prototype->getArg(i), argValues[i]);
+    }
+
+    bool isInterpreted = block->interpret(interpreter) && interpreter.isReturning;
+    ComptimeValue result = isInterpreted ? interpreter.returnValue : ComptimeValue();
+    interpreter.leaveCall();
+    return result;
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(prototype);
+    children.push_back(block);
+    return std::move(children);
+  }
+
+  llvm::Function *codegen() override
+  {
+    llvm::Function *function = prototype->codegen();
+    if (!function || !function->empty())
+    {
+      return nullptr;
+    }
+
+    // Each function builds its SSA form apart from the one being generated
+    // around it.
+    llvm::IRBuilderBase::InsertPointGuard insertPointGuard(*builder);
+    SSABuilder ssaBuilder;
+    SSABuilder *outerSSABuilder = globalSSABuilder;
+    globalSSABuilder = &ssaBuilder;
+
+    prototype->setDefinitionLinkage(function);
+    llvm::BasicBlock *entryBlock = llvm::BasicBlock::Create(*context, "entry", function);
+    builder->SetInsertPoint(entryBlock);
+    ssaBuilder.sealBlock(entryBlock);
+
+    std::unique_ptr<FunctionProfiler> profiler;
+    FunctionProfiler *outerProfiler = globalFunctionProfiler;
+    if (globalProfileMode != ProfileMode::None)
+    {
+      profiler.reset(new FunctionProfiler(globalProfileMode, globalProfileData, function, HashTree(this, "")));
+      profiler->enterFunction(*builder);
+    }
+
+    globalFunctionProfiler = profiler.get();
+
+    for (int i = 0; i < prototype->getNumArgs(); i++)
+    {
+      ASTVariableStatement *arg = prototype->getArg(i);
+      arg->codegen();
+      arg->define(function->getArg(i));
+    }
+
+    // Returns that call the function itself redefine the arguments and jump
+    // here, the block is sealed once all of them are generated.
+    llvm::BasicBlock *recurseBlock = llvm::BasicBlock::Create(*context, "tail_recurse", function);
+    builder->CreateBr(recurseBlock);
+    builder->SetInsertPoint(recurseBlock);
+    llvm::BasicBlock *outerRecurseBlock = globalTailRecurseBlock;
+    globalTailRecurseBlock = recurseBlock;
+    unsigned outerFunctionBlockDepth = globalFunctionBlockDepth;
+    globalFunctionBlockDepth = globalBlockStack->size();
+
+    block->codegen();
+
+    if (!builder->GetInsertBlock()->getTerminator())
+    {
+      if (function->getReturnType()->isVoidTy())
+      {
+        builder->CreateRetVoid();
+      }
+      else
+      {
+        builder->CreateRet(llvm::Constant::getNullValue(function->getReturnType()));
+      }
+    }
+
+    ssaBuilder.sealBlock(recurseBlock);
+    llvm::MergeBlockIntoPredecessor(recurseBlock);
+
+    if (profiler)
+    {
+      profiler->finishFunction();
+    }
+
+    globalFunctionBlockDepth = outerFunctionBlockDepth;
+    globalTailRecurseBlock = outerRecurseBlock;
+    globalFunctionProfiler = outerProfiler;
+    globalSSABuilder = outerSSABuilder;
+    return function;
+  }
+};
+
+class ASTReturnStatement : public ASTStatement
+{
+protected:
+  ASTExpression *expression;
+  ASTPrototype *prototype;
+
+public:
+  ASTReturnStatement(ASTExpression *expression = nullptr) : expression(expression),
+                                                            prototype(currentPrototype),
+                                                            ASTStatement(ASTNode::ASTReturnStatementID, "ReturnStatement"){};
+
+  void evaluateType() override
+  {
+    if (expression)
+    {
+      expression->evaluateType();
+      expression = ASTCastExpression::convert(expression, prototype->getReturnType());
+    }
+  }
+
+  ASTStatement *fold() override
+  {
+    if (expression)
+    {
+      expression = expression->fold();
+    }
+
+    return this;
+  }
+
+  bool interpret(ComptimeInterpreter &interpreter) override
+  {
+    ComptimeValue value;
+    if (expression)
+    {
+      value = expression->evaluate(interpreter);
+      if (!value.isKnown())
+      {
+        return false;
+      }
+    }
+
+    interpreter.returnValue = value;
+    interpreter.isReturning = true;
+    return true;
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    if (expression)
+    {
+      children.push_back(expression);
+    }
+
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override;
+};
+
+class ASTIfStatement : public ASTStatement
+{
+protected:
+  ASTExpression *condition;
+  ASTBlock *thenBlock;
+  ASTBlock *elseBlock;
+
+public:
+  ASTIfStatement(ASTExpression *condition, ASTBlock *thenBlock, ASTBlock *elseBlock = nullptr) : condition(condition),
+                                                                                                 thenBlock(thenBlock),
+                                                                                                 elseBlock(elseBlock),
+                                                                                                 ASTStatement(ASTNode::ASTIfStatementID, "IfStatement"){};
+
+  void evaluateType() override
+  {
+    condition->evaluateType();
+    condition = ASTCastExpression::convert(condition, Type::getInteger1Ty());
+    thenBlock->evaluateType();
+    if (elseBlock)
+    {
+      elseBlock->evaluateType();
+    }
+  }
+
+  ASTStatement *fold() override
+  {
+    condition = condition->fold();
+    thenBlock->fold();
+    if (elseBlock)
+    {
+      elseBlock->fold();
+    }
+
+    return this;
+  }
+
+  bool interpret(ComptimeInterpreter &interpreter) override
+  {
+    ComptimeValue conditionValue = condition->evaluate(interpreter);
+    if (!conditionValue.isKnown())
+    {
+      return false;
+    }
+
+    if (conditionValue.intValue != 0)
+    {
+      return thenBlock->interpret(interpreter);
+    }
+
+    return !elseBlock || elseBlock->interpret(interpreter);
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(condition);
+    children.push_back(thenBlock);
+    if (elseBlock)
+    {
+      children.push_back(elseBlock);
+    }
+
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override
+  {
+    llvm::Value *conditionValue = condition->codegen();
+    if (!conditionValue)
+    {
+      return nullptr;
+    }
+
+    llvm::Function *function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *thenBasicBlock = llvm::BasicBlock::Create(*context, "if_then", function);
+    llvm::BasicBlock *elseBasicBlock = elseBlock ? llvm::BasicBlock::Create(*context, "if_else") : nullptr;
+    llvm::BasicBlock *endBasicBlock = llvm::BasicBlock::Create(*context, "if_end");
+    CreateProfiledCondBr(conditionValue, thenBasicBlock, elseBasicBlock ? elseBasicBlock : endBasicBlock);
+
+    globalSSABuilder->sealBlock(thenBasicBlock);
+    builder->SetInsertPoint(thenBasicBlock);
+    thenBlock->codegen();
+    if (!builder->GetInsertBlock()->getTerminator())
+    {
+      builder->CreateBr(endBasicBlock);
+    }
+
+    if (elseBasicBlock)
+    {
+      function->getBasicBlockList().push_back(elseBasicBlock);
+      globalSSABuilder->sealBlock(elseBasicBlock);
+      builder->SetInsertPoint(elseBasicBlock);
+      elseBlock->codegen();
+      if (!builder->GetInsertBlock()->getTerminator())
+      {
+        builder->CreateBr(endBasicBlock);
+      }
+    }
+
+    function->getBasicBlockList().push_back(endBasicBlock);
+    globalSSABuilder->sealBlock(endBasicBlock);
+    builder->SetInsertPoint(endBasicBlock);
+
+    // Both branches may have returned, nothing reaches the end then.
+    if (llvm::pred_empty(endBasicBlock))
+    {
+      builder->CreateUnreachable();
+    }
+
+    return nullptr;
+  }
+};
+
+class ASTWhileStatement : public ASTStatement
+{
+protected:
+  ASTExpression *condition;
+  ASTBlock *body;
+  LoopHints hints;
+
+public:
+  ASTWhileStatement(ASTExpression *condition, ASTBlock *body, LoopHints hints = LoopHints()) : condition(condition),
+                                                                                               body(body),
+                                                                                               hints(hints),
+                                                                                               ASTStatement(ASTNode::ASTWhileStatementID, "WhileStatement"){};
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTStatement::hash(hasher);
+    UpdateHash(hasher, hints.getManglingName());
+  }
+
+  void evaluateType() override
+  {
+    condition->evaluateType();
+    condition = ASTCastExpression::convert(condition, Type::getInteger1Ty());
+    body->evaluateType();
+  }
+
+  ASTStatement *fold() override
+  {
+    condition = condition->fold();
+    body->fold();
+    return this;
+  }
+
+  bool interpret(ComptimeInterpreter &interpreter) override
+  {
+    while (interpreter.step())
+    {
+      ComptimeValue conditionValue = condition->evaluate(interpreter);
+      if (!conditionValue.isKnown())
+      {
+        return false;
+      }
+
+      if (conditionValue.intValue == 0)
+      {
+        return true;
+      }
+
+      if (!body->interpret(interpreter))
+      {
+        return false;
+      }
+
+      if (interpreter.isReturning)
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(condition);
+    children.push_back(body);
+    return std::move(children);
+  }
+
+  // The condition block gets its back edge only after the body, it is
+  // sealed last so that variables assigned in the body get their phis.
+  llvm::Value *codegen() override
+  {
+    llvm::Function *function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *conditionBasicBlock = llvm::BasicBlock::Create(*context, "while_cond", function);
+    llvm::BasicBlock *bodyBasicBlock = llvm::BasicBlock::Create(*context, "while_body");
+    llvm::BasicBlock *endBasicBlock = llvm::BasicBlock::Create(*context, "while_end");
+    builder->CreateBr(conditionBasicBlock);
+
+    builder->SetInsertPoint(conditionBasicBlock);
+    llvm::Value *conditionValue = condition->codegen();
+    if (!conditionValue)
+    {
+      return nullptr;
+    }
+
+    CreateProfiledCondBr(conditionValue, bodyBasicBlock, endBasicBlock);
+
+    function->getBasicBlockList().push_back(bodyBasicBlock);
+    globalSSABuilder->sealBlock(bodyBasicBlock);
+    builder->SetInsertPoint(bodyBasicBlock);
+    body->codegen();
+    std::vector<llvm::Metadata *> properties = hints.getProperties();
+    if (!builder->GetInsertBlock()->getTerminator())
+    {
+      llvm::BranchInst *latch = builder->CreateBr(conditionBasicBlock);
+      if (!properties.empty())
+      {
+        latch->setMetadata(llvm::LLVMContext::MD_loop, CreateLoopID(properties));
+      }
+    }
+
+    globalSSABuilder->sealBlock(conditionBasicBlock);
+    function->getBasicBlockList().push_back(endBasicBlock);
+    globalSSABuilder->sealBlock(endBasicBlock);
+    builder->SetInsertPoint(endBasicBlock);
+    return nullptr;
+  }
+};
+
+// for i in start..end { } and for x of array { }, where the array may also
+// be a slice. Both are counted loops:
+// the trip count is known before the first iteration and the induction
+// variable is a phi of the header that only the latch increments, whatever
+// the body assigns to the loop variable. The vectoriser and the unroller
+// recognise the loop without having to prove anything about the body.
+class ASTForStatement : public ASTStatement
+{
+protected:
+  ASTVariableStatement *variable;
+  ASTExpression *start = nullptr;
+  ASTExpression *end = nullptr;
+  ASTExpression *iterable = nullptr;
+  ASTBlock *body;
+  LoopHints hints;
+
+  // The body with the induction variable of the current iteration, then the
+  // latch with the loop ID.
+  void codegenLoop(llvm::Value *startValue, llvm::Value *endValue, bool isSigned, std::function<llvm::Value *(llvm::Value *)> element)
+  {
+    llvm::Function *function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *preheaderBasicBlock = builder->GetInsertBlock();
+    llvm::BasicBlock *conditionBasicBlock = llvm::BasicBlock::Create(*context, "for_cond", function);
+    llvm::BasicBlock *bodyBasicBlock = llvm::BasicBlock::Create(*context, "for_body");
+    llvm::BasicBlock *latchBasicBlock = llvm::BasicBlock::Create(*context, "for_latch");
+    llvm::BasicBlock *endBasicBlock = llvm::BasicBlock::Create(*context, "for_end");
+    builder->CreateBr(conditionBasicBlock);
+
+    builder->SetInsertPoint(conditionBasicBlock);
+    llvm::PHINode *index = builder->CreatePHI(startValue->getType(), 2, "for_index");
+    index->addIncoming(startValue, preheaderBasicBlock);
+    llvm::Value *conditionValue = isSigned ? builder->CreateICmpSLT(index, endValue, "for_cmp") : builder->CreateICmpULT(index, endValue, "for_cmp");
+    CreateProfiledCondBr(conditionValue, bodyBasicBlock, endBasicBlock);
+
+    function->getBasicBlockList().push_back(bodyBasicBlock);
+    globalSSABuilder->sealBlock(bodyBasicBlock);
+    builder->SetInsertPoint(bodyBasicBlock);
+    variable->codegen();
+    variable->define(element(index));
+    body->codegen();
+    if (!builder->GetInsertBlock()->getTerminator())
+    {
+      builder->CreateBr(latchBasicBlock);
+    }
+
+    // The index is below the end, adding one can not wrap.
+    function->getBasicBlockList().push_back(latchBasicBlock);
+    globalSSABuilder->sealBlock(latchBasicBlock);
+    builder->SetInsertPoint(latchBasicBlock);
+    llvm::Value *next = builder->CreateAdd(index, llvm::ConstantInt::get(index->getType(), 1), "for_next", !isSigned, isSigned);
+    index->addIncoming(next, latchBasicBlock);
+    llvm::BranchInst *latch = builder->CreateBr(conditionBasicBlock);
+
+    globalSSABuilder->sealBlock(conditionBasicBlock);
+    function->getBasicBlockList().push_back(endBasicBlock);
+    globalSSABuilder->sealBlock(endBasicBlock);
+    builder->SetInsertPoint(endBasicBlock);
+
+    // A body that always returns leaves the latch without predecessors.
+    if (llvm::pred_empty(latchBasicBlock))
+    {
+      index->removeIncomingValue(latchBasicBlock);
+      latchBasicBlock->eraseFromParent();
+      return;
+    }
+
+    // A counted loop always ends.
+    std::vector<llvm::Metadata *> properties = hints.getProperties();
+    properties.push_back(llvm::MDNode::get(*context, llvm::MDString::get(*context, "llvm.loop.mustprogress")));
+    latch->setMetadata(llvm::LLVMContext::MD_loop, CreateLoopID(properties));
+  }
+
+  // Whether the elements the body indexes with the loop variable are in
+  // bounds for the whole range: the loop does not start or its first and
+  // last index are in bounds. The length of an array is known from its
+  // type, a slice is read before the loop when it is in a variable the body
+  // does not assign. With isArrayOnly slices are left out, a constant range
+  // then gives a constant. Null when the body indexes no such element.
+  llvm::Value *codegenRangeInBounds(llvm::Value *startValue, llvm::Value *endValue, std::vector<ASTIndexExpression *> &elements, bool isArrayOnly = false);
+
+  // Whether the body may be copied for codegenRangeLoop. Only the innermost
+  // counted loops of a nest with a body of at most maxVersionedNodes nodes
+  // are, so code grows with the depth of a nest, not exponentially.
+  static const unsigned maxVersionedNodes = 128;
+  bool isVersionable();
+
+  // for i in start..end, checked once before the loop. When the whole range
+  // is in bounds a copy of the body without the checks of these elements
+  // runs, otherwise one with them, which traps in the iteration that is out
+  // of bounds if the body reaches it. A check that holds for any range, as
+  // the one of for i in 0..len(s) over s, folds away and leaves only the
+  // copy without checks. A body that can not be copied keeps the checks in
+  // every iteration, unless a constant range is known to be in bounds.
+  void codegenRangeLoop(llvm::Value *startValue, llvm::Value *endValue);
+
+public:
+  // The loop variable is declared in the body block before the body is
+  // built, so that the body finds it.
+  ASTForStatement(ASTVariableStatement *variable, ASTExpression *start, ASTExpression *end, ASTBlock *body, LoopHints hints = LoopHints()) : variable(variable),
+                                                                                                                                        start(start),
+                                                                                                                                        end(end),
+                                                                                                                                        body(body),
+                                                                                                                                        hints(hints),
+                                                                                                                                        ASTStatement(ASTNode::ASTForStatementID, "ForStatement", "in"){};
+
+  ASTForStatement(ASTVariableStatement *variable, ASTExpression *iterable, ASTBlock *body, LoopHints hints = LoopHints()) : variable(variable),
+                                                                                                                       iterable(iterable),
+                                                                                                                       body(body),
+                                                                                                                       hints(hints),
+                                                                                                                       ASTStatement(ASTNode::ASTForStatementID, "ForStatement", "of"){};
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTStatement::hash(hasher);
+    UpdateHash(hasher, hints.getManglingName());
+    ArrayType *arrayType = iterable ? GetArrayType(iterable->getType()) : nullptr;
+    if (arrayType && arrayType->isSoA())
+    {
+      HashClass(hasher, (ClassType *)arrayType->getElementTy());
+    }
+  }
+
+  void evaluateType() override
+  {
+    if (iterable)
+    {
+      iterable->evaluateType();
+    }
+    else
+    {
+      start->evaluateType();
+      start = ASTCastExpression::convert(start, variable->getType());
+      end->evaluateType();
+      end = ASTCastExpression::convert(end, variable->getType());
+    }
+
+    body->evaluateType();
+  }
+
+  ASTVariableStatement *getVariable() { return variable; }
+  bool isRangeLoop() { return end != nullptr; }
+
+  ASTStatement *fold() override
+  {
+    if (iterable)
+    {
+      iterable = iterable->fold();
+    }
+    else
+    {
+      start = start->fold();
+      end = end->fold();
+    }
+
+    body->fold();
+    return this;
+  }
+
+  // Only ranges run in the interpreter, it has no arrays.
+  bool interpret(ComptimeInterpreter &interpreter) override
+  {
+    if (iterable)
+    {
+      return false;
+    }
+
+    ComptimeValue startValue = start->evaluate(interpreter);
+    ComptimeValue endValue = end->evaluate(interpreter);
+    if (!startValue.isKnown() || !endValue.isKnown() || !variable->getType()->isIntegerTy())
+    {
+      return false;
+    }
+
+    bool isSigned = variable->getType()->isSignedIntegerTy();
+    for (int64_t i = startValue.intValue; isSigned ? i < endValue.intValue : (uint64_t)i < (uint64_t)endValue.intValue; i++)
+    {
+      if (!interpreter.step())
+      {
+        return false;
+      }
+
+      interpreter.setVariable(variable, ComptimeValue::integer(i, variable->getType()));
+      if (!body->interpret(interpreter))
+      {
+        return false;
+      }
+
+      if (interpreter.isReturning)
+      {
+        return true;
+      }
+    }
+
+    return true;
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(variable);
+    if (iterable)
+    {
+      children.push_back(iterable);
+    }
+    else
+    {
+      children.push_back(start);
+      children.push_back(end);
+    }
+
+    children.push_back(body);
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override
+  {
+    if (iterable && iterable->getType() && iterable->getType()->isSliceTy())
+    {
+      llvm::Value *slice = iterable->getType()->getElementTy()->isEquals(variable->getType()) ? iterable->codegen() : nullptr;
+      if (!slice)
+      {
+        return nullptr;
+      }
+
+      llvm::Type *elementTy = variable->getType()->getLLVMTy();
+      llvm::Value *data = CreateTypedAddress(elementTy, builder->CreateExtractValue(slice, 0, "slice_data"));
+      codegenLoop(builder->getInt64(0), builder->CreateExtractValue(slice, 1, "slice_length"), false, [&](llvm::Value *index)
+                  { return builder->CreateLoad(elementTy, builder->CreateInBoundsGEP(elementTy, data, index), variable->getName()); });
+    }
+    else if (iterable)
+    {
+      Type *iterableType = iterable->getType();
+      Type *arrayType = iterableType && iterableType->isPointerTy() ? iterableType->getElementTy() : iterableType;
+      if (!arrayType || !arrayType->isArrayTy() || !arrayType->getElementTy()->isEquals(variable->getType()))
+      {
+        return nullptr;
+      }
+
+      // The elements are read from memory, an array behind a pointer in
+      // place and an array in a variable that is not in memory already from
+      // a copy on the stack.
+      llvm::Value *array = nullptr;
+      if (iterableType->isPointerTy())
+      {
+        array = iterable->codegen();
+        if (!array)
+        {
+          return nullptr;
+        }
+      }
+      else if (iterable->getASTNodeID() == ASTNode::ASTIdentifierExpressionID)
+      {
+        ASTVariableStatement *arrayVariable = static_cast<ASTIdentifierExpression *>(iterable)->getVariable();
+        array = arrayVariable && arrayVariable->getIsAddressTaken() ? arrayVariable->getAlocatedValue() : nullptr;
+      }
+
+      llvm::Type *arrayTy = arrayType->getLLVMTy();
+      if (!array)
+      {
+        llvm::Value *arrayValue = iterable->codegen();
+        if (!arrayValue)
+        {
+          return nullptr;
+        }
+
+        array = CreateEntryBlockAlloca(builder->GetInsertBlock()->getParent(), arrayTy, "for_array");
+        builder->CreateStore(arrayValue, array);
+      }
+
+      uint64_t numOfElements = static_cast<ArrayType *>(arrayType)->getNumElements();
+      codegenLoop(builder->getInt64(0), builder->getInt64(numOfElements), false, [&](llvm::Value *index)
+                  { return CodegenArrayElement(static_cast<ArrayType *>(arrayType), array, index, variable->getName()); });
+    }
+    else
+    {
+      if (!variable->getType()->isIntegerTy())
+      {
+        return nullptr;
+      }
+
+      llvm::Value *startValue = start->codegen();
+      llvm::Value *endValue = end->codegen();
+      if (!startValue || !endValue)
+      {
+        return nullptr;
+      }
+
+      codegenRangeLoop(startValue, endValue);
+    }
+
+    return nullptr;
+  }
+};
+
+enum class ParallelSchedule
+{
+  Static,
+  Dynamic,
+};
+
+// Whether the program has a parallel for, its executable is linked with the
+// runtime then.
+bool globalHasParallelLoops = false;
+
+// parallel for i in start..end { }. The body is outlined into a function
+// that runs the iterations of a range and the loop becomes a call of the
+// runtime, see Runtime/parallel.cpp. The static schedule deals the range out
+// in chunks of the grain, the dynamic one splits ranges down to the grain
+// while idle threads steal them. A grain of zero lets the runtime choose.
+//
+// The body reads the variables around the loop through a copy of their
+// values taken when the loop starts, so it can neither assign them nor
+// return. Variables in memory can not be read, their memory belongs to the
+// frame of the function.
+class ASTParallelForStatement : public ASTForStatement
+{
+protected:
+  ParallelSchedule schedule;
+  int64_t grain;
+
+  // Finds the variables declared outside of the body that it reads. False
+  // when the body can not be outlined, with the reason.
+  bool findCaptures(std::vector<ASTVariableStatement *> &captures, std::string &reason)
+  {
+    std::vector<ASTNode *> nodes;
+    std::vector<ASTNode *> stack = {body};
+    while (!stack.empty())
+    {
+      ASTNode *node = stack.back();
+      stack.pop_back();
+      nodes.push_back(node);
+
+      std::vector<ASTNode *> children = node->getChildrenShow();
+      stack.insert(stack.end(), children.rbegin(), children.rend());
+    }
+
+    llvm::SmallPtrSet<ASTVariableStatement *, 16> declared = {variable};
+    for (int i = 0; i < nodes.size(); i++)
+    {
+      if (nodes[i]->getASTNodeID() == ASTNode::ASTVariableStatementID || nodes[i]->getASTNodeID() == ASTNode::ASTObjectStatementID || (nodes[i]->getASTNodeID() == ASTNode::ASTAssignVariableStatementID && static_cast<ASTAssignVariableStatement *>(nodes[i])->getAssignedVariable() == nodes[i]))
+      {
+        declared.insert(static_cast<ASTVariableStatement *>(nodes[i]));
+      }
+      else if (nodes[i]->getASTNodeID() == ASTNode::ASTForStatementID)
+      {
+        declared.insert(static_cast<ASTForStatement *>(nodes[i])->getVariable());
+      }
+    }
+
+    llvm::SmallPtrSet<ASTVariableStatement *, 16> captured;
+    for (int i = 0; i < nodes.size(); i++)
+    {
+      ASTVariableStatement *used = nullptr;
+      switch (nodes[i]->getASTNodeID())
+      {
+      case ASTNode::ASTReturnStatementID:
+        reason = "the body returns";
+        return false;
+      case ASTNode::ASTAssignVariableStatementID:
+        if (!declared.count(static_cast<ASTAssignVariableStatement *>(nodes[i])->getAssignedVariable()))
+        {
+          reason = "the body assigns " + static_cast<ASTAssignVariableStatement *>(nodes[i])->getAssignedVariable()->getName() + ", which is declared outside of it";
+          return false;
+        }
+        break;
+      case ASTNode::ASTIdentifierExpressionID:
+        used = static_cast<ASTIdentifierExpression *>(nodes[i])->getVariable();
+        break;
+      default:
+        break;
+      }
+
+      if (used && !declared.count(used) && captured.insert(used).second)
+      {
+        if (used->getIsAddressTaken())
+        {
+          reason = "the body reads " + used->getName() + ", which is in memory";
+          return false;
+        }
+
+        captures.push_back(used);
+      }
+    }
+
+    return true;
+  }
+
+public:
+  ASTParallelForStatement(ASTVariableStatement *variable,
+                          ASTExpression *start,
+                          ASTExpression *end,
+                          ASTBlock *body,
+                          ParallelSchedule schedule = ParallelSchedule::Static,
+                          int64_t grain = 0,
+                          LoopHints hints = LoopHints()) : schedule(schedule),
+                                                           grain(grain),
+                                                           ASTForStatement(variable, start, end, body, hints)
+  {
+    showKind = "ParallelForStatement";
+    globalHasParallelLoops = true;
+  };
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTForStatement::hash(hasher);
+    UpdateHash(hasher, (schedule == ParallelSchedule::Dynamic ? "dynamic " : "static ") + std::to_string(grain));
+  }
+
+  bool interpret(ComptimeInterpreter &interpreter) override { return false; }
+
+  llvm::Value *codegen() override
+  {
+    std::vector<ASTVariableStatement *> captures;
+    std::string reason;
+    Type *variableType = variable->getType();
+    if (!variableType->isIntegerTy())
+    {
+      ReportError("parallel for " + variable->getName() + " can not be outlined, its variable is not an integer");
+      return nullptr;
+    }
+
+    if (!findCaptures(captures, reason))
+    {
+      ReportError("parallel for " + variable->getName() + " can not be outlined, " + reason);
+      return nullptr;
+    }
+
+    llvm::Value *startValue = start->codegen();
+    llvm::Value *endValue = end->codegen();
+    if (!startValue || !endValue)
+    {
+      return nullptr;
+    }
+
+    bool isSigned = variableType->isSignedIntegerTy();
+    llvm::Type *int64Ty = builder->getInt64Ty();
+    llvm::Type *int8PtrTy = builder->getInt8PtrTy();
+    llvm::Function *function = builder->GetInsertBlock()->getParent();
+
+    std::vector<llvm::Type *> captureTys;
+    std::vector<llvm::Value *> captureValues;
+    for (int i = 0; i < captures.size(); i++)
+    {
+      captureValues.push_back(captures[i]->load());
+      captureTys.push_back(captures[i]->getType()->getLLVMTy());
+    }
+
+    llvm::StructType *contextTy = llvm::StructType::get(*context, captureTys);
+    llvm::AllocaInst *loopContext = CreateEntryBlockAlloca(function, contextTy, "parallel_context");
+    for (int i = 0; i < captureValues.size(); i++)
+    {
+      builder->CreateStore(captureValues[i], builder->CreateStructGEP(contextTy, loopContext, i));
+    }
+
+    // The runtime calls the body with the C calling convention.
+    llvm::FunctionType *bodyTy = llvm::FunctionType::get(builder->getVoidTy(), {int8PtrTy, int64Ty, int64Ty}, false);
+    llvm::Function *bodyFunction = llvm::Function::Create(bodyTy, llvm::GlobalValue::InternalLinkage, function->getName() + ".parallel_body", module.get());
+    bodyFunction->setDoesNotThrow();
+    {
+      llvm::IRBuilderBase::InsertPointGuard insertPointGuard(*builder);
+      SSABuilder ssaBuilder;
+      SSABuilder *outerSSABuilder = globalSSABuilder;
+      FunctionProfiler *outerProfiler = globalFunctionProfiler;
+      llvm::BasicBlock *outerRecurseBlock = globalTailRecurseBlock;
+      globalSSABuilder = &ssaBuilder;
+      globalFunctionProfiler = nullptr;
+      globalTailRecurseBlock = nullptr;
+
+      llvm::BasicBlock *entryBlock = llvm::BasicBlock::Create(*context, "entry", bodyFunction);
+      builder->SetInsertPoint(entryBlock);
+      ssaBuilder.sealBlock(entryBlock);
+
+      llvm::Value *bodyContext = builder->CreatePointerCast(bodyFunction->getArg(0), contextTy->getPointerTo());
+      for (int i = 0; i < captures.size(); i++)
+      {
+        captures[i]->define(builder->CreateLoad(captureTys[i], builder->CreateStructGEP(contextTy, bodyContext, i), captures[i]->getName()));
+      }
+
+      llvm::Type *indexTy = variableType->getLLVMTy();
+      codegenLoop(builder->CreateTrunc(bodyFunction->getArg(1), indexTy), builder->CreateTrunc(bodyFunction->getArg(2), indexTy), isSigned, [](llvm::Value *index)
+                  { return index; });
+      builder->CreateRetVoid();
+
+      globalTailRecurseBlock = outerRecurseBlock;
+      globalFunctionProfiler = outerProfiler;
+      globalSSABuilder = outerSSABuilder;
+    }
+
+    llvm::FunctionCallee parallelFor = module->getOrInsertFunction("__gearfuse_parallel_for", builder->getVoidTy(), int64Ty, int64Ty, int64Ty, builder->getInt32Ty(), int8PtrTy, int8PtrTy);
+    builder->CreateCall(parallelFor, {builder->CreateIntCast(startValue, int64Ty, isSigned),
+                                      builder->CreateIntCast(endValue, int64Ty, isSigned),
+                                      builder->getInt64(grain),
+                                      builder->getInt32(schedule == ParallelSchedule::Dynamic ? 1 : 0),
+                                      builder->CreatePointerCast(bodyFunction, int8PtrTy),
+                                      builder->CreatePointerCast(loopContext, int8PtrTy)});
+    return nullptr;
+  }
+};
+
+class ASTCallExpression : public ASTExpression
+{
+protected:
+  Token token;
+  std::vector<ASTExpression *> args;
+  ASTPrototype *foundPrototype;
+
+public:
+  ASTCallExpression(Token token, std::vector<ASTExpression *> args) : token(token),
+                                                                      args(std::move(args)),
+                                                                      ASTExpression(ASTNode::ASTCallExpressionID, "CallExpression", token.value)
+  {
+    foundPrototype = globalPrototypes.count(token.value) ? globalPrototypes[token.value] : nullptr;
+    if (foundPrototype)
+    {
+      setType(foundPrototype->getReturnType());
+    }
+  };
+
+  void evaluateType() override
+  {
+    for (int i = 0; i < args.size(); i++)
+    {
+      args[i]->evaluateType();
+      if (foundPrototype && i < foundPrototype->getNumArgs())
+      {
+        args[i] = ASTCastExpression::convert(args[i], foundPrototype->getArg(i)->getType());
+      }
+    }
+  }
+
+  // A call of a const function with literal arguments is run in the
+  // interpreter and replaced by its result. When that does not work out it
+  // is left to run time.
+  ASTExpression *fold() override
+  {
+    bool isConstant = true;
+    for (int i = 0; i < args.size(); i++)
+    {
+      args[i] = args[i]->fold();
+      isConstant = isConstant && ASTNumberExpression::asNumber(args[i]);
+    }
+
+    if (!isConstant || !foundPrototype || !foundPrototype->getIsConst())
+    {
+      return this;
+    }
+
+    ComptimeInterpreter interpreter;
+    ComptimeValue value = evaluate(interpreter);
+    if (!value.isKnown())
+    {
+      return this;
+    }
+
+    return value.toExpression();
+  }
+
+  ComptimeValue evaluate(ComptimeInterpreter &interpreter) override
+  {
+    ASTFunction *definition = foundPrototype ? foundPrototype->getDefinition() : nullptr;
+    if (!definition)
+    {
+      return ComptimeValue();
+    }
+
+    std::vector<ComptimeValue> argValues;
+    for (int i = 0; i < args.size(); i++)
+    {
+      ComptimeValue argValue = args[i]->evaluate(interpreter);
+      if (!argValue.isKnown())
+      {
+        return ComptimeValue();
+      }
+
+      argValues.push_back(argValue);
+    }
+
+    return definition->call(interpreter, argValues);
+  }
+
+  std::string getName() { return token.value; }
+  ASTPrototype *getPrototype() { return foundPrototype; }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTExpression::hash(hasher);
+    if (foundPrototype)
+    {
+      foundPrototype->hashDeclaration(hasher);
+    }
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    for (int i = 0; i < args.size(); i++)
+    {
+      children.push_back(args[i]);
+    }
+
+    return std::move(children);
+  }
+
+  // The callee is declared in the current module when it is defined in
+  // another one, which is the case for every partition but its own.
+  llvm::Value *codegen() override
+  {
+    if (!foundPrototype || args.size() != foundPrototype->getNumArgs())
+    {
+      return nullptr;
+    }
+
+    llvm::Function *function = foundPrototype->codegen();
+    std::vector<llvm::Value *> argValues;
+    if (!codegenArgs(argValues))
+    {
+      return nullptr;
+    }
+
+    llvm::CallInst *call = function->getReturnType()->isVoidTy() ? builder->CreateCall(function, argValues)
+                                                                  : builder->CreateCall(function, argValues, "call_tmp");
+    call->setCallingConv(function->getCallingConv());
+    return call;
+  }
+
+  bool codegenArgs(std::vector<llvm::Value *> &argValues)
+  {
+    for (int i = 0; i < args.size(); i++)
+    {
+      llvm::Value *argValue = args[i]->codegen();
+      if (!argValue)
+      {
+        return false;
+      }
+
+      argValues.push_back(argValue);
+    }
+
+    return true;
+  }
+};
+
+llvm::Value *CodegenObjectAddress(ASTExpression *object);
+void MarkObjectInMemory(ASTExpression *object);
+
+// The address of an array, of the one a pointer points to or of one in
+// memory. Any other array value is copied to the stack.
+llvm::Value *CodegenArrayAddress(ASTExpression *array)
+{
+  llvm::Value *address = CodegenObjectAddress(array);
+  if (address)
+  {
+    return address;
+  }
+
+  llvm::Value *arrayValue = array->codegen();
+  if (!arrayValue)
+  {
+    return nullptr;
+  }
+
+  llvm::AllocaInst *copy = CreateEntryBlockAlloca(builder->GetInsertBlock()->getParent(), arrayValue->getType(), "array_tmp");
+  builder->CreateStore(arrayValue, copy);
+  return copy;
+}
+
+// array[index], an element of an array, of the array a pointer points to or
+// of a slice. Elements are read from memory, a variable holding the array is
+// stored in the frame. An element of the struct-of-arrays layout has no
+// address of its own, its fields are read where they are, see
+// ASTMemberExpression. The index is checked against the length, unless a
+// loop around already checked the whole range of its indexes, see
+// ASTForStatement.
+class ASTIndexExpression : public ASTExpression
+{
+protected:
+  ASTExpression *array;
+  ASTExpression *index;
+  ArrayType *arrayType;
+  SliceType *sliceType;
+  bool isInBounds = false;
+
+  // The address of the first element and the index, after the check.
+  bool codegenOperands(llvm::Value *&arrayAddress, llvm::Value *&indexValue)
+  {
+    if ((!arrayType && !sliceType) || !index->getType() || !index->getType()->isIntegerTy())
+    {
+      return false;
+    }
+
+    llvm::Value *length;
+    if (sliceType)
+    {
+      llvm::Value *slice = array->codegen();
+      if (!slice)
+      {
+        return false;
+      }
+
+      arrayAddress = builder->CreateExtractValue(slice, 0, "slice_data");
+      length = builder->CreateExtractValue(slice, 1, "slice_length");
+    }
+    else
+    {
+      arrayAddress = CodegenArrayAddress(array);
+      length = builder->getInt64(arrayType->getNumElements());
+    }
+
+    indexValue = arrayAddress ? index->codegen() : nullptr;
+    if (!indexValue)
+    {
+      return false;
+    }
+
+    if (!isInBounds)
+    {
+      CodegenBoundsCheck(builder->CreateICmpULT(indexValue, length, "in_bounds"));
+    }
+
+    return true;
+  }
+
+  llvm::Value *codegenElementAddress(llvm::Value *arrayAddress, llvm::Value *indexValue)
+  {
+    if (arrayType)
+    {
+      return CodegenArrayElementAddress(arrayType, arrayAddress, indexValue);
+    }
+
+    llvm::Type *elementTy = getType()->getLLVMTy();
+    return builder->CreateInBoundsGEP(elementTy, CreateTypedAddress(elementTy, arrayAddress), indexValue, "element_address");
+  }
+
+public:
+  ASTIndexExpression(ASTExpression *array, ASTExpression *index) : array(array),
+                                                                   index(index),
+                                                                   arrayType(GetArrayType(array->getType())),
+                                                                   sliceType(array->getType() && array->getType()->isSliceTy() ? (SliceType *)array->getType() : nullptr),
+                                                                   ASTExpression(ASTNode::ASTIndexExpressionID, "IndexExpression")
+  {
+    if (arrayType)
+    {
+      setType(arrayType->getElementTy());
+      MarkObjectInMemory(array);
+    }
+    else if (sliceType)
+    {
+      setType(sliceType->getElementTy());
+    }
+  };
+
+  ASTExpression *getArray() { return array; }
+  ASTExpression *getIndex() { return index; }
+  ArrayType *getArrayType() { return arrayType; }
+  bool isSoA() { return arrayType && arrayType->isSoA(); }
+
+  // Whether the element is known to exist, its index is not checked then.
+  void setInBounds(bool isKnown) { isInBounds = isKnown; }
+
+  void evaluateType() override
+  {
+    array->evaluateType();
+    index->evaluateType();
+    index = ASTCastExpression::convert(index, Type::getInteger64Ty());
+  }
+
+  ASTExpression *fold() override
+  {
+    array = array->fold();
+    index = index->fold();
+    return this;
+  }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTExpression::hash(hasher);
+    UpdateHash(hasher, array->getType() ? array->getType()->getManglingName() : "");
+    ArrayType *arrayType = GetArrayType(array->getType());
+    if (arrayType && arrayType->isSoA())
+    {
+      HashClass(hasher, (ClassType *)arrayType->getElementTy());
+    }
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(array);
+    children.push_back(index);
+    return std::move(children);
+  }
+
+  // The address of the element and the index, for an element of an array
+  // of the struct-of-arrays layout.
+  bool codegenSoAElement(llvm::Value *&arrayAddress, llvm::Value *&indexValue)
+  {
+    return isSoA() && codegenOperands(arrayAddress, indexValue);
+  }
+
+  // Null for an element of the struct-of-arrays layout.
+  llvm::Value *codegenAddress()
+  {
+    llvm::Value *arrayAddress, *indexValue;
+    if (isSoA() || !codegenOperands(arrayAddress, indexValue))
+    {
+      return nullptr;
+    }
+
+    return codegenElementAddress(arrayAddress, indexValue);
+  }
+
+  // The address of a field of an element of the struct-of-arrays layout,
+  // field is its index in the LLVM struct of the class.
+  llvm::Value *codegenFieldAddress(unsigned field)
+  {
+    llvm::Value *arrayAddress, *indexValue;
+    if (!codegenSoAElement(arrayAddress, indexValue))
+    {
+      return nullptr;
+    }
+
+    return CodegenSoAFieldAddress(arrayType, arrayAddress, indexValue, field);
+  }
+
+  llvm::Value *codegenStore(llvm::Value *element)
+  {
+    llvm::Value *arrayAddress, *indexValue;
+    if (!codegenOperands(arrayAddress, indexValue))
+    {
+      return nullptr;
+    }
+
+    if (isSoA())
+    {
+      CodegenArrayElementStore(arrayType, arrayAddress, indexValue, element);
+      return element;
+    }
+
+    return builder->CreateStore(element, codegenElementAddress(arrayAddress, indexValue));
+  }
+
+  llvm::Value *codegen() override
+  {
+    llvm::Value *arrayAddress, *indexValue;
+    if (!codegenOperands(arrayAddress, indexValue))
+    {
+      return nullptr;
+    }
+
+    if (isSoA())
+    {
+      return CodegenArrayElement(arrayType, arrayAddress, indexValue, "element");
+    }
+
+    return builder->CreateLoad(getType()->getLLVMTy(), codegenElementAddress(arrayAddress, indexValue), "element");
+  }
+};
+
+// array[lo..hi], a slice of the elements from lo up to hi of an array, of
+// the array a pointer points to or of a slice, without copying them. lo
+// defaults to the first element and hi to the end. The view of an array in
+// a variable keeps it in the frame, it must not outlive the function. The
+// fields of the struct-of-arrays layout are not consecutive, its arrays can
+// not be sliced.
+class ASTSliceExpression : public ASTExpression
+{
+protected:
+  ASTExpression *array;
+  ASTExpression *lo;
+  ASTExpression *hi;
+  ArrayType *arrayType;
+
+public:
+  ASTSliceExpression(ASTExpression *array, ASTExpression *lo = nullptr, ASTExpression *hi = nullptr) : array(array),
+                                                                                                      lo(lo),
+                                                                                                      hi(hi),
+                                                                                                      arrayType(GetArrayType(array->getType())),
+                                                                                                      ASTExpression(ASTNode::ASTSliceExpressionID, "SliceExpression")
+  {
+    if (arrayType && !arrayType->isSoA())
+    {
+      setType(Type::getSliceTy(arrayType->getElementTy()));
+      MarkObjectInMemory(array);
+    }
+    else if (array->getType() && array->getType()->isSliceTy())
+    {
+      setType(array->getType());
+    }
+  };
+
+  void evaluateType() override
+  {
+    array->evaluateType();
+    if (lo)
+    {
+      lo->evaluateType();
+      lo = ASTCastExpression::convert(lo, Type::getInteger64Ty());
+    }
+
+    if (hi)
+    {
+      hi->evaluateType();
+      hi = ASTCastExpression::convert(hi, Type::getInteger64Ty());
+    }
+  }
+
+  ASTExpression *fold() override
+  {
+    array = array->fold();
+    lo = lo ? lo->fold() : nullptr;
+    hi = hi ? hi->fold() : nullptr;
+    return this;
+  }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTExpression::hash(hasher);
+    UpdateHash(hasher, array->getType() ? array->getType()->getManglingName() : "");
+    UpdateHash(hasher, std::string(lo ? "lo" : "") + (hi ? "hi" : ""));
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(array);
+    if (lo)
+    {
+      children.push_back(lo);
+    }
+
+    if (hi)
+    {
+      children.push_back(hi);
+    }
+
+    return std::move(children);
+  }
+
+  // lo <= hi <= length is checked, as unsigned numbers so that negative
+  // bounds fail too.
+  llvm::Value *codegen() override
+  {
+    if (!getType())
+    {
+      return nullptr;
+    }
+
+    llvm::Value *data, *length;
+    if (arrayType)
+    {
+      data = CodegenArrayAddress(array);
+      length = builder->getInt64(arrayType->getNumElements());
+    }
+    else
+    {
+      llvm::Value *slice = array->codegen();
+      data = slice ? builder->CreateExtractValue(slice, 0, "slice_data") : nullptr;
+      length = slice ? builder->CreateExtractValue(slice, 1, "slice_length") : nullptr;
+    }
+
+    llvm::Value *loValue = lo ? lo->codegen() : builder->getInt64(0);
+    llvm::Value *hiValue = hi ? hi->codegen() : length;
+    if (!data || !loValue || !hiValue)
+    {
+      return nullptr;
+    }
+
+    CodegenBoundsCheck(builder->CreateAnd(builder->CreateICmpULE(loValue, hiValue), builder->CreateICmpULE(hiValue, length), "in_bounds"));
+    llvm::Type *elementTy = getType()->getElementTy()->getLLVMTy();
+    llvm::Value *first = builder->CreateInBoundsGEP(elementTy, CreateTypedAddress(elementTy, data), loValue, "slice_first");
+    llvm::Value *slice = llvm::UndefValue::get(getType()->getLLVMTy());
+    slice = builder->CreateInsertValue(slice, builder->CreatePointerCast(first, llvm::PointerType::get(*context, 0)), 0);
+    return builder->CreateInsertValue(slice, builder->CreateSub(hiValue, loValue, "slice_length", true, true), 1, "slice");
+  }
+};
+
+// len(array), the number of elements of an array, of the array a pointer
+// points to or of a slice. The length of an array is known from its type,
+// the array is not evaluated.
+class ASTLengthExpression : public ASTExpression
+{
+protected:
+  ASTExpression *operand;
+
+public:
+  ASTLengthExpression(ASTExpression *operand) : operand(operand),
+                                                ASTExpression(Type::getInteger64Ty(), ASTNode::ASTLengthExpressionID, "LengthExpression"){};
+
+  ASTExpression *getOperand() { return operand; }
+
+  void evaluateType() override
+  {
+    operand->evaluateType();
+  }
+
+  ASTExpression *fold() override
+  {
+    operand = operand->fold();
+    return this;
+  }
+
+  ComptimeValue evaluate(ComptimeInterpreter &interpreter) override
+  {
+    ArrayType *arrayType = GetArrayType(operand->getType());
+    return arrayType ? ComptimeValue::integer(arrayType->getNumElements(), getType()) : ComptimeValue();
+  }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTExpression::hash(hasher);
+    UpdateHash(hasher, operand->getType() ? operand->getType()->getManglingName() : "");
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(operand);
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override
+  {
+    ArrayType *arrayType = GetArrayType(operand->getType());
+    if (arrayType)
+    {
+      return builder->getInt64(arrayType->getNumElements());
+    }
+
+    llvm::Value *slice = operand->getType() && operand->getType()->isSliceTy() ? operand->codegen() : nullptr;
+    return slice ? builder->CreateExtractValue(slice, 1, "slice_length") : nullptr;
+  }
+};
+
+bool ASTForStatement::isVersionable()
+{
+  unsigned numOfNodes = 0;
+  std::vector<ASTNode *> stack = {body};
+  while (!stack.empty())
+  {
+    ASTNode *node = stack.back();
+    stack.pop_back();
+    if (++numOfNodes > maxVersionedNodes || (node->getASTNodeID() == ASTNode::ASTForStatementID && static_cast<ASTForStatement *>(node)->isRangeLoop()))
+    {
+      return false;
+    }
+
+    std::vector<ASTNode *> children = node->getChildrenShow();
+    stack.insert(stack.end(), children.begin(), children.end());
+  }
+
+  return true;
+}
+
+llvm::Value *ASTForStatement::codegenRangeInBounds(llvm::Value *startValue, llvm::Value *endValue, std::vector<ASTIndexExpression *> &elements, bool isArrayOnly)
+{
+  std::vector<ASTNode *> nodes;
+  std::vector<ASTNode *> stack = {body};
+  while (!stack.empty())
+  {
+    ASTNode *node = stack.back();
+    stack.pop_back();
+    nodes.push_back(node);
+
+    std::vector<ASTNode *> children = node->getChildrenShow();
+    stack.insert(stack.end(), children.rbegin(), children.rend());
+  }
+
+  // The variables the body declares or assigns.
+  llvm::SmallPtrSet<ASTVariableStatement *, 16> changed;
+  for (int i = 0; i < nodes.size(); i++)
+  {
+    if (nodes[i]->getASTNodeID() == ASTNode::ASTVariableStatementID || nodes[i]->getASTNodeID() == ASTNode::ASTObjectStatementID)
+    {
+      changed.insert(static_cast<ASTVariableStatement *>(nodes[i]));
+    }
+    else if (nodes[i]->getASTNodeID() == ASTNode::ASTAssignVariableStatementID)
+    {
+      changed.insert(static_cast<ASTAssignVariableStatement *>(nodes[i])->getAssignedVariable());
+    }
+    else if (nodes[i]->getASTNodeID() == ASTNode::ASTForStatementID)
+    {
+      changed.insert(static_cast<ASTForStatement *>(nodes[i])->getVariable());
+    }
+  }
+
+  if (changed.count(variable))
+  {
+    return nullptr;
+  }
+
+  bool isSigned = variable->getType()->isSignedIntegerTy();
+  llvm::Value *end64 = builder->CreateIntCast(endValue, builder->getInt64Ty(), isSigned);
+  llvm::Value *isInBounds = nullptr;
+  for (int i = 0; i < nodes.size(); i++)
+  {
+    if (nodes[i]->getASTNodeID() != ASTNode::ASTIndexExpressionID)
+    {
+      continue;
+    }
+
+    ASTIndexExpression *element = static_cast<ASTIndexExpression *>(nodes[i]);
+    ASTExpression *index = element->getIndex();
+    if (index->getASTNodeID() == ASTNode::ASTCastExpressionID)
+    {
+      index = static_cast<ASTCastExpression *>(index)->getOperand();
+    }
+
+    if (index->getASTNodeID() != ASTNode::ASTIdentifierExpressionID || static_cast<ASTIdentifierExpression *>(index)->getVariable() != variable)
+    {
+      continue;
+    }
+
+    llvm::Value *length = nullptr;
+    ASTExpression *array = element->getArray();
+    if (element->getArrayType())
+    {
+      length = builder->getInt64(element->getArrayType()->getNumElements());
+    }
+    else if (!isArrayOnly && array->getType() && array->getType()->isSliceTy() && array->getASTNodeID() == ASTNode::ASTIdentifierExpressionID)
+    {
+      ASTVariableStatement *sliceVariable = static_cast<ASTIdentifierExpression *>(array)->getVariable();
+      llvm::Value *slice = sliceVariable && !sliceVariable->getIsAddressTaken() && !changed.count(sliceVariable) ? sliceVariable->load() : nullptr;
+      length = slice ? builder->CreateExtractValue(slice, 1, "slice_length") : nullptr;
+    }
+
+    if (!length)
+    {
+      continue;
+    }
+
+    llvm::Value *isEndInBounds = builder->CreateICmpULE(end64, length, "end_in_bounds");
+    isInBounds = isInBounds ? builder->CreateAnd(isInBounds, isEndInBounds) : isEndInBounds;
+    elements.push_back(element);
+  }
+
+  if (!isInBounds)
+  {
+    return nullptr;
+  }
+
+  if (isSigned)
+  {
+    isInBounds = builder->CreateAnd(builder->CreateICmpSGE(startValue, llvm::ConstantInt::get(startValue->getType(), 0)), isInBounds);
+  }
+
+  llvm::Value *isEmpty = isSigned ? builder->CreateICmpSGE(startValue, endValue) : builder->CreateICmpUGE(startValue, endValue);
+  return builder->CreateOr(isEmpty, isInBounds, "range_in_bounds");
+}
+
+void ASTForStatement::codegenRangeLoop(llvm::Value *startValue, llvm::Value *endValue)
+{
+  bool isSigned = variable->getType()->isSignedIntegerTy();
+  std::function<llvm::Value *(llvm::Value *)> identity = [](llvm::Value *index)
+  { return index; };
+  std::vector<ASTIndexExpression *> elements;
+  bool isVersioned = isVersionable();
+  llvm::Value *isInBounds = nullptr;
+  if (isVersioned || (llvm::isa<llvm::Constant>(startValue) && llvm::isa<llvm::Constant>(endValue)))
+  {
+    isInBounds = codegenRangeInBounds(startValue, endValue, elements, !isVersioned);
+  }
+
+  llvm::ConstantInt *isKnown = llvm::dyn_cast_or_null<llvm::ConstantInt>(isInBounds);
+  if (!isInBounds || isKnown)
+  {
+    for (ASTIndexExpression *element : elements)
+    {
+      element->setInBounds(isKnown && isKnown->isOne());
+    }
+
+    codegenLoop(startValue, endValue, isSigned, identity);
+    return;
+  }
+
+  llvm::Function *function = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *uncheckedBasicBlock = llvm::BasicBlock::Create(*context, "for_unchecked", function);
+  llvm::BasicBlock *checkedBasicBlock = llvm::BasicBlock::Create(*context, "for_checked");
+  llvm::BasicBlock *endBasicBlock = llvm::BasicBlock::Create(*context, "for_checked_end");
+  builder->CreateCondBr(isInBounds, uncheckedBasicBlock, checkedBasicBlock);
+  globalSSABuilder->sealBlock(uncheckedBasicBlock);
+  globalSSABuilder->sealBlock(checkedBasicBlock);
+
+  builder->SetInsertPoint(uncheckedBasicBlock);
+  for (ASTIndexExpression *element : elements)
+  {
+    element->setInBounds(true);
+  }
+
+  codegenLoop(startValue, endValue, isSigned, identity);
+  builder->CreateBr(endBasicBlock);
+
+  function->getBasicBlockList().push_back(checkedBasicBlock);
+  builder->SetInsertPoint(checkedBasicBlock);
+  for (ASTIndexExpression *element : elements)
+  {
+    element->setInBounds(false);
+  }
+
+  codegenLoop(startValue, endValue, isSigned, identity);
+  builder->CreateBr(endBasicBlock);
+
+  function->getBasicBlockList().push_back(endBasicBlock);
+  globalSSABuilder->sealBlock(endBasicBlock);
+  builder->SetInsertPoint(endBasicBlock);
+}
+
+// object.field, a field of an object or of the object a pointer points to.
+class ASTMemberExpression : public ASTExpression
+{
+protected:
+  ASTExpression *object;
+  Token token;
+  ClassType *classType;
+
+public:
+  ASTMemberExpression(ASTExpression *object, Token token) : object(object),
+                                                            token(token),
+                                                            classType(GetClassType(object->getType())),
+                                                            ASTExpression(ASTNode::ASTMemberExpressionID, "MemberExpression", token.value)
+  {
+    if (classType)
+    {
+      setType(classType->getFieldType(token.value));
+    }
+  };
+
+  ASTExpression *getObject() { return object; }
+
+  void evaluateType() override
+  {
+    object->evaluateType();
+  }
+
+  ASTExpression *fold() override
+  {
+    object = object->fold();
+    return this;
+  }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTExpression::hash(hasher);
+    UpdateHash(hasher, classType ? classType->getLayoutName() : "");
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(object);
+    return std::move(children);
+  }
+
+  // Null, without generating anything, when the object is a value that is
+  // not in memory.
+  llvm::Value *codegenAddress()
+  {
+    int index = classType ? classType->getFieldIndex(token.value) : -1;
+    if (index >= 0 && object->getASTNodeID() == ASTNode::ASTIndexExpressionID && static_cast<ASTIndexExpression *>(object)->isSoA())
+    {
+      return static_cast<ASTIndexExpression *>(object)->codegenFieldAddress(index);
+    }
+
+    llvm::Value *objectAddress = index < 0 ? nullptr : CodegenObjectAddress(object);
+    if (!objectAddress)
+    {
+      return nullptr;
+    }
+
+    return builder->CreateStructGEP(classType->getLLVMTy(), CreateTypedAddress(classType->getLLVMTy(), objectAddress), index, token.value + "_address");
+  }
+
+  llvm::Value *codegen() override
+  {
+    int index = classType ? classType->getFieldIndex(token.value) : -1;
+    if (index < 0)
+    {
+      return nullptr;
+    }
+
+    llvm::Value *address = codegenAddress();
+    if (address)
+    {
+      return builder->CreateLoad(getType()->getLLVMTy(), address, token.value);
+    }
+
+    llvm::Value *objectValue = object->getType()->isStructTy() ? object->codegen() : nullptr;
+    if (!objectValue)
+    {
+      return nullptr;
+    }
+
+    return builder->CreateExtractValue(objectValue, index, token.value);
+  }
+};
+
+// The address of an object or array, of the one a pointer points to or of
+// one in memory. Null, without generating anything, for any other value.
+llvm::Value *CodegenObjectAddress(ASTExpression *object)
+{
+  Type *type = object->getType();
+  if (type && type->isPointerTy())
+  {
+    return object->codegen();
+  }
+
+  if (!type || (!type->isStructTy() && !type->isArrayTy()))
+  {
+    return nullptr;
+  }
+
+  if (object->getASTNodeID() == ASTNode::ASTIdentifierExpressionID)
+  {
+    ASTVariableStatement *variable = static_cast<ASTIdentifierExpression *>(object)->getVariable();
+    return variable && variable->getIsAddressTaken() ? variable->getAddress() : nullptr;
+  }
+
+  if (object->getASTNodeID() == ASTNode::ASTMemberExpressionID)
+  {
+    return static_cast<ASTMemberExpression *>(object)->codegenAddress();
+  }
+
+  if (object->getASTNodeID() == ASTNode::ASTIndexExpressionID)
+  {
+    return static_cast<ASTIndexExpression *>(object)->codegenAddress();
+  }
+
+  return nullptr;
+}
+
+// An object or array changed in place lives in memory, a variable holding
+// one is stored in the frame.
+void MarkObjectInMemory(ASTExpression *object)
+{
+  while (object->getType() && (object->getType()->isStructTy() || object->getType()->isArrayTy()))
+  {
+    if (object->getASTNodeID() == ASTNode::ASTMemberExpressionID)
+    {
+      object = static_cast<ASTMemberExpression *>(object)->getObject();
+    }
+    else if (object->getASTNodeID() == ASTNode::ASTIndexExpressionID)
+    {
+      object = static_cast<ASTIndexExpression *>(object)->getArray();
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if (object->getASTNodeID() == ASTNode::ASTIdentifierExpressionID && object->getType() && (object->getType()->isStructTy() || object->getType()->isArrayTy()))
+  {
+    ASTVariableStatement *variable = static_cast<ASTIdentifierExpression *>(object)->getVariable();
+    if (variable)
+    {
+      variable->markAddressTaken();
+    }
+  }
+}
+
+// &variable, &object.field or &array[index], a pointer to a variable,
+// which then lives in memory.
+class ASTReferenceExpression : public ASTExpression
+{
+protected:
+  ASTExpression *operand;
+
+public:
+  ASTReferenceExpression(ASTExpression *operand) : operand(operand),
+                                                   ASTExpression(ASTNode::ASTReferenceExpressionID, "ReferenceExpression")
+  {
+    if (operand->getASTNodeID() == ASTNode::ASTIdentifierExpressionID && static_cast<ASTIdentifierExpression *>(operand)->getVariable())
+    {
+      static_cast<ASTIdentifierExpression *>(operand)->getVariable()->markAddressTaken();
+    }
+    else
+    {
+      MarkObjectInMemory(operand);
+    }
+
+    if (operand->getType())
+    {
+      setType(Type::getPointerTy(operand->getType(), 0));
+    }
+  };
+
+  void evaluateType() override
+  {
+    operand->evaluateType();
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(operand);
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override
+  {
+    if (operand->getASTNodeID() == ASTNode::ASTIdentifierExpressionID)
+    {
+      ASTVariableStatement *variable = static_cast<ASTIdentifierExpression *>(operand)->getVariable();
+      return variable ? variable->getAddress() : nullptr;
+    }
+
+    llvm::Value *address = nullptr;
+    if (operand->getASTNodeID() == ASTNode::ASTMemberExpressionID)
+    {
+      address = static_cast<ASTMemberExpression *>(operand)->codegenAddress();
+    }
+    else if (operand->getASTNodeID() == ASTNode::ASTIndexExpressionID)
+    {
+      address = static_cast<ASTIndexExpression *>(operand)->codegenAddress();
+    }
+
+    return address ? builder->CreatePointerCast(address, llvm::PointerType::get(*context, 0)) : nullptr;
+  }
+};
+
+// object.field = expression
+class ASTMemberAssignStatement : public ASTStatement
+{
+protected:
+  ASTMemberExpression *target;
+  ASTExpression *expression;
+
+public:
+  ASTMemberAssignStatement(ASTExpression *object, Token token, ASTExpression *expression) : target(new ASTMemberExpression(object, token)),
+                                                                                            expression(expression),
+                                                                                            ASTStatement(ASTNode::ASTMemberAssignStatementID, "MemberAssignStatement", token.value)
+  {
+    MarkObjectInMemory(object);
+  };
+
+  void evaluateType() override
+  {
+    target->evaluateType();
+    expression->evaluateType();
+    expression = ASTCastExpression::convert(expression, target->getType());
+  }
+
+  ASTStatement *fold() override
+  {
+    target->fold();
+    expression = expression->fold();
+    return this;
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(target);
+    children.push_back(expression);
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override
+  {
+    llvm::Value *expressionValue = target->getType() ? expression->codegen() : nullptr;
+    llvm::Value *address = expressionValue ? target->codegenAddress() : nullptr;
+    if (!address)
+    {
+      return nullptr;
+    }
+
+    return builder->CreateStore(expressionValue, address);
+  }
+};
+
+// array[index] = expression
+class ASTIndexAssignStatement : public ASTStatement
+{
+protected:
+  ASTIndexExpression *target;
+  ASTExpression *expression;
+
+public:
+  ASTIndexAssignStatement(ASTExpression *array, ASTExpression *index, ASTExpression *expression) : target(new ASTIndexExpression(array, index)),
+                                                                                                  expression(expression),
+                                                                                                  ASTStatement(ASTNode::ASTIndexAssignStatementID, "IndexAssignStatement"){};
+
+  void evaluateType() override
+  {
+    target->evaluateType();
+    expression->evaluateType();
+    expression = ASTCastExpression::convert(expression, target->getType());
+  }
+
+  ASTStatement *fold() override
+  {
+    target->fold();
+    expression = expression->fold();
+    return this;
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(target);
+    children.push_back(expression);
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override
+  {
+    llvm::Value *expressionValue = target->getType() ? expression->codegen() : nullptr;
+    if (!expressionValue)
+    {
+      return nullptr;
+    }
+
+    return target->codegenStore(expressionValue);
+  }
+};
+
+// object.method(args), a call with the object as this. It is direct unless
+// the method is virtual and the object is behind a pointer to a class that
+// is not final and has subclasses that override the method, then the
+// method is loaded from the table of the object.
+class ASTMethodCallExpression : public ASTExpression
+{
+protected:
+  ASTExpression *object;
+  Token token;
+  std::vector<ASTExpression *> args;
+  ClassType *classType;
+  ASTPrototype *method = nullptr;
+
+public:
+  ASTMethodCallExpression(ASTExpression *object, Token token, std::vector<ASTExpression *> args) : object(object),
+                                                                                                   token(token),
+                                                                                                   args(std::move(args)),
+                                                                                                   classType(GetClassType(object->getType())),
+                                                                                                   ASTExpression(ASTNode::ASTMethodCallExpressionID, "MethodCallExpression", token.value)
+  {
+    if (classType)
+    {
+      method = FindMethod(classType, token.value);
+      MarkObjectInMemory(object);
+    }
+
+    if (method)
+    {
+      setType(method->getReturnType());
+    }
+  };
+
+  bool isVirtualCall()
+  {
+    return object->getType()->isPointerTy() && classType->getVirtualMethodIndex(token.value) >= 0 && !classType->isFinal() && IsOverridden(classType, token.value);
+  }
+
+  void evaluateType() override
+  {
+    object->evaluateType();
+    for (int i = 0; i < args.size(); i++)
+    {
+      args[i]->evaluateType();
+      if (method && i + 1 < method->getNumArgs())
+      {
+        args[i] = ASTCastExpression::convert(args[i], method->getArg(i + 1)->getType());
+      }
+    }
+  }
+
+  ASTExpression *fold() override
+  {
+    object = object->fold();
+    for (int i = 0; i < args.size(); i++)
+    {
+      args[i] = args[i]->fold();
+    }
+
+    return this;
+  }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTExpression::hash(hasher);
+    if (classType)
+    {
+      HashClass(hasher, classType);
+    }
+    UpdateHash(hasher, method ? method->getName() : "");
+    if (method)
+    {
+      method->hashDeclaration(hasher);
+    }
+    UpdateHash(hasher, method && isVirtualCall() ? "virtual" : "direct");
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(object);
+    children.insert(children.end(), args.begin(), args.end());
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override
+  {
+    if (!method || args.size() + 1 != method->getNumArgs())
+    {
+      return nullptr;
+    }
+
+    // A value that is not in memory is copied for the call. An element of
+    // the struct-of-arrays layout is gathered into the copy and scattered
+    // back after the call.
+    ASTIndexExpression *element = object->getASTNodeID() == ASTNode::ASTIndexExpressionID && static_cast<ASTIndexExpression *>(object)->isSoA() ? static_cast<ASTIndexExpression *>(object) : nullptr;
+    llvm::Value *arrayAddress = nullptr, *indexValue = nullptr;
+    llvm::AllocaInst *elementCopy = nullptr;
+    llvm::Value *objectAddress = nullptr;
+    if (element)
+    {
+      if (!element->codegenSoAElement(arrayAddress, indexValue))
+      {
+        return nullptr;
+      }
+
+      llvm::Value *elementValue = CodegenArrayElement(element->getArrayType(), arrayAddress, indexValue, "element");
+      elementCopy = CreateEntryBlockAlloca(builder->GetInsertBlock()->getParent(), elementValue->getType(), "element_tmp");
+      builder->CreateStore(elementValue, elementCopy);
+      objectAddress = elementCopy;
+    }
+    else
+    {
+      objectAddress = CodegenObjectAddress(object);
+    }
+
+    if (!objectAddress)
+    {
+      llvm::Value *objectValue = object->codegen();
+      if (!objectValue)
+      {
+        return nullptr;
+      }
+
+      llvm::AllocaInst *copy = CreateEntryBlockAlloca(builder->GetInsertBlock()->getParent(), objectValue->getType(), "object_tmp");
+      builder->CreateStore(objectValue, copy);
+      objectAddress = copy;
+    }
+
+    std::vector<llvm::Value *> argValues = {builder->CreatePointerCast(objectAddress, llvm::PointerType::get(*context, 0))};
+    for (int i = 0; i < args.size(); i++)
+    {
+      llvm::Value *argValue = args[i]->codegen();
+      if (!argValue)
+      {
+        return nullptr;
+      }
+
+      argValues.push_back(argValue);
+    }
+
+    llvm::Function *function = method->codegen();
+    llvm::FunctionCallee callee = function;
+    if (isVirtualCall())
+    {
+      // The table of a class never changes, loads of its slots can be
+      // hoisted and merged.
+      llvm::PointerType *ptrTy = llvm::PointerType::get(*context, 0);
+      llvm::Value *table = builder->CreateLoad(ptrTy, objectAddress, "vtable");
+      llvm::Value *slot = builder->CreateConstInBoundsGEP1_32(ptrTy, table, classType->getVirtualMethodIndex(token.value), token.value + "_slot");
+      llvm::LoadInst *methodValue = builder->CreateLoad(ptrTy, slot, token.value + "_method");
+      methodValue->setMetadata(llvm::LLVMContext::MD_invariant_load, llvm::MDNode::get(*context, {}));
+      callee = llvm::FunctionCallee(function->getFunctionType(), methodValue);
+    }
+
+    llvm::CallInst *call = function->getReturnType()->isVoidTy() ? builder->CreateCall(callee, argValues)
+                                                                  : builder->CreateCall(callee, argValues, "call_tmp");
+    call->setCallingConv(function->getCallingConv());
+    if (element)
+    {
+      CodegenArrayElementStore(element->getArrayType(), arrayAddress, indexValue, builder->CreateLoad(elementCopy->getAllocatedType(), elementCopy));
+    }
+
+    return call;
+  }
+};
+
+// name = Class(args), declares an object in the current block and
+// constructs it in place. Objects are values in the frame of the function
+// that the optimiser breaks up into registers. The constructors are
+// inlined where the object is declared, see ConstructObject, the
+// destructors where the block is left, see ASTBlock::destroyObjects.
+class ASTObjectStatement : public ASTVariableStatement
+{
+protected:
+  ClassType *classType;
+  std::vector<ASTExpression *> args;
+  ASTPrototype *constructor;
+
+public:
+  ASTObjectStatement(Token token, ClassType *classType, std::vector<ASTExpression *> args = {}) : classType(classType),
+                                                                                                  args(std::move(args)),
+                                                                                                  constructor(FindMethod(classType, "constructor")),
+                                                                                                  ASTVariableStatement(token, classType, ASTNode::ASTObjectStatementID, "ObjectStatement")
+  {
+    markAddressTaken();
+    globalBlockStack->getCurrentBlock()->newNamedVariable(this);
+  };
+
+  void evaluateType() override
+  {
+    CheckConstructors(classType);
+    for (int i = 0; i < args.size(); i++)
+    {
+      args[i]->evaluateType();
+      if (constructor && i + 1 < constructor->getNumArgs())
+      {
+        args[i] = ASTCastExpression::convert(args[i], constructor->getArg(i + 1)->getType());
+      }
+    }
+  }
+
+  ASTStatement *fold() override
+  {
+    for (int i = 0; i < args.size(); i++)
+    {
+      args[i] = args[i]->fold();
+    }
+
+    return this;
+  }
+
+  bool interpret(ComptimeInterpreter &interpreter) override { return false; }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTVariableStatement::hash(hasher);
+    HashClass(hasher, classType);
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    return std::vector<ASTNode *>(args.begin(), args.end());
+  }
+
+  llvm::Value *codegen() override
+  {
+    if (constructor ? args.size() + 1 != constructor->getNumArgs() : !args.empty())
+    {
+      return nullptr;
+    }
+
+    std::vector<llvm::Value *> argValues;
+    for (int i = 0; i < args.size(); i++)
+    {
+      llvm::Value *argValue = args[i]->codegen();
+      if (!argValue)
+      {
+        return nullptr;
+      }
+
+      argValues.push_back(argValue);
+    }
+
+    builder->CreateLifetimeStart(allocate());
+    builder->CreateStore(GetInitialObject(classType), allocate());
+    ConstructObject(classType, getAddress(), argValues);
+
+    globalBlockStack->getCurrentBlock()->addObject(this);
+    return allocate();
+  }
+};
+
+// new Class(args) constructs an object on the heap, new value copies a value
+// there and new Type allocates zeros of a type, for arrays too large for
+// the stack. All give a pointer to it, which lives until it is deleted.
+// Allocations that do not outlive their function are moved to its frame,
+// see StackPromotionPass.
+class ASTNewExpression : public ASTExpression
+{
+protected:
+  ClassType *classType = nullptr;
+  std::vector<ASTExpression *> args;
+  ASTPrototype *constructor = nullptr;
+  ASTExpression *value = nullptr;
+
+public:
+  ASTNewExpression(ClassType *classType, std::vector<ASTExpression *> args = {}) : classType(classType),
+                                                                                   args(std::move(args)),
+                                                                                   constructor(FindMethod(classType, "constructor")),
+                                                                                   ASTExpression(Type::getPointerTy(classType, 0), ASTNode::ASTNewExpressionID, "NewExpression", classType->getName()){};
+
+  ASTNewExpression(Type *type) : ASTExpression(Type::getPointerTy(type, 0), ASTNode::ASTNewExpressionID, "NewExpression", type->getManglingName()){};
+
+  ASTNewExpression(ASTExpression *value) : value(value),
+                                           ASTExpression(ASTNode::ASTNewExpressionID, "NewExpression")
+  {
+    if (value->getType())
+    {
+      setType(Type::getPointerTy(value->getType(), 0));
+    }
+  };
+
+  void evaluateType() override
+  {
+    if (value)
+    {
+      value->evaluateType();
+      if (value->getType())
+      {
+        setType(Type::getPointerTy(value->getType(), 0));
+      }
+    }
+
+    if (classType)
+    {
+      CheckConstructors(classType);
+    }
+
+    for (int i = 0; i < args.size(); i++)
+    {
+      args[i]->evaluateType();
+      if (constructor && i + 1 < constructor->getNumArgs())
+      {
+        args[i] = ASTCastExpression::convert(args[i], constructor->getArg(i + 1)->getType());
+      }
+    }
+  }
+
+  ASTExpression *fold() override
+  {
+    if (value)
+    {
+      value = value->fold();
+    }
+
+    for (int i = 0; i < args.size(); i++)
+    {
+      args[i] = args[i]->fold();
+    }
+
+    return this;
+  }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTExpression::hash(hasher);
+    if (classType)
+    {
+      HashClass(hasher, classType);
+    }
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children(args.begin(), args.end());
+    if (value)
+    {
+      children.push_back(value);
+    }
+
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override
+  {
+    if (!getType() || (classType && (constructor ? args.size() + 1 != constructor->getNumArgs() : !args.empty())))
+    {
+      return nullptr;
+    }
+
+    std::vector<llvm::Value *> argValues;
+    for (int i = 0; i < args.size(); i++)
+    {
+      llvm::Value *argValue = args[i]->codegen();
+      if (!argValue)
+      {
+        return nullptr;
+      }
+
+      argValues.push_back(argValue);
+    }
+
+    llvm::Type *allocatedTy = getType()->getElementTy()->getLLVMTy();
+    uint64_t size = module->getDataLayout().getTypeAllocSize(allocatedTy);
+    if (!classType && !value)
+    {
+      if (!IsZeroValid(getType()->getElementTy()))
+      {
+        return nullptr;
+      }
+
+      llvm::FunctionCallee allocateZeros = module->getOrInsertFunction("calloc", llvm::PointerType::get(*context, 0), builder->getInt64Ty(), builder->getInt64Ty());
+      return builder->CreateCall(allocateZeros, {builder->getInt64(1), builder->getInt64(size)}, "new");
+    }
+
+    llvm::Value *initialValue = classType ? GetInitialObject(classType) : value->codegen();
+    if (!initialValue)
+    {
+      return nullptr;
+    }
+
+    llvm::FunctionCallee allocate = module->getOrInsertFunction("malloc", llvm::PointerType::get(*context, 0), builder->getInt64Ty());
+    llvm::Value *object = builder->CreateCall(allocate, {builder->getInt64(size)}, "new");
+    builder->CreateStore(initialValue, object);
+    if (classType)
+    {
+      ConstructObject(classType, object, argValues);
+    }
+
+    return object;
+  }
+};
+
+// delete pointer, destroys what new allocated and frees its memory.
+class ASTDeleteStatement : public ASTStatement
+{
+protected:
+  ASTExpression *pointer;
+
+public:
+  ASTDeleteStatement(ASTExpression *pointer) : pointer(pointer),
+                                               ASTStatement(ASTNode::ASTDeleteStatementID, "DeleteStatement"){};
+
+  void evaluateType() override
+  {
+    pointer->evaluateType();
+  }
+
+  ASTStatement *fold() override
+  {
+    pointer = pointer->fold();
+    return this;
+  }
+
+  void hash(llvm::SHA1 &hasher) override
+  {
+    ASTStatement::hash(hasher);
+    ClassType *classType = GetClassType(pointer->getType());
+    if (classType)
+    {
+      HashClass(hasher, classType);
+    }
+  }
+
+  std::vector<ASTNode *> getChildrenShow() override
+  {
+    std::vector<ASTNode *> children;
+    children.push_back(pointer);
+    return std::move(children);
+  }
+
+  llvm::Value *codegen() override
+  {
+    llvm::Value *pointerValue = pointer->getType() && pointer->getType()->isPointerTy() ? pointer->codegen() : nullptr;
+    if (!pointerValue)
+    {
+      return nullptr;
+    }
+
+    ClassType *classType = GetClassType(pointer->getType());
+    if (classType)
+    {
+      DestroyObject(classType, pointerValue);
+    }
+
+    llvm::FunctionCallee free = module->getOrInsertFunction("free", builder->getVoidTy(), llvm::PointerType::get(*context, 0));
+    return builder->CreateCall(free, {pointerValue});
+  }
+};
+
+// Collects the calls of an expression a return does not return directly.
+void FindCalls(ASTNode *root, std::vector<ASTCallExpression *> &calls)
+{
+  std::vector<ASTNode *> stack = {root};
+  while (!stack.empty())
+  {
+    ASTNode *node = stack.back();
+    stack.pop_back();
+    if (node->getASTNodeID() == ASTNode::ASTCallExpressionID)
+    {
+      calls.push_back(static_cast<ASTCallExpression *>(node));
+    }
+
+    std::vector<ASTNode *> children = node->getChildrenShow();
+    stack.insert(stack.end(), children.begin(), children.end());
+  }
+}
+
+// A returned call is a tail call. A call of the function itself becomes a
+// jump back to its start. Any other call is marked musttail when the
+// backend can always reuse the frame, that is when both functions have the
+// same type and calling convention, and tail otherwise, which leaves it to
+// the backend. Variables in memory live in the frame, with one of them the
+// call is not marked at all, and a call that objects of the function are
+// destroyed after is no tail call.
+llvm::Value *ASTReturnStatement::codegen()
+{
+  llvm::Function *function = builder->GetInsertBlock()->getParent();
+  if (!expression)
+  {
+    DestroyFunctionObjects();
+    return builder->CreateRetVoid();
+  }
+
+  if (expression->getASTNodeID() != ASTNode::ASTCallExpressionID || HasFunctionObjectsToDestroy())
+  {
+    std::vector<ASTCallExpression *> calls;
+    if (globalReportTailCalls)
+    {
+      FindCalls(expression, calls);
+    }
+
+    for (int i = 0; i < calls.size(); i++)
+    {
+      bool isConverted = expression->getASTNodeID() == ASTNode::ASTCastExpressionID && static_cast<ASTCastExpression *>(expression)->getOperand() == calls[i];
+      ReportTailCall(function, calls[i]->getName(), calls[i] == expression ? "not eliminated, objects are destroyed after it"
+                                                    : isConverted         ? "not eliminated, the result is converted"
+                                                                          : "not eliminated, the result is used");
+    }
+
+    llvm::Value *expressionValue = expression->codegen();
+    if (!expressionValue)
+    {
+      return nullptr;
+    }
+
+    DestroyFunctionObjects();
+    return builder->CreateRet(expressionValue);
+  }
+
+  ASTCallExpression *call = static_cast<ASTCallExpression *>(expression);
+  ASTPrototype *callee = call->getPrototype();
+  if (callee && globalTailRecurseBlock && globalTailRecurseBlock->getParent() == function && callee->getName() == function->getName())
+  {
+    std::vector<llvm::Value *> argValues;
+    if (!call->codegenArgs(argValues) || argValues.size() != callee->getNumArgs())
+    {
+      return nullptr;
+    }
+
+    // All arguments are evaluated before any of them is redefined.
+    for (int i = 0; i < argValues.size(); i++)
+    {
+      callee->getArg(i)->define(argValues[i]);
+    }
+
+    ReportTailCall(function, callee->getName(), "lowered to a loop");
+    return builder->CreateBr(globalTailRecurseBlock);
+  }
+
+  llvm::CallInst *callValue = llvm::dyn_cast_or_null<llvm::CallInst>(call->codegen());
+  if (!callValue)
+  {
+    return nullptr;
+  }
+
+  llvm::Function *calledFunction = callValue->getCalledFunction();
+  bool hasFrameVariables = llvm::any_of(function->getEntryBlock(), [](llvm::Instruction &instruction)
+                                        { return llvm::isa<llvm::AllocaInst>(instruction); });
+  if (hasFrameVariables)
+  {
+    ReportTailCall(function, call->getName(), "not eliminated, the caller has variables in memory");
+  }
+  else if (calledFunction->getFunctionType() == function->getFunctionType() && calledFunction->getCallingConv() == function->getCallingConv())
+  {
+    callValue->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    ReportTailCall(function, call->getName(), "musttail");
+  }
+  else
+  {
+    callValue->setTailCallKind(llvm::CallInst::TCK_Tail);
+    ReportTailCall(function, call->getName(), "tail, left to the backend");
+  }
+
+  if (callValue->getType()->isVoidTy())
+  {
+    return builder->CreateRetVoid();
+  }
+
+  return builder->CreateRet(callValue);
+}
+
+class ASTDumper
+{
+public:
+  enum class Format
+  {
+    Text,
+    JSON,
+    Binary,
+  };
+
+private:
+  struct Frame
+  {
+    ASTNode *node;
+    unsigned depth;
+    bool isFirst;
+    bool isLast;
+  };
+
+  static const size_t BufferSize = 1 << 16;
+
+  FILE *output;
+  Format format;
+  bool useColour;
+  std::vector<char> buffer;
+  std::map<std::string, uint64_t> kindIndexes;
+
+  void flush()
+  {
+    fwrite(buffer.data(), 1, buffer.size(), output);
+    buffer.clear();
+  }
+
+  void write(const char *data, size_t length)
+  {
+    if (buffer.size() + length > BufferSize)
+    {
+      flush();
+    }
+
+    if (length > BufferSize)
+    {
+      fwrite(data, 1, length, output);
+      return;
+    }
+
+    buffer.insert(buffer.end(), data, data + length);
+  }
+
+  void write(const std::string &str) { write(str.data(), str.size()); }
+
+  void write(char c)
+  {
+    if (buffer.size() == BufferSize)
+    {
+      flush();
+    }
+
+    buffer.push_back(c);
+  }
+
+  void writeVarInt(uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      write((char)((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+
+    write((char)value);
+  }
+
+  void writeJSONString(const std::string &str)
+  {
+    static const char *hex = "0123456789abcdef";
+
+    write('"');
+    for (unsigned char c : str)
+    {
+      switch (c)
+      {
+      case '"':
+        write("\\\"", 2);
+        break;
+      case '\\':
+        write("\\\\", 2);
+        break;
+      case '\n':
+        write("\\n", 2);
+        break;
+      case '\t':
+        write("\\t", 2);
+        break;
+      default:
+        if (c < 0x20)
+        {
+          char escaped[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+          write(escaped, sizeof(escaped));
+        }
+        else
+        {
+          write((char)c);
+        }
+      }
+    }
+    write('"');
+  }
+
+  // Children are pushed in reverse so they are popped, and written, in order.
+  void pushChildren(std::vector<Frame> &stack, ASTNode *node, unsigned depth)
+  {
+    std::vector<ASTNode *> children = node->getChildrenShow();
+    for (int i = children.size() - 1; i >= 0; i--)
+    {
+      if (children[i])
+      {
+        stack.push_back({children[i], depth, i == 0, i == children.size() - 1});
+      }
+    }
+  }
+
+  void dumpText(ASTNode *root)
+  {
+    // └── : ├── : │
+    // Every level adds exactly three characters to the indent, so a node at
+    // depth n only has to cut the shared indent back to n * 3 characters.
+    std::string indent;
+    std::vector<Frame> stack;
+    stack.push_back({root, 0, true, true});
+
+    while (!stack.empty())
+    {
+      Frame frame = stack.back();
+      stack.pop_back();
+
+      indent.resize(frame.depth * 3);
+      write(useColour ? "\033[0;91;1m" : "");
+      write(indent);
+      write(frame.isLast ? "|- " : "+ ");
+      write(frame.node->showKind);
+      write(useColour ? "\033[0;92;1m " : " ");
+      write(frame.node->showValue);
+      write(useColour ? "\033[0m\n" : "\n");
+
+      indent += frame.isLast ? "   " : "|  ";
+      pushChildren(stack, frame.node, frame.depth + 1);
+    }
+  }
+
+  void dumpJSON(ASTNode *root)
+  {
+    unsigned openNodes = 0;
+    std::vector<Frame> stack;
+    stack.push_back({root, 0, true, true});
+
+    while (!stack.empty())
+    {
+      Frame frame = stack.back();
+      stack.pop_back();
+
+      for (; openNodes > frame.depth; openNodes--)
+      {
+        write("]}", 2);
+      }
+
+      if (!frame.isFirst)
+      {
+        write(',');
+      }
+
+      write("{\"kind\":", 8);
+      writeJSONString(frame.node->showKind);
+      write(",\"value\":", 9);
+      writeJSONString(frame.node->showValue);
+      write(",\"children\":[", 13);
+      openNodes++;
+
+      pushChildren(stack, frame.node, frame.depth + 1);
+    }
+
+    for (; openNodes > 0; openNodes--)
+    {
+      write("]}", 2);
+    }
+    write('\n');
+  }
+
+  // Nodes are written in preorder as (kind, value, number of children). A kind
+  // is written as its index in the table of already seen kinds, and a new
+  // kind is introduced by the next free index followed by its name.
+  void dumpBinary(ASTNode *root)
+  {
+    write("GFAST\x01", 6);
+
+    std::vector<ASTNode *> stack;
+    stack.push_back(root);
+
+    while (!stack.empty())
+    {
+      ASTNode *node = stack.back();
+      stack.pop_back();
+
+      auto found = kindIndexes.find(node->showKind);
+      if (found != kindIndexes.end())
+      {
+        writeVarInt(found->second);
+      }
+      else
+      {
+        uint64_t index = kindIndexes.size();
+        kindIndexes[node->showKind] = index;
+        writeVarInt(index);
+        writeVarInt(node->showKind.size());
+        write(node->showKind);
+      }
+
+      writeVarInt(node->showValue.size());
+      write(node->showValue);
+
+      std::vector<ASTNode *> children = node->getChildrenShow();
+      uint64_t numOfChildren = 0;
+      for (int i = children.size() - 1; i >= 0; i--)
+      {
+        if (children[i])
+        {
+          stack.push_back(children[i]);
+          numOfChildren++;
+        }
+      }
+      writeVarInt(numOfChildren);
+    }
+  }
+
+public:
+  ASTDumper(FILE *output = stdout, Format format = Format::Text) : output(output),
+                                                                   format(format),
+                                                                   useColour(format == Format::Text && isatty(fileno(output)))
+  {
+    buffer.reserve(BufferSize);
+  };
+
+  void dump(ASTNode *root)
+  {
+    if (root != nullptr)
+    {
+      switch (format)
+      {
+      case Format::Text:
+        dumpText(root);
+        break;
+      case Format::JSON:
+        dumpJSON(root);
+        break;
+      case Format::Binary:
+        dumpBinary(root);
+        break;
+      }
+    }
+
+    flush();
+    fflush(output);
+  }
+};
+
+void PrettyPrint(ASTNode *node, ASTDumper::Format format = ASTDumper::Format::Text)
+{
+  ASTDumper(stdout, format).dump(node);
+}
+
+// Counts the nodes of a tree, it is the estimate of how long the tree takes
+// to generate and optimise.
+size_t CountNodes(ASTNode *root)
+{
+  size_t count = 0;
+  std::vector<ASTNode *> stack = {root};
+  while (!stack.empty())
+  {
+    ASTNode *node = stack.back();
+    stack.pop_back();
+    count++;
+
+    std::vector<ASTNode *> children = node->getChildrenShow();
+    stack.insert(stack.end(), children.begin(), children.end());
+  }
+
+  return count;
+}
+
+struct CodegenPartition
+{
+  std::vector<ASTFunction *> functions;
+  size_t cost = 0;
+  std::string bitcode;
+  std::string objectPath;
+  bool isFailed = false;
+};
+
+// Spreads the functions over the partitions largest first, each one goes to
+// the partition with the least work so far.
+std::vector<CodegenPartition> PartitionFunctions(std::vector<ASTFunction *> functions, unsigned numOfPartitions)
+{
+  std::vector<std::pair<size_t, ASTFunction *>> costs;
+  for (int i = 0; i < functions.size(); i++)
+  {
+    costs.push_back({CountNodes(functions[i]), functions[i]});
+  }
+
+  std::stable_sort(costs.begin(), costs.end(), [](const std::pair<size_t, ASTFunction *> &a, const std::pair<size_t, ASTFunction *> &b)
+                   { return a.first > b.first; });
+
+  std::vector<CodegenPartition> partitions(std::min<size_t>(numOfPartitions, functions.size()));
+  for (int i = 0; i < costs.size(); i++)
+  {
+    CodegenPartition *lightest = &partitions[0];
+    for (int j = 1; j < partitions.size(); j++)
+    {
+      if (partitions[j].cost < lightest->cost)
+      {
+        lightest = &partitions[j];
+      }
+    }
+
+    lightest->functions.push_back(costs[i].second);
+    lightest->cost += costs[i].first;
+  }
+
+  return partitions;
+}
+
+// How the workers generate and optimise the partitions.
+struct CodegenOptions
+{
+  llvm::OptimizationLevel level = llvm::OptimizationLevel::O0;
+  bool isThinLTO = false;
+  FunctionCache *cache = nullptr;
+  std::string cacheFlags;
+};
+
+// Generates every function in a module of its own, optimises it on its own
+// and links it into the module of the thread. Functions found in the cache
+// are read back instead, the others are added to it.
+bool CodegenCachedFunctions(std::vector<ASTFunction *> &functions,
+                            llvm::TargetMachine *targetMachine,
+                            const CodegenOptions &options)
+{
+  std::unique_ptr<llvm::Module> partitionModule = std::move(module);
+  llvm::Linker linker(*partitionModule);
+  for (int i = 0; i < functions.size(); i++)
+  {
+    std::string key = functions[i]->getCacheKey(options.cacheFlags);
+    std::unique_ptr<llvm::Module> functionModule;
+    if (std::unique_ptr<llvm::MemoryBuffer> bitcode = options.cache->load(key))
+    {
+      llvm::Expected<std::unique_ptr<llvm::Module>> cachedModule = llvm::parseBitcodeFile(bitcode->getMemBufferRef(), *context);
+      if (cachedModule)
+      {
+        functionModule = std::move(*cachedModule);
+      }
+      else
+      {
+        llvm::consumeError(cachedModule.takeError());
+      }
+    }
+
+    if (!functionModule)
+    {
+      module.reset(new llvm::Module(functions[i]->getName(), *context));
+      module->setTargetTriple(partitionModule->getTargetTriple());
+      module->setDataLayout(partitionModule->getDataLayout());
+      if (globalProfileData)
+      {
+        globalProfileData->annotateModule(module.get());
+      }
+      functions[i]->codegen();
+      if (globalHasErrors || llvm::verifyModule(*module, &llvm::errs()))
+      {
+        module = std::move(partitionModule);
+        return false;
+      }
+
+      OptimizeModule(module.get(), options.level, targetMachine, options.isThinLTO);
+
+      std::string bitcode;
+      llvm::raw_string_ostream output(bitcode);
+      llvm::WriteBitcodeToFile(*module, output);
+      output.flush();
+      options.cache->store(key, bitcode);
+      functionModule = std::move(module);
+    }
+
+    if (linker.linkInModule(std::move(functionModule)))
+    {
+      module = std::move(partitionModule);
+      return false;
+    }
+  }
+
+  module = std::move(partitionModule);
+  return true;
+}
+
+// Generates and optimises every partition on its own thread. The context,
+// builder and module are thread local, so each worker starts with an empty
+// module of its own. A partition either keeps its module as bitcode, to be
+// linked by the caller or to be an input of the thin link, or is emitted
+// straight to its object file.
+std::vector<std::thread> CodegenPartitions(std::vector<CodegenPartition> &partitions,
+                                           std::vector<std::unique_ptr<llvm::TargetMachine>> &targetMachines,
+                                           const CodegenOptions &options)
+{
+  std::vector<std::thread> workers;
+  for (int i = 0; i < partitions.size(); i++)
+  {
+    CodegenPartition *partition = &partitions[i];
+    llvm::TargetMachine *targetMachine = targetMachines[i].get();
+    workers.emplace_back([partition, targetMachine, i, &options]()
+                         {
+      EnableLoopRemarks(*context);
+      module->setModuleIdentifier("main.gc.part" + std::to_string(i));
+      module->setTargetTriple(targetMachine->getTargetTriple().str());
+      module->setDataLayout(targetMachine->createDataLayout());
+      if (globalProfileData)
+      {
+        globalProfileData->annotateModule(module.get());
+      }
+
+      if (options.cache)
+      {
+        if (!CodegenCachedFunctions(partition->functions, targetMachine, options))
+        {
+          partition->isFailed = true;
+          return;
+        }
+      }
+      else
+      {
+        for (int j = 0; j < partition->functions.size(); j++)
+        {
+          partition->functions[j]->codegen();
+        }
+
+        if (llvm::verifyModule(*module, &llvm::errs()))
+        {
+          partition->isFailed = true;
+          return;
+        }
+
+        OptimizeModule(module.get(), options.level, targetMachine, options.isThinLTO);
+      }
+
+      if (options.isThinLTO)
+      {
+        partition->bitcode = WriteThinLTOBitcode(module.get());
+        return;
+      }
+
+      if (!partition->objectPath.empty())
+      {
+        partition->isFailed = !EmitObjectFile(module.get(), targetMachine, partition->objectPath);
+        return;
+      }
+
+      llvm::raw_string_ostream output(partition->bitcode);
+      llvm::WriteBitcodeToFile(*module, output);
+      output.flush(); });
+  }
+
+  return workers;
+}
+
+// Moves the partitions into the module of the calling thread.
+bool LinkPartitions(std::vector<CodegenPartition> &partitions)
+{
+  for (int i = 0; i < partitions.size(); i++)
+  {
+    llvm::Expected<std::unique_ptr<llvm::Module>> partitionModule = llvm::parseBitcodeFile(llvm::MemoryBufferRef(partitions[i].bitcode, "main.gc.part" + std::to_string(i)), *context);
+    if (!partitionModule)
+    {
+      llvm::errs() << llvm::toString(partitionModule.takeError()) << "\n";
+      return false;
+    }
+
+    if (llvm::Linker::linkModules(*module, std::move(*partitionModule)))
+    {
+      return false;
+    }
+
+    partitions[i].bitcode.clear();
+  }
+
+  return true;
+}
+
+// Once the partitions are linked every function of the program is defined
+// in the module, the hidden ones become internal as if the module had been
+// generated at once.
+void InternalizeFunctions(llvm::Module *module)
+{
+  for (llvm::Function &function : *module)
+  {
+    if (!function.isDeclaration() && function.hasHiddenVisibility())
+    {
+      function.setLinkage(llvm::GlobalValue::InternalLinkage);
+      function.setVisibility(llvm::GlobalValue::DefaultVisibility);
+    }
+  }
+}
+
+// A program that spends its time in branches, used to measure profile
+// guided optimisation (benchmarks/pgo.sh). The rare branch calls the
+// expensive function, the common one a cheap one. mix is too large to be
+// inlined without a profile, with one its call site is hot enough.
+//
+// fn collatz(n: int64): int64 {
+//   steps: int64 = 0
+//   while (n != 1) {
+//     if (n % 2 == 0) { n = n / 2 } else { n = 3 * n + 1 }
+//     steps = steps + 1
+//   }
+//   return steps
+// }
+// fn mix(x: int64): int64 {
+//   x = (x * 31 + 7) % 1000003   // 24 times
+//   if (x % 3 == 0 || x % 5 == 0) { return x % 7 }
+//   return x % 11
+// }
+// total: int64 = 0
+// i: int64 = 1
+// while (i < 10000000) {
+//   if (i % 4096 == 0) { total = total + collatz(i) } else { total = total + mix(i) }
+//   i = i + 1
+// }
+// int32(total % 128)
+ASTExpression *SampleIdentifier(const char *name)
+{
+  return new ASTIdentifierExpression(Token(name, Token::Type::IDENTIFIER));
+}
+
+ASTExpression *SampleNumber(const char *value)
+{
+  return new ASIntTNumberExpression(Token(value, Token::Type::LITERAL_INT));
+}
+
+ASTExpression *SampleBinary(const char *op, Token::Type type, ASTExpression *left, ASTExpression *right)
+{
+  return new ASTBinaryExpression(Token(op, type), left, right);
+}
+
+ASTBlock *SampleBlock(const char *kind)
+{
+  ASTBlock *block(new ASTBlock(kind));
+  globalBlockStack->pushBlock(block);
+  return block;
+}
+
+// A block whose statements build adds, closed again afterwards.
+ASTBlock *SampleBody(const char *kind, std::function<void(ASTBlock *)> build)
+{
+  ASTBlock *block = SampleBlock(kind);
+  build(block);
+  globalBlockStack->popBlock();
+  return block;
+}
+
+ASTVariableStatement *SampleVariable(const char *name, Type *type)
+{
+  return new ASTVariableStatement(Token(name, Token::Type::IDENTIFIER), type);
+}
+
+// name = value, declares the variable when it has a type.
+ASTStatement *SampleAssign(const char *name, ASTExpression *value, Type *type = nullptr)
+{
+  return new ASTAssignVariableStatement(value, Token(name, Token::Type::IDENTIFIER), type);
+}
+
+ASTExpression *SampleCall(const char *name, std::vector<ASTExpression *> args)
+{
+  return new ASTCallExpression(Token(name, Token::Type::IDENTIFIER), std::move(args));
+}
+
+// for name in start..end or, without an end, for name of start. The
+// variable is declared in the body before build adds the statements.
+ASTStatement *SampleFor(const char *name, Type *type, ASTExpression *start, ASTExpression *end, std::function<void(ASTBlock *)> build)
+{
+  ASTVariableStatement *variable = SampleVariable(name, type);
+  ASTBlock *block = SampleBlock("ForBlock");
+  block->newNamedVariable(variable);
+  build(block);
+  globalBlockStack->popBlock();
+  return end ? new ASTForStatement(variable, start, end, block) : new ASTForStatement(variable, start, block);
+}
+
+ASTFunction *SampleFunction(const char *name,
+                            std::vector<ASTVariableStatement *> args,
+                            Type *returnType,
+                            FunctionAttributes attributes,
+                            std::function<void(ASTBlock *)> build)
+{
+  ASTBlock *block = SampleBlock("FunctionBlock");
+  ASTPrototype *prototype(new ASTPrototype(Token(name, Token::Type::IDENTIFIER), std::move(args), returnType, attributes));
+  prototype->declareArgs(block);
+  build(block);
+  globalBlockStack->popBlock();
+  return new ASTFunction(prototype, block);
+}
+
+// A method of the class, see DeclareMethod.
+ASTFunction *SampleMethod(ClassType *classType,
+                          const char *name,
+                          std::vector<ASTVariableStatement *> args,
+                          Type *returnType,
+                          bool isVirtual,
+                          std::function<void(ASTBlock *)> build)
+{
+  ASTBlock *block = SampleBlock("FunctionBlock");
+  ASTPrototype *prototype = DeclareMethod(classType, Token(name, Token::Type::IDENTIFIER), std::move(args), returnType, FunctionAttributes(), isVirtual);
+  prototype->declareArgs(block);
+  build(block);
+  globalBlockStack->popBlock();
+  return new ASTFunction(prototype, block);
+}
+
+void BuildBranchySample(ASTBlock *program)
+{
+  Type *int64Ty = Type::getInteger64Ty();
+
+  ASTBlock *collatzBlock = SampleBlock("FunctionBlock");
+  ASTPrototype *collatz(new ASTPrototype(Token("collatz", Token::Type::IDENTIFIER), {new ASTVariableStatement(Token("n", Token::Type::IDENTIFIER), int64Ty)}, int64Ty));
+  collatz->declareArgs(collatzBlock);
+  collatzBlock->pushStatement(new ASTAssignVariableStatement(SampleNumber("0"), Token("steps", Token::Type::IDENTIFIER), int64Ty));
+  ASTBlock *loopBlock = SampleBlock("WhileBlock");
+  ASTBlock *evenBlock = SampleBlock("ThenBlock");
+  evenBlock->pushStatement(new ASTAssignVariableStatement(SampleBinary("/", Token::Type::BACKSLASH, SampleIdentifier("n"), SampleNumber("2")), Token("n", Token::Type::IDENTIFIER)));
+  globalBlockStack->popBlock();
+  ASTBlock *oddBlock = SampleBlock("ElseBlock");
+  oddBlock->pushStatement(new ASTAssignVariableStatement(SampleBinary("+", Token::Type::PLUS, SampleBinary("*", Token::Type::ASTERISK, SampleNumber("3"), SampleIdentifier("n")), SampleNumber("1")), Token("n", Token::Type::IDENTIFIER)));
+  globalBlockStack->popBlock();
+  ASTExpression *isEven = SampleBinary("==", Token::Type::DOUBLE_EQUALS, SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("n"), SampleNumber("2")), SampleNumber("0"));
+  loopBlock->pushStatement(new ASTIfStatement(isEven, evenBlock, oddBlock));
+  loopBlock->pushStatement(new ASTAssignVariableStatement(SampleBinary("+", Token::Type::PLUS, SampleIdentifier("steps"), SampleNumber("1")), Token("steps", Token::Type::IDENTIFIER)));
+  globalBlockStack->popBlock();
+  collatzBlock->pushStatement(new ASTWhileStatement(SampleBinary("!=", Token::Type::EXCLAMATION_EQUALS, SampleIdentifier("n"), SampleNumber("1")), loopBlock));
+  collatzBlock->pushStatement(new ASTReturnStatement(SampleIdentifier("steps")));
+  globalBlockStack->popBlock();
+  program->pushStatement(new ASTFunction(collatz, collatzBlock));
+
+  ASTBlock *mixBlock = SampleBlock("FunctionBlock");
+  ASTPrototype *mix(new ASTPrototype(Token("mix", Token::Type::IDENTIFIER), {new ASTVariableStatement(Token("x", Token::Type::IDENTIFIER), int64Ty)}, int64Ty));
+  mix->declareArgs(mixBlock);
+  // Enough rounds that mix is too large to inline without a profile.
+  for (int i = 0; i < 24; i++)
+  {
+    ASTExpression *round = SampleBinary("+", Token::Type::PLUS, SampleBinary("*", Token::Type::ASTERISK, SampleIdentifier("x"), SampleNumber("31")), SampleNumber("7"));
+    mixBlock->pushStatement(new ASTAssignVariableStatement(SampleBinary("%", Token::Type::PERCENT, round, SampleNumber("1000003")), Token("x", Token::Type::IDENTIFIER)));
+  }
+  ASTBlock *multipleBlock = SampleBlock("ThenBlock");
+  multipleBlock->pushStatement(new ASTReturnStatement(SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("x"), SampleNumber("7"))));
+  globalBlockStack->popBlock();
+  ASTExpression *isMultiple = SampleBinary("||", Token::Type::DOUBLE_VBAR,
+                                           SampleBinary("==", Token::Type::DOUBLE_EQUALS, SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("x"), SampleNumber("3")), SampleNumber("0")),
+                                           SampleBinary("==", Token::Type::DOUBLE_EQUALS, SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("x"), SampleNumber("5")), SampleNumber("0")));
+  mixBlock->pushStatement(new ASTIfStatement(isMultiple, multipleBlock));
+  mixBlock->pushStatement(new ASTReturnStatement(SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("x"), SampleNumber("11"))));
+  globalBlockStack->popBlock();
+  program->pushStatement(new ASTFunction(mix, mixBlock));
+
+  program->pushStatement(new ASTAssignVariableStatement(SampleNumber("0"), Token("total", Token::Type::IDENTIFIER), int64Ty));
+  program->pushStatement(new ASTAssignVariableStatement(SampleNumber("1"), Token("i", Token::Type::IDENTIFIER), int64Ty));
+  ASTBlock *mainLoopBlock = SampleBlock("WhileBlock");
+  ASTBlock *rareBlock = SampleBlock("ThenBlock");
+  rareBlock->pushStatement(new ASTAssignVariableStatement(SampleBinary("+", Token::Type::PLUS, SampleIdentifier("total"), new ASTCallExpression(Token("collatz", Token::Type::IDENTIFIER), {SampleIdentifier("i")})), Token("total", Token::Type::IDENTIFIER)));
+  globalBlockStack->popBlock();
+  ASTBlock *commonBlock = SampleBlock("ElseBlock");
+  commonBlock->pushStatement(new ASTAssignVariableStatement(SampleBinary("+", Token::Type::PLUS, SampleIdentifier("total"), new ASTCallExpression(Token("mix", Token::Type::IDENTIFIER), {SampleIdentifier("i")})), Token("total", Token::Type::IDENTIFIER)));
+  globalBlockStack->popBlock();
+  ASTExpression *isRare = SampleBinary("==", Token::Type::DOUBLE_EQUALS, SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("i"), SampleNumber("4096")), SampleNumber("0"));
+  mainLoopBlock->pushStatement(new ASTIfStatement(isRare, rareBlock, commonBlock));
+  mainLoopBlock->pushStatement(new ASTAssignVariableStatement(SampleBinary("+", Token::Type::PLUS, SampleIdentifier("i"), SampleNumber("1")), Token("i", Token::Type::IDENTIFIER)));
+  globalBlockStack->popBlock();
+  program->pushStatement(new ASTWhileStatement(SampleBinary("<", Token::Type::LEFT_ANGULAR_BRACKET, SampleIdentifier("i"), SampleNumber("10000000")), mainLoopBlock));
+  program->pushStatement(new ASTCastExpression(SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("total"), SampleNumber("128")), Type::getInteger32Ty()));
+}
+
+// A program of many functions, used to measure the function cache
+// (benchmarks/cache.sh). Every function mixes its argument and calls the one
+// before it. The function exported, when there is one, is called with the C
+// calling convention instead of fastcc, which has to rebuild its caller.
+//
+// fn f0(x: int64): int64 { return x }
+// fn fi(x: int64): int64 {
+//   x = (x * 31 + i) % 1000003   // 8 times
+//   return f(i - 1)(x)
+// }
+// int32(f(count - 1)(1) % 128)
+void BuildFunctionsSample(ASTBlock *program, unsigned count, int exported = -1)
+{
+  Type *int64Ty = Type::getInteger64Ty();
+  for (unsigned i = 0; i < count; i++)
+  {
+    std::string name = "f" + std::to_string(i);
+    FunctionAttributes attributes;
+    attributes.isExported = i == exported;
+    ASTBlock *functionBlock = SampleBlock("FunctionBlock");
+    ASTPrototype *prototype(new ASTPrototype(Token(name, Token::Type::IDENTIFIER), {new ASTVariableStatement(Token("x", Token::Type::IDENTIFIER), int64Ty)}, int64Ty, attributes));
+    prototype->declareArgs(functionBlock);
+    if (i == 0)
+    {
+      functionBlock->pushStatement(new ASTReturnStatement(SampleIdentifier("x")));
+    }
+    else
+    {
+      std::string salt = std::to_string(i);
+      for (int j = 0; j < 8; j++)
+      {
+        ASTExpression *round = SampleBinary("+", Token::Type::PLUS, SampleBinary("*", Token::Type::ASTERISK, SampleIdentifier("x"), SampleNumber("31")), SampleNumber(salt.c_str()));
+        functionBlock->pushStatement(new ASTAssignVariableStatement(SampleBinary("%", Token::Type::PERCENT, round, SampleNumber("1000003")), Token("x", Token::Type::IDENTIFIER)));
+      }
+
+      std::string callee = "f" + std::to_string(i - 1);
+      functionBlock->pushStatement(new ASTReturnStatement(new ASTCallExpression(Token(callee, Token::Type::IDENTIFIER), {SampleIdentifier("x")})));
+    }
+
+    globalBlockStack->popBlock();
+    program->pushStatement(new ASTFunction(prototype, functionBlock));
+  }
+
+  std::string last = "f" + std::to_string(count - 1);
+  ASTExpression *result = new ASTCallExpression(Token(last, Token::Type::IDENTIFIER), {SampleNumber("1")});
+  program->pushStatement(new ASTCastExpression(SampleBinary("%", Token::Type::PERCENT, result, SampleNumber("128")), Type::getInteger32Ty()));
+}
+
+// Calls of const functions with literal arguments, see
+// ASTCallExpression::fold. fib is folded while compiling. spin runs more
+// steps and depth nests deeper than ComptimeInterpreter allows, so both are
+// left to run time with the same results (tests/samples.sh).
+//
+// const fn fib(n: int64): int64 { if (n < 2) { return n } return fib(n - 1) + fib(n - 2) }
+// const fn spin(n: int64): int64 {
+//   t: int64 = 0
+//   i: int64 = 0
+//   while (i < n) { t = (t + i) % 1000; i = i + 1 }
+//   return t
+// }
+// const fn depth(n: int64): int64 { if (n == 0) { return 0 } return depth(n - 1) + 1 }
+// int32((fib(20) + spin(5000003) + depth(1000)) % 256)   // 88
+void BuildComptimeSample(ASTBlock *program)
+{
+  Type *int64Ty = Type::getInteger64Ty();
+  FunctionAttributes constAttributes;
+  constAttributes.isConst = true;
+
+  program->pushStatement(SampleFunction("fib", {SampleVariable("n", int64Ty)}, int64Ty, constAttributes, [](ASTBlock *block)
+                                        {
+    ASTBlock *smallBlock = SampleBody("ThenBlock", [](ASTBlock *thenBlock)
+                                      { thenBlock->pushStatement(new ASTReturnStatement(SampleIdentifier("n"))); });
+    block->pushStatement(new ASTIfStatement(SampleBinary("<", Token::Type::LEFT_ANGULAR_BRACKET, SampleIdentifier("n"), SampleNumber("2")), smallBlock));
+    ASTExpression *previous = SampleCall("fib", {SampleBinary("-", Token::Type::HYPHEN, SampleIdentifier("n"), SampleNumber("1"))});
+    ASTExpression *beforePrevious = SampleCall("fib", {SampleBinary("-", Token::Type::HYPHEN, SampleIdentifier("n"), SampleNumber("2"))});
+    block->pushStatement(new ASTReturnStatement(SampleBinary("+", Token::Type::PLUS, previous, beforePrevious))); }));
+
+  program->pushStatement(SampleFunction("spin", {SampleVariable("n", int64Ty)}, int64Ty, constAttributes, [int64Ty](ASTBlock *block)
+                                        {
+    block->pushStatement(SampleAssign("t", SampleNumber("0"), int64Ty));
+    block->pushStatement(SampleAssign("i", SampleNumber("0"), int64Ty));
+    ASTBlock *loopBlock = SampleBody("WhileBlock", [](ASTBlock *whileBlock)
+                                     {
+      ASTExpression *sum = SampleBinary("+", Token::Type::PLUS, SampleIdentifier("t"), SampleIdentifier("i"));
+      whileBlock->pushStatement(SampleAssign("t", SampleBinary("%", Token::Type::PERCENT, sum, SampleNumber("1000"))));
+      whileBlock->pushStatement(SampleAssign("i", SampleBinary("+", Token::Type::PLUS, SampleIdentifier("i"), SampleNumber("1")))); });
+    block->pushStatement(new ASTWhileStatement(SampleBinary("<", Token::Type::LEFT_ANGULAR_BRACKET, SampleIdentifier("i"), SampleIdentifier("n")), loopBlock));
+    block->pushStatement(new ASTReturnStatement(SampleIdentifier("t"))); }));
+
+  program->pushStatement(SampleFunction("depth", {SampleVariable("n", int64Ty)}, int64Ty, constAttributes, [](ASTBlock *block)
+                                        {
+    ASTBlock *bottomBlock = SampleBody("ThenBlock", [](ASTBlock *thenBlock)
+                                       { thenBlock->pushStatement(new ASTReturnStatement(SampleNumber("0"))); });
+    block->pushStatement(new ASTIfStatement(SampleBinary("==", Token::Type::DOUBLE_EQUALS, SampleIdentifier("n"), SampleNumber("0")), bottomBlock));
+    ASTExpression *inner = SampleCall("depth", {SampleBinary("-", Token::Type::HYPHEN, SampleIdentifier("n"), SampleNumber("1"))});
+    block->pushStatement(new ASTReturnStatement(SampleBinary("+", Token::Type::PLUS, inner, SampleNumber("1")))); }));
+
+  ASTExpression *total = SampleBinary("+", Token::Type::PLUS, SampleCall("fib", {SampleNumber("20")}), SampleCall("spin", {SampleNumber("5000003")}));
+  total = SampleBinary("+", Token::Type::PLUS, total, SampleCall("depth", {SampleNumber("1000")}));
+  program->pushStatement(new ASTCastExpression(SampleBinary("%", Token::Type::PERCENT, total, SampleNumber("256")), Type::getInteger32Ty()));
+}
+
+// Counted loops, see ASTForStatement. values is indexed, so it is in memory
+// and for x of values reads it in place. copy is not, for x of copy reads a
+// copy on the stack. squares is read through its pointer.
+//
+// values: [int64; 8] = [3, 1, 4, 1, 5, 9, 2, 6]
+// copy: [int64; 4] = [10, 20, 30, 40]
+// squares: *[int64; 16] = new [int64; 16]
+// for i in 0..16 { squares[i] = i * i }
+// total: int64 = 0
+// for i in 0..8 { total = total + values[i] * (i + 1) }   // 162
+// for x of values { total = total + x }                   // 31
+// for x of copy { total = total + x }                     // 100
+// for x of squares { total = total + x }                  // 1240
+// delete squares
+// int32(total % 256)                                      // 253
+void BuildLoopsSample(ASTBlock *program)
+{
+  Type *int64Ty = Type::getInteger64Ty();
+  ArrayType *valuesTy = Type::getArrayTy(int64Ty, 8);
+  ArrayType *copyTy = Type::getArrayTy(int64Ty, 4);
+  ArrayType *squaresTy = Type::getArrayTy(int64Ty, 16);
+  std::vector<ASTExpression *> values;
+  for (const char *value : {"3", "1", "4", "1", "5", "9", "2", "6"})
+  {
+    values.push_back(SampleNumber(value));
+  }
+
+  program->pushStatement(SampleAssign("values", new ASTArrayExpression(int64Ty, values), valuesTy));
+  program->pushStatement(SampleAssign("copy", new ASTArrayExpression(int64Ty, {SampleNumber("10"), SampleNumber("20"), SampleNumber("30"), SampleNumber("40")}), copyTy));
+  program->pushStatement(SampleAssign("squares", new ASTNewExpression(squaresTy), Type::getPointerTy(squaresTy, 0)));
+  program->pushStatement(SampleFor("i", int64Ty, SampleNumber("0"), SampleNumber("16"), [](ASTBlock *block)
+                                   { block->pushStatement(new ASTIndexAssignStatement(SampleIdentifier("squares"), SampleIdentifier("i"), SampleBinary("*", Token::Type::ASTERISK, SampleIdentifier("i"), SampleIdentifier("i")))); }));
+  program->pushStatement(SampleAssign("total", SampleNumber("0"), int64Ty));
+  program->pushStatement(SampleFor("i", int64Ty, SampleNumber("0"), SampleNumber("8"), [](ASTBlock *block)
+                                   {
+    ASTExpression *weight = SampleBinary("+", Token::Type::PLUS, SampleIdentifier("i"), SampleNumber("1"));
+    ASTExpression *term = SampleBinary("*", Token::Type::ASTERISK, new ASTIndexExpression(SampleIdentifier("values"), SampleIdentifier("i")), weight);
+    block->pushStatement(SampleAssign("total", SampleBinary("+", Token::Type::PLUS, SampleIdentifier("total"), term))); }));
+  for (const char *array : {"values", "copy", "squares"})
+  {
+    program->pushStatement(SampleFor("x", int64Ty, SampleIdentifier(array), nullptr, [](ASTBlock *block)
+                                     { block->pushStatement(SampleAssign("total", SampleBinary("+", Token::Type::PLUS, SampleIdentifier("total"), SampleIdentifier("x")))); }));
+  }
+
+  program->pushStatement(new ASTDeleteStatement(SampleIdentifier("squares")));
+  program->pushStatement(new ASTCastExpression(SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("total"), SampleNumber("256")), Type::getInteger32Ty()));
+}
+
+// Parallel for loops, see ASTParallelForStatement. Both bodies are outlined
+// and capture parts and k, the first loop is dealt out in blocks, the
+// second is split down to ranges of 1000. With assignsOutside a third body
+// assigns total, which is declared outside of it, so it can not be
+// outlined and the program does not compile.
+//
+// parts: *[int64; 100000] = new [int64; 100000]
+// k: int64 = 3
+// total: int64 = 0
+// parallel for i in 0..100000 { parts[i] = i * k }
+// parallel for i in 0..100000 dynamic 1000 { parts[i] = parts[i] + i }
+// parallel for i in 0..4 { total = i }                    // assignsOutside
+// for x of parts { total = total + x }                    // 19999800000
+// delete parts
+// int32(total % 256)                                      // 192
+void BuildParallelSample(ASTBlock *program, bool assignsOutside)
+{
+  Type *int64Ty = Type::getInteger64Ty();
+  ArrayType *partsTy = Type::getArrayTy(int64Ty, 100000);
+  program->pushStatement(SampleAssign("parts", new ASTNewExpression(partsTy), Type::getPointerTy(partsTy, 0)));
+  program->pushStatement(SampleAssign("k", SampleNumber("3"), int64Ty));
+  program->pushStatement(SampleAssign("total", SampleNumber("0"), int64Ty));
+
+  ASTVariableStatement *scaled = SampleVariable("i", int64Ty);
+  ASTBlock *scaleBlock = SampleBody("ForBlock", [scaled](ASTBlock *block)
+                                    {
+    block->newNamedVariable(scaled);
+    block->pushStatement(new ASTIndexAssignStatement(SampleIdentifier("parts"), SampleIdentifier("i"), SampleBinary("*", Token::Type::ASTERISK, SampleIdentifier("i"), SampleIdentifier("k")))); });
+  program->pushStatement(new ASTParallelForStatement(scaled, SampleNumber("0"), SampleNumber("100000"), scaleBlock));
+
+  ASTVariableStatement *added = SampleVariable("i", int64Ty);
+  ASTBlock *addBlock = SampleBody("ForBlock", [added](ASTBlock *block)
+                                  {
+    block->newNamedVariable(added);
+    ASTExpression *sum = SampleBinary("+", Token::Type::PLUS, new ASTIndexExpression(SampleIdentifier("parts"), SampleIdentifier("i")), SampleIdentifier("i"));
+    block->pushStatement(new ASTIndexAssignStatement(SampleIdentifier("parts"), SampleIdentifier("i"), sum)); });
+  program->pushStatement(new ASTParallelForStatement(added, SampleNumber("0"), SampleNumber("100000"), addBlock, ParallelSchedule::Dynamic, 1000));
+
+  if (assignsOutside)
+  {
+    ASTVariableStatement *assigned = SampleVariable("i", int64Ty);
+    ASTBlock *assignBlock = SampleBody("ForBlock", [assigned](ASTBlock *block)
+                                       {
+      block->newNamedVariable(assigned);
+      block->pushStatement(SampleAssign("total", SampleIdentifier("i"))); });
+    program->pushStatement(new ASTParallelForStatement(assigned, SampleNumber("0"), SampleNumber("4"), assignBlock));
+  }
+
+  program->pushStatement(SampleFor("x", int64Ty, SampleIdentifier("parts"), nullptr, [](ASTBlock *block)
+                                   { block->pushStatement(SampleAssign("total", SampleBinary("+", Token::Type::PLUS, SampleIdentifier("total"), SampleIdentifier("x")))); }));
+  program->pushStatement(new ASTDeleteStatement(SampleIdentifier("parts")));
+  program->pushStatement(new ASTCastExpression(SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("total"), SampleNumber("256")), Type::getInteger32Ty()));
+}
+
+// Classes, see ClassType. Shape has a constructor without arguments that
+// runs before the constructor of Rect, which Square inherits. areaOf calls
+// area through the table of the object, Square is final so squareArea
+// calls Square.area directly. With baseArguments Square has a constructor
+// of its own, the one of Rect could not be passed its arguments and the
+// program does not compile.
+//
+// class Shape { id: int64; constructor() { id = 7 }; virtual fn area(): int64 { return 0 } }
+// class Rect : Shape { w: int64; h: int64
+//   constructor(w: int64, h: int64) { this.w = w; this.h = h }
+//   fn area(): int64 { return w * h }
+// }
+// final class Square : Rect {
+//   constructor(s: int64) { w = s; h = s }                  // baseArguments
+//   fn area(): int64 { return w * w }
+// }
+// @noinline fn areaOf(s: *Shape): int64 { return s.area() }
+// @noinline fn squareArea(s: *Square): int64 { return s.area() }
+// r = Rect(3, 4)
+// sq = Square(5, 5)                                      // Square(5)
+// int32(areaOf(&r) + areaOf(&sq) + squareArea(&sq) + r.id + sq.id)   // 76
+void BuildClassesSample(ASTBlock *program, bool baseArguments)
+{
+  Type *int64Ty = Type::getInteger64Ty();
+  Type *voidTy = Type::getVoidTy();
+  ClassType *shape = Type::getClassTy("Shape");
+  shape->addField("id", int64Ty);
+  program->pushStatement(SampleMethod(shape, "constructor", {}, voidTy, false, [](ASTBlock *block)
+                                      { block->pushStatement(new ASTMemberAssignStatement(SampleIdentifier("this"), Token("id", Token::Type::IDENTIFIER), SampleNumber("7"))); }));
+  program->pushStatement(SampleMethod(shape, "area", {}, int64Ty, true, [](ASTBlock *block)
+                                      { block->pushStatement(new ASTReturnStatement(SampleNumber("0"))); }));
+
+  ClassType *rect = Type::getClassTy("Rect", shape, false);
+  rect->addField("w", int64Ty);
+  rect->addField("h", int64Ty);
+  program->pushStatement(SampleMethod(rect, "constructor", {SampleVariable("w", int64Ty), SampleVariable("h", int64Ty)}, voidTy, false, [](ASTBlock *block)
+                                      {
+    block->pushStatement(new ASTMemberAssignStatement(SampleIdentifier("this"), Token("w", Token::Type::IDENTIFIER), SampleIdentifier("w")));
+    block->pushStatement(new ASTMemberAssignStatement(SampleIdentifier("this"), Token("h", Token::Type::IDENTIFIER), SampleIdentifier("h"))); }));
+  program->pushStatement(SampleMethod(rect, "area", {}, int64Ty, false, [](ASTBlock *block)
+                                      {
+    ASTExpression *width = new ASTMemberExpression(SampleIdentifier("this"), Token("w", Token::Type::IDENTIFIER));
+    ASTExpression *height = new ASTMemberExpression(SampleIdentifier("this"), Token("h", Token::Type::IDENTIFIER));
+    block->pushStatement(new ASTReturnStatement(SampleBinary("*", Token::Type::ASTERISK, width, height))); }));
+
+  ClassType *square = Type::getClassTy("Square", rect, true);
+  if (baseArguments)
+  {
+    program->pushStatement(SampleMethod(square, "constructor", {SampleVariable("s", int64Ty)}, voidTy, false, [](ASTBlock *block)
+                                        {
+      block->pushStatement(new ASTMemberAssignStatement(SampleIdentifier("this"), Token("w", Token::Type::IDENTIFIER), SampleIdentifier("s")));
+      block->pushStatement(new ASTMemberAssignStatement(SampleIdentifier("this"), Token("h", Token::Type::IDENTIFIER), SampleIdentifier("s"))); }));
+  }
+
+  program->pushStatement(SampleMethod(square, "area", {}, int64Ty, false, [](ASTBlock *block)
+                                      {
+    ASTExpression *width = new ASTMemberExpression(SampleIdentifier("this"), Token("w", Token::Type::IDENTIFIER));
+    ASTExpression *sameWidth = new ASTMemberExpression(SampleIdentifier("this"), Token("w", Token::Type::IDENTIFIER));
+    block->pushStatement(new ASTReturnStatement(SampleBinary("*", Token::Type::ASTERISK, width, sameWidth))); }));
+
+  FunctionAttributes noInlineAttributes;
+  noInlineAttributes.isNoInline = true;
+  program->pushStatement(SampleFunction("areaOf", {SampleVariable("s", Type::getPointerTy(shape, 0))}, int64Ty, noInlineAttributes, [](ASTBlock *block)
+                                        { block->pushStatement(new ASTReturnStatement(new ASTMethodCallExpression(SampleIdentifier("s"), Token("area", Token::Type::IDENTIFIER), {}))); }));
+  program->pushStatement(SampleFunction("squareArea", {SampleVariable("s", Type::getPointerTy(square, 0))}, int64Ty, noInlineAttributes, [](ASTBlock *block)
+                                        { block->pushStatement(new ASTReturnStatement(new ASTMethodCallExpression(SampleIdentifier("s"), Token("area", Token::Type::IDENTIFIER), {}))); }));
+
+  program->pushStatement(new ASTObjectStatement(Token("r", Token::Type::IDENTIFIER), rect, {SampleNumber("3"), SampleNumber("4")}));
+  std::vector<ASTExpression *> squareArgs = {SampleNumber("5")};
+  if (!baseArguments)
+  {
+    squareArgs.push_back(SampleNumber("5"));
+  }
+
+  program->pushStatement(new ASTObjectStatement(Token("sq", Token::Type::IDENTIFIER), square, squareArgs));
+  ASTExpression *total = SampleBinary("+", Token::Type::PLUS, SampleCall("areaOf", {new ASTReferenceExpression(SampleIdentifier("r"))}), SampleCall("areaOf", {new ASTReferenceExpression(SampleIdentifier("sq"))}));
+  total = SampleBinary("+", Token::Type::PLUS, total, SampleCall("squareArea", {new ASTReferenceExpression(SampleIdentifier("sq"))}));
+  total = SampleBinary("+", Token::Type::PLUS, total, new ASTMemberExpression(SampleIdentifier("r"), Token("id", Token::Type::IDENTIFIER)));
+  total = SampleBinary("+", Token::Type::PLUS, total, new ASTMemberExpression(SampleIdentifier("sq"), Token("id", Token::Type::IDENTIFIER)));
+  program->pushStatement(new ASTCastExpression(total, Type::getInteger32Ty()));
+}
+
+// Heap allocations moved to the frame, see StackPromotionPass. Every
+// function is kept out of line and exported, so that its argument is not
+// known and tests/samples.sh can look at what the pass did to it at -O2. callocSmall and mallocSmall allocate at most
+// 4096 bytes and are promoted, callocLarge allocates 4104 and is not.
+// merged reads p and q through a pointer that may be either, so neither is
+// promoted. The tail call of tailSum reads its promoted array, so it is no
+// longer marked tail. mustTailSum has the type of total, the call that
+// reads its array is musttail and the array stays on the heap.
+//
+// @noinline fn total(p: *[int64; 8]): int64 { t: int64 = 0; for x of p { t = t + x }; return t }
+// @noinline fn callocSmall(n: int64): int64 {               // and callocLarge with 513
+//   p = new [int64; 512]
+//   for i in 0..n { p[i % 512] = i * 2 }
+//   r = p[(n - 1) % 512]; delete p; return r                 // 18
+// }
+// @noinline fn mallocSmall(n: int64): int64 {
+//   p = new [n, n, n, n, n, n, n, n]; p[n % 8] = 1
+//   r = p[0] + p[n % 8]; delete p; return r                  // 11
+// }
+// @noinline fn merged(n: int64): int64 {
+//   p = new [int64; 8]; q = new [int64; 8]; r = p
+//   if (n > 5) { r = q }
+//   r[n % 8] = n
+//   t = p[n % 8] + q[n % 8] * 2; delete p; delete q; return t   // 20
+// }
+// @noinline fn tailSum(n: int64): int64 { p = new [int64; 8]; p[n % 8] = n; return total(p) }   // 10
+// @noinline fn mustTailSum(q: *[int64; 8]): int64 { p = new [int64; 8]; p[0] = q[0] + 1; return total(p) }   // 6
+// values: [int64; 8] = [5, 0, 0, 0, 0, 0, 0, 0]
+// int32(callocSmall(10) + callocLarge(10) + mallocSmall(10) + merged(10) + tailSum(10) + mustTailSum(&values))   // 83
+void BuildStackSample(ASTBlock *program)
+{
+  Type *int64Ty = Type::getInteger64Ty();
+  ArrayType *arrayTy = Type::getArrayTy(int64Ty, 8);
+  FunctionAttributes noInlineAttributes;
+  noInlineAttributes.isNoInline = true;
+  noInlineAttributes.isExported = true;
+
+  program->pushStatement(SampleFunction("total", {SampleVariable("p", Type::getPointerTy(arrayTy, 0))}, int64Ty, noInlineAttributes, [int64Ty](ASTBlock *block)
+                                        {
+    block->pushStatement(SampleAssign("t", SampleNumber("0"), int64Ty));
+    block->pushStatement(SampleFor("x", int64Ty, SampleIdentifier("p"), nullptr, [](ASTBlock *loopBlock)
+                                   { loopBlock->pushStatement(SampleAssign("t", SampleBinary("+", Token::Type::PLUS, SampleIdentifier("t"), SampleIdentifier("x")))); }));
+    block->pushStatement(new ASTReturnStatement(SampleIdentifier("t"))); }));
+
+  for (const char *length : {"512", "513"})
+  {
+    ArrayType *zeroedTy = Type::getArrayTy(int64Ty, std::stoul(length));
+    const char *name = strcmp(length, "512") == 0 ? "callocSmall" : "callocLarge";
+    program->pushStatement(SampleFunction(name, {SampleVariable("n", int64Ty)}, int64Ty, noInlineAttributes, [int64Ty, zeroedTy, length](ASTBlock *block)
+                                          {
+      block->pushStatement(SampleAssign("p", new ASTNewExpression(zeroedTy), Type::getPointerTy(zeroedTy, 0)));
+      block->pushStatement(SampleFor("i", int64Ty, SampleNumber("0"), SampleIdentifier("n"), [length](ASTBlock *loopBlock)
+                                     {
+        ASTExpression *index = SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("i"), SampleNumber(length));
+        loopBlock->pushStatement(new ASTIndexAssignStatement(SampleIdentifier("p"), index, SampleBinary("*", Token::Type::ASTERISK, SampleIdentifier("i"), SampleNumber("2")))); }));
+      ASTExpression *last = SampleBinary("%", Token::Type::PERCENT, SampleBinary("-", Token::Type::HYPHEN, SampleIdentifier("n"), SampleNumber("1")), SampleNumber(length));
+      block->pushStatement(SampleAssign("r", new ASTIndexExpression(SampleIdentifier("p"), last), int64Ty));
+      block->pushStatement(new ASTDeleteStatement(SampleIdentifier("p")));
+      block->pushStatement(new ASTReturnStatement(SampleIdentifier("r"))); }));
+  }
+
+  program->pushStatement(SampleFunction("mallocSmall", {SampleVariable("n", int64Ty)}, int64Ty, noInlineAttributes, [int64Ty, arrayTy](ASTBlock *block)
+                                        {
+    std::vector<ASTExpression *> elements;
+    for (int i = 0; i < 8; i++)
+    {
+      elements.push_back(SampleIdentifier("n"));
+    }
+
+    block->pushStatement(SampleAssign("p", new ASTNewExpression(new ASTArrayExpression(int64Ty, elements)), Type::getPointerTy(arrayTy, 0)));
+    block->pushStatement(new ASTIndexAssignStatement(SampleIdentifier("p"), SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("n"), SampleNumber("8")), SampleNumber("1")));
+    ASTExpression *sum = SampleBinary("+", Token::Type::PLUS, new ASTIndexExpression(SampleIdentifier("p"), SampleNumber("0")), new ASTIndexExpression(SampleIdentifier("p"), SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("n"), SampleNumber("8"))));
+    block->pushStatement(SampleAssign("r", sum, int64Ty));
+    block->pushStatement(new ASTDeleteStatement(SampleIdentifier("p")));
+    block->pushStatement(new ASTReturnStatement(SampleIdentifier("r"))); }));
+
+  program->pushStatement(SampleFunction("merged", {SampleVariable("n", int64Ty)}, int64Ty, noInlineAttributes, [int64Ty, arrayTy](ASTBlock *block)
+                                        {
+    block->pushStatement(SampleAssign("p", new ASTNewExpression(arrayTy), Type::getPointerTy(arrayTy, 0)));
+    block->pushStatement(SampleAssign("q", new ASTNewExpression(arrayTy), Type::getPointerTy(arrayTy, 0)));
+    block->pushStatement(SampleAssign("r", SampleIdentifier("p"), Type::getPointerTy(arrayTy, 0)));
+    ASTBlock *otherBlock = SampleBody("ThenBlock", [](ASTBlock *thenBlock)
+                                      { thenBlock->pushStatement(SampleAssign("r", SampleIdentifier("q"))); });
+    block->pushStatement(new ASTIfStatement(SampleBinary(">", Token::Type::RIGHT_ANGULAR_BRACKET, SampleIdentifier("n"), SampleNumber("5")), otherBlock));
+    block->pushStatement(new ASTIndexAssignStatement(SampleIdentifier("r"), SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("n"), SampleNumber("8")), SampleIdentifier("n")));
+    ASTExpression *first = new ASTIndexExpression(SampleIdentifier("p"), SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("n"), SampleNumber("8")));
+    ASTExpression *second = new ASTIndexExpression(SampleIdentifier("q"), SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("n"), SampleNumber("8")));
+    block->pushStatement(SampleAssign("t", SampleBinary("+", Token::Type::PLUS, first, SampleBinary("*", Token::Type::ASTERISK, second, SampleNumber("2"))), int64Ty));
+    block->pushStatement(new ASTDeleteStatement(SampleIdentifier("p")));
+    block->pushStatement(new ASTDeleteStatement(SampleIdentifier("q")));
+    block->pushStatement(new ASTReturnStatement(SampleIdentifier("t"))); }));
+
+  program->pushStatement(SampleFunction("tailSum", {SampleVariable("n", int64Ty)}, int64Ty, noInlineAttributes, [arrayTy](ASTBlock *block)
+                                        {
+    block->pushStatement(SampleAssign("p", new ASTNewExpression(arrayTy), Type::getPointerTy(arrayTy, 0)));
+    block->pushStatement(new ASTIndexAssignStatement(SampleIdentifier("p"), SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("n"), SampleNumber("8")), SampleIdentifier("n")));
+    block->pushStatement(new ASTReturnStatement(SampleCall("total", {SampleIdentifier("p")}))); }));
+
+  program->pushStatement(SampleFunction("mustTailSum", {SampleVariable("q", Type::getPointerTy(arrayTy, 0))}, int64Ty, noInlineAttributes, [arrayTy](ASTBlock *block)
+                                        {
+    block->pushStatement(SampleAssign("p", new ASTNewExpression(arrayTy), Type::getPointerTy(arrayTy, 0)));
+    ASTExpression *next = SampleBinary("+", Token::Type::PLUS, new ASTIndexExpression(SampleIdentifier("q"), SampleNumber("0")), SampleNumber("1"));
+    block->pushStatement(new ASTIndexAssignStatement(SampleIdentifier("p"), SampleNumber("0"), next));
+    block->pushStatement(new ASTReturnStatement(SampleCall("total", {SampleIdentifier("p")}))); }));
+
+  std::vector<ASTExpression *> values = {SampleNumber("5")};
+  for (int i = 1; i < 8; i++)
+  {
+    values.push_back(SampleNumber("0"));
+  }
+
+  program->pushStatement(SampleAssign("values", new ASTArrayExpression(int64Ty, values), arrayTy));
+  ASTExpression *result = SampleCall("callocSmall", {SampleNumber("10")});
+  for (const char *name : {"callocLarge", "mallocSmall", "merged", "tailSum"})
+  {
+    result = SampleBinary("+", Token::Type::PLUS, result, SampleCall(name, {SampleNumber("10")}));
+  }
+
+  result = SampleBinary("+", Token::Type::PLUS, result, SampleCall("mustTailSum", {new ASTReferenceExpression(SampleIdentifier("values"))}));
+  program->pushStatement(new ASTCastExpression(result, Type::getInteger32Ty()));
+}
+
+// Slices and arrays of structures laid out by field, see ASTSliceExpression
+// and ArrayType::isSoA. Indexing a slice is checked against its length,
+// with outOfRange the program reads past the end of v and traps. guarded
+// runs past the end of its slice but only reads it below its length, so the
+// copy of its loop with checks runs and never traps. Only the innermost
+// loop of cube is copied, see ASTForStatement::codegenRangeLoop.
+//
+// class Particle { x: int64; y: int64 }
+// @noinline fn total(s: []int64): int64 { t: int64 = 0; for i in 0..len(s) { t = t + s[i] }; return t }
+// @noinline fn at(s: []int64, n: int64): int64 { return s[n] }
+// @noinline fn guarded(s: []int64, n: int64): int64 {
+//   t: int64 = 0
+//   for i in 0..n { if (i < len(s)) { t = t + s[i] } }
+//   return t
+// }
+// @noinline fn cube(s: []int64): int64 {
+//   t: int64 = 0
+//   for a in 0..len(s) { for b in 0..len(s) { for c in 0..len(s) { t = t + s[a] * s[b] + s[c] } } }
+//   return t
+// }
+// buf = new [int64; 100]
+// for i in 0..100 { buf[i] = i }
+// s = buf[:]; v = buf[20:30]; w = v[2:5]
+// particles = new @soa [Particle; 16]
+// for i in 0..16 { particles[i].x = i; particles[i].y = particles[i].x * 3 }
+// ys: int64 = 0
+// for i in 0..16 { ys = ys + particles[i].y }                       // 360
+// result = total(s) + total(v) + total(w) + len(v) + at(v, 9) + ys   // 5663
+// result = result + guarded(v, 15) + cube(w)                         // 245, 14904
+// at(v, 10)                                                          // outOfRange
+// delete buf; delete particles
+// int32(result % 256)                                                // 76
+void BuildSlicesSample(ASTBlock *program, bool outOfRange)
+{
+  Type *int64Ty = Type::getInteger64Ty();
+  SliceType *sliceTy = Type::getSliceTy(int64Ty);
+  ArrayType *bufferTy = Type::getArrayTy(int64Ty, 100);
+  ClassType *particle = Type::getClassTy("Particle");
+  particle->addField("x", int64Ty);
+  particle->addField("y", int64Ty);
+  ArrayType *particlesTy = Type::getArrayTy(particle, 16, true);
+  FunctionAttributes noInlineAttributes;
+  noInlineAttributes.isNoInline = true;
+
+  program->pushStatement(SampleFunction("total", {SampleVariable("s", sliceTy)}, int64Ty, noInlineAttributes, [int64Ty](ASTBlock *block)
+                                        {
+    block->pushStatement(SampleAssign("t", SampleNumber("0"), int64Ty));
+    block->pushStatement(SampleFor("i", int64Ty, SampleNumber("0"), new ASTLengthExpression(SampleIdentifier("s")), [](ASTBlock *loopBlock)
+                                   { loopBlock->pushStatement(SampleAssign("t", SampleBinary("+", Token::Type::PLUS, SampleIdentifier("t"), new ASTIndexExpression(SampleIdentifier("s"), SampleIdentifier("i"))))); }));
+    block->pushStatement(new ASTReturnStatement(SampleIdentifier("t"))); }));
+  program->pushStatement(SampleFunction("at", {SampleVariable("s", sliceTy), SampleVariable("n", int64Ty)}, int64Ty, noInlineAttributes, [](ASTBlock *block)
+                                        { block->pushStatement(new ASTReturnStatement(new ASTIndexExpression(SampleIdentifier("s"), SampleIdentifier("n")))); }));
+  program->pushStatement(SampleFunction("guarded", {SampleVariable("s", sliceTy), SampleVariable("n", int64Ty)}, int64Ty, noInlineAttributes, [int64Ty](ASTBlock *block)
+                                        {
+    block->pushStatement(SampleAssign("t", SampleNumber("0"), int64Ty));
+    block->pushStatement(SampleFor("i", int64Ty, SampleNumber("0"), SampleIdentifier("n"), [](ASTBlock *loopBlock)
+                                   {
+      ASTBlock *readBlock = SampleBody("ThenBlock", [](ASTBlock *thenBlock)
+                                       { thenBlock->pushStatement(SampleAssign("t", SampleBinary("+", Token::Type::PLUS, SampleIdentifier("t"), new ASTIndexExpression(SampleIdentifier("s"), SampleIdentifier("i"))))); });
+      loopBlock->pushStatement(new ASTIfStatement(SampleBinary("<", Token::Type::LEFT_ANGULAR_BRACKET, SampleIdentifier("i"), new ASTLengthExpression(SampleIdentifier("s"))), readBlock)); }));
+    block->pushStatement(new ASTReturnStatement(SampleIdentifier("t"))); }));
+  program->pushStatement(SampleFunction("cube", {SampleVariable("s", sliceTy)}, int64Ty, noInlineAttributes, [int64Ty](ASTBlock *block)
+                                        {
+    block->pushStatement(SampleAssign("t", SampleNumber("0"), int64Ty));
+    block->pushStatement(SampleFor("a", int64Ty, SampleNumber("0"), new ASTLengthExpression(SampleIdentifier("s")), [int64Ty](ASTBlock *outerBlock)
+                                   { outerBlock->pushStatement(SampleFor("b", int64Ty, SampleNumber("0"), new ASTLengthExpression(SampleIdentifier("s")), [int64Ty](ASTBlock *middleBlock)
+                                                                         { middleBlock->pushStatement(SampleFor("c", int64Ty, SampleNumber("0"), new ASTLengthExpression(SampleIdentifier("s")), [](ASTBlock *innerBlock)
+                                                                                                                {
+      ASTExpression *product = SampleBinary("*", Token::Type::ASTERISK, new ASTIndexExpression(SampleIdentifier("s"), SampleIdentifier("a")), new ASTIndexExpression(SampleIdentifier("s"), SampleIdentifier("b")));
+      ASTExpression *sum = SampleBinary("+", Token::Type::PLUS, product, new ASTIndexExpression(SampleIdentifier("s"), SampleIdentifier("c")));
+      innerBlock->pushStatement(SampleAssign("t", SampleBinary("+", Token::Type::PLUS, SampleIdentifier("t"), sum))); })); })); }));
+    block->pushStatement(new ASTReturnStatement(SampleIdentifier("t"))); }));
+
+  program->pushStatement(SampleAssign("buf", new ASTNewExpression(bufferTy), Type::getPointerTy(bufferTy, 0)));
+  program->pushStatement(SampleFor("i", int64Ty, SampleNumber("0"), SampleNumber("100"), [](ASTBlock *block)
+                                   { block->pushStatement(new ASTIndexAssignStatement(SampleIdentifier("buf"), SampleIdentifier("i"), SampleIdentifier("i"))); }));
+  program->pushStatement(SampleAssign("s", new ASTSliceExpression(SampleIdentifier("buf")), sliceTy));
+  program->pushStatement(SampleAssign("v", new ASTSliceExpression(SampleIdentifier("buf"), SampleNumber("20"), SampleNumber("30")), sliceTy));
+  program->pushStatement(SampleAssign("w", new ASTSliceExpression(SampleIdentifier("v"), SampleNumber("2"), SampleNumber("5")), sliceTy));
+
+  program->pushStatement(SampleAssign("particles", new ASTNewExpression(particlesTy), Type::getPointerTy(particlesTy, 0)));
+  program->pushStatement(SampleFor("i", int64Ty, SampleNumber("0"), SampleNumber("16"), [](ASTBlock *block)
+                                   {
+    block->pushStatement(new ASTMemberAssignStatement(new ASTIndexExpression(SampleIdentifier("particles"), SampleIdentifier("i")), Token("x", Token::Type::IDENTIFIER), SampleIdentifier("i")));
+    ASTExpression *x = new ASTMemberExpression(new ASTIndexExpression(SampleIdentifier("particles"), SampleIdentifier("i")), Token("x", Token::Type::IDENTIFIER));
+    block->pushStatement(new ASTMemberAssignStatement(new ASTIndexExpression(SampleIdentifier("particles"), SampleIdentifier("i")), Token("y", Token::Type::IDENTIFIER), SampleBinary("*", Token::Type::ASTERISK, x, SampleNumber("3")))); }));
+  program->pushStatement(SampleAssign("ys", SampleNumber("0"), int64Ty));
+  program->pushStatement(SampleFor("i", int64Ty, SampleNumber("0"), SampleNumber("16"), [](ASTBlock *block)
+                                   {
+    ASTExpression *y = new ASTMemberExpression(new ASTIndexExpression(SampleIdentifier("particles"), SampleIdentifier("i")), Token("y", Token::Type::IDENTIFIER));
+    block->pushStatement(SampleAssign("ys", SampleBinary("+", Token::Type::PLUS, SampleIdentifier("ys"), y))); }));
+
+  ASTExpression *result = SampleCall("total", {SampleIdentifier("s")});
+  for (const char *slice : {"v", "w"})
+  {
+    result = SampleBinary("+", Token::Type::PLUS, result, SampleCall("total", {SampleIdentifier(slice)}));
+  }
+
+  result = SampleBinary("+", Token::Type::PLUS, result, new ASTLengthExpression(SampleIdentifier("v")));
+  result = SampleBinary("+", Token::Type::PLUS, result, SampleCall("at", {SampleIdentifier("v"), SampleNumber("9")}));
+  result = SampleBinary("+", Token::Type::PLUS, result, SampleIdentifier("ys"));
+  result = SampleBinary("+", Token::Type::PLUS, result, SampleCall("guarded", {SampleIdentifier("v"), SampleNumber("15")}));
+  result = SampleBinary("+", Token::Type::PLUS, result, SampleCall("cube", {SampleIdentifier("w")}));
+  program->pushStatement(SampleAssign("result", result, int64Ty));
+  if (outOfRange)
+  {
+    program->pushStatement(SampleAssign("result", SampleBinary("+", Token::Type::PLUS, SampleIdentifier("result"), SampleCall("at", {SampleIdentifier("v"), SampleNumber("10")}))));
+  }
+
+  program->pushStatement(new ASTDeleteStatement(SampleIdentifier("buf")));
+  program->pushStatement(new ASTDeleteStatement(SampleIdentifier("particles")));
+  program->pushStatement(new ASTCastExpression(SampleBinary("%", Token::Type::PERCENT, SampleIdentifier("result"), SampleNumber("256")), Type::getInteger32Ty()));
+}
+
+// Builds the sample program of the name, false when there is none.
+bool BuildSample(const std::string &name, ASTBlock *program)
+{
+  if (name == "branchy")
+  {
+    BuildBranchySample(program);
+  }
+  else if (name == "comptime")
+  {
+    BuildComptimeSample(program);
+  }
+  else if (name == "loops")
+  {
+    BuildLoopsSample(program);
+  }
+  else if (name == "classes" || name == "classes-base-arguments")
+  {
+    BuildClassesSample(program, name == "classes-base-arguments");
+  }
+  else if (name == "stack")
+  {
+    BuildStackSample(program);
+  }
+  else if (name == "slices" || name == "slices-out-of-range")
+  {
+    BuildSlicesSample(program, name == "slices-out-of-range");
+  }
+  else if (name == "parallel" || name == "parallel-assign")
+  {
+    BuildParallelSample(program, name == "parallel-assign");
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  ASTDumper::Format dumpFormat = ASTDumper::Format::Text;
+  bool isDumpRequested = false;
+  bool emitLLVM = false;
+  bool reportOptimization = false;
+  llvm::OptimizationLevel optimizationLevel = llvm::OptimizationLevel::O0;
+  std::string targetCPU;
+  std::string targetFeatures;
+  std::string outputPath;
+  bool emitObjectOnly = false;
+  bool runInProcess = false;
+  bool runTiered = false;
+  uint64_t tierUpThreshold = 1000;
+  unsigned codegenThreads = 0;
+  bool splitObjects = false;
+  std::string cacheDirectory;
+  bool isThinLTO = false;
+  std::vector<std::string> inputFiles;
+  std::string profilePath;
+  std::string sampleName;
+  unsigned numOfSampleFunctions = 0;
+  int exportedSampleFunction = -1;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--dump=json") == 0)
+    {
+      dumpFormat = ASTDumper::Format::JSON;
+      isDumpRequested = true;
+    }
+    else if (strcmp(argv[i], "--dump=binary") == 0)
+    {
+      dumpFormat = ASTDumper::Format::Binary;
+      isDumpRequested = true;
+    }
+    else if (strcmp(argv[i], "--dump=text") == 0)
+    {
+      dumpFormat = ASTDumper::Format::Text;
+      isDumpRequested = true;
+    }
+    else if (strcmp(argv[i], "--emit-llvm") == 0)
+    {
+      emitLLVM = true;
+    }
+    else if (strcmp(argv[i], "--opt-report") == 0)
+    {
+      reportOptimization = true;
+    }
+    else if (strcmp(argv[i], "--report-tail-calls") == 0)
+    {
+      globalReportTailCalls = true;
+    }
+    else if (strcmp(argv[i], "--report-loops") == 0)
+    {
+      globalReportLoops = true;
+    }
+    else if (strncmp(argv[i], "-march=", 7) == 0)
+    {
+      targetCPU = argv[i] + 7;
+    }
+    else if (strncmp(argv[i], "-mattr=", 7) == 0)
+    {
+      targetFeatures = argv[i] + 7;
+    }
+    else if (strcmp(argv[i], "--run") == 0)
+    {
+      runInProcess = true;
+    }
+    else if (strcmp(argv[i], "--tiered") == 0)
+    {
+      runInProcess = true;
+      runTiered = true;
+    }
+    else if (strncmp(argv[i], "--tier-threshold=", 17) == 0)
+    {
+      tierUpThreshold = std::strtoull(argv[i] + 17, nullptr, 10);
+    }
+    else if (strncmp(argv[i], "--codegen-threads=", 18) == 0)
+    {
+      codegenThreads = std::strtoul(argv[i] + 18, nullptr, 10);
+    }
+    else if (strcmp(argv[i], "--split-objects") == 0)
+    {
+      splitObjects = true;
+    }
+    else if (strncmp(argv[i], "--cache-dir=", 12) == 0)
+    {
+      cacheDirectory = argv[i] + 12;
+    }
+    else if (strcmp(argv[i], "-flto=thin") == 0)
+    {
+      isThinLTO = true;
+    }
+    else if (strcmp(argv[i], "--profile-generate") == 0)
+    {
+      globalProfileMode = ProfileMode::Generate;
+      profilePath = "gearfuse.profile";
+    }
+    else if (strncmp(argv[i], "--profile-generate=", 19) == 0)
+    {
+      globalProfileMode = ProfileMode::Generate;
+      profilePath = argv[i] + 19;
+    }
+    else if (strncmp(argv[i], "--profile-use=", 14) == 0)
+    {
+      globalProfileMode = ProfileMode::Use;
+      profilePath = argv[i] + 14;
+    }
+    else if (strncmp(argv[i], "--sample=functions=", 19) == 0)
+    {
+      char *options;
+      numOfSampleFunctions = std::max(1ul, std::strtoul(argv[i] + 19, &options, 10));
+      if (strncmp(options, ",exported=", 10) == 0)
+      {
+        exportedSampleFunction = std::atoi(options + 10);
+      }
+    }
+    else if (strncmp(argv[i], "--sample=", 9) == 0)
+    {
+      sampleName = argv[i] + 9;
+    }
+    else if (argv[i][0] != '-' && (llvm::StringRef(argv[i]).endswith(".bc") || llvm::StringRef(argv[i]).endswith(".o")))
+    {
+      inputFiles.push_back(argv[i]);
+    }
+    else if (strcmp(argv[i], "-c") == 0)
+    {
+      emitObjectOnly = true;
+    }
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+    {
+      outputPath = argv[++i];
+    }
+    else if (!ParseOptimizationLevel(argv[i], optimizationLevel))
+    {
+      fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 1;
+    }
   }
 
-  llvm::Value *codegen() override
+  // Input files are modules written with -flto=thin -c, they are linked
+  // with the program through the thin link.
+  if (!inputFiles.empty() && (emitObjectOnly || runInProcess || outputPath.empty()))
   {
-    Type *operandType = operand->getType();
-    llvm::Value *operandValue = operand->codegen();
+    fprintf(stderr, "input files can only be linked into an executable (-o)\n");
+    return 1;
+  }
 
-    if (!operandValue)
-    {
-      return nullptr;
-    }
+  isThinLTO = (isThinLTO || !inputFiles.empty()) && !runInProcess && (emitObjectOnly || !outputPath.empty());
 
-    if (getType()->isNumberTy())
+  std::unique_ptr<ProfileData> profileData;
+  if (globalProfileMode == ProfileMode::Use)
+  {
+    profileData = ProfileData::load(profilePath);
+    if (!profileData)
     {
-      switch (operatorToken.type)
-      {
-      case Token::Type::PLUS:
-        return operandValue;
-      case Token::Type::HYPHEN:
-        return builder->CreateNeg(operandValue, "negative_tmp");
-      case Token::Type::EXCLAMATION:
-        return builder->CreateNot(operandValue, "not_tmp");
-      default:
-        return nullptr;
-      }
+      fprintf(stderr, "could not read the profile %s\n", profilePath.c_str());
+      return 1;
     }
 
-    return nullptr;
+    globalProfileData = profileData.get();
   }
-};
 
-class ASTVariableStatement : public ASTStatement
-{
-protected:
-  Token token;
-  Type *type;
-  llvm::AllocaInst *value;
+  // Partitions are optimised apart from each other, so how the program is
+  // split decides what is inlined. Without --codegen-threads it is a single
+  // module and the output does not depend on the cores of the host. The
+  // backends of the thin link produce the same code on any number of
+  // threads, they use every core.
+  unsigned numOfPartitions = std::max(1u, codegenThreads);
+  unsigned numOfThinLinkThreads = codegenThreads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : codegenThreads;
 
-public:
-  ASTVariableStatement(Token token,
-                       Type *type,
-                       ASTNodeID ID = ASTNode::ASTVariableStatementID,
-                       std::string showKind = "VariableStatement") : token(token),
-                                                                     type(type),
-                                                                     ASTStatement(ID, showKind, token.value){};
+  std::unique_ptr<llvm::TargetMachine> targetMachine(CreateTargetMachine(targetCPU, targetFeatures, optimizationLevel));
+  if (!targetMachine)
+  {
+    return 1;
+  }
 
-  std::string getName() { return token.value; }
-  Type *getType() { return type; }
-  llvm::AllocaInst *getAlocatedValue() { return value; }
-  virtual void evaluateType(){};
+  // Tiered runs start from unoptimised IR, the level is used for tier up.
+  llvm::OptimizationLevel codegenLevel = runTiered ? llvm::OptimizationLevel::O0 : optimizationLevel;
 
-  virtual llvm::Value *codegen() override
+  module->setTargetTriple(targetMachine->getTargetTriple().str());
+  module->setDataLayout(targetMachine->createDataLayout());
+  if (globalProfileData)
   {
-    llvm::Function *function = builder->GetInsertBlock()->getParent();
-    value = CreateEntryBlockAlloca(function, type->getLLVMTy(), token.value.c_str());
-    return value;
+    globalProfileData->annotateModule(module.get());
   }
-};
 
-ASTVariableStatement *currentVariable;
-class ASTBlock : public ASTNode
-{
-protected:
-  std::vector<ASTStatement *> body;
-  std::map<std::string, ASTVariableStatement *> namedVariables;
+  EnableLoopRemarks(*context);
 
-public:
-  ASTBlock(std::vector<ASTStatement *> body, std::string showKind = "Block") : body(std::move(body)), ASTNode(ASTNode::ASTBlockID, showKind){};
-  ASTBlock(std::string showKind = "Block") : ASTNode(ASTNode::ASTBlockID, showKind){};
+  // std::vector<Type *> testTys;
+  // Type *type1 = Type::getFloat32Ty();
+  // Type *type2 = Type::getInteger64Ty();
+  // Type *type3 = getTypeFromTwoTypes(type1, type2);
 
-  std::vector<ASTNode *> getChildrenShow() override
+  // testTys.push_back(type1);
+  // testTys.push_back(type2);
+  // testTys.push_back(type3);
+  // TestTypes(std::move(testTys));
+
+  // binaryExpr2->evaluateType();
+  // PrettyPrint(binaryExpr2);
+  // llvm::Value *value = binaryExpr2->codegen();
+  // value->print(llvm::outs());
+
+  llvm::Function *function = llvm::Function::Create(llvm::FunctionType::get(builder->getInt32Ty(), false), llvm::GlobalValue::ExternalLinkage, "main", module.get());
+  llvm::BasicBlock *basicBlock = llvm::BasicBlock::Create(*context, "entry", function);
+  builder->SetInsertPoint(basicBlock);
+  globalSSABuilder->sealBlock(basicBlock);
+
+  ASTBlock *block1(new ASTBlock("ProgramBlock"));
+  globalBlockStack->pushBlock(block1);
+
+  if (numOfSampleFunctions)
   {
-    std::vector<ASTNode *> children;
-    // printf("------ DEBUGING ------");
-    for (int i = 0; i < body.size(); i++)
+    BuildFunctionsSample(block1, numOfSampleFunctions, exportedSampleFunction);
+  }
+  else if (!sampleName.empty())
+  {
+    if (!BuildSample(sampleName, block1))
     {
-      children.push_back(body[i]);
+      fprintf(stderr, "unknown sample: %s\n", sampleName.c_str());
+      return 1;
     }
+  }
+  else
+  {
+    ASIntTNumberExpression *intExpr4(new ASIntTNumberExpression(Token("2", Token::Type::LITERAL_INT)));
+    ASTAssignVariableStatement *variableStm1(new ASTAssignVariableStatement(intExpr4, Token("a", Token::Type::IDENTIFIER), Type::getInteger32Ty()));
+    block1->pushStatement(variableStm1);
 
-    return std::move(children);
+    ASIntTNumberExpression *intExpr1(new ASIntTNumberExpression(Token("4", Token::Type::LITERAL_INT)));
+    ASIntTNumberExpression *intExpr2(new ASIntTNumberExpression(Token("2", Token::Type::LITERAL_INT)));
+    ASIntTNumberExpression *intExpr3(new ASIntTNumberExpression(Token("2", Token::Type::LITERAL_INT)));
+    ASTUnaryExpression *unaryExpr1(new ASTUnaryExpression(Token("-", Token::Type::HYPHEN), intExpr3));
+    ASTIdentifierExpression *identifierExpr1(new ASTIdentifierExpression(Token("a", Token::Type::IDENTIFIER)));
+
+    ASTBinaryExpression *binaryExpr1(new ASTBinaryExpression(Token("+", Token::Type::PLUS), intExpr1, intExpr2));
+    ASTBinaryExpression *binaryExpr2(new ASTBinaryExpression(Token("*", Token::Type::ASTERISK), unaryExpr1, binaryExpr1));
+    ASTBinaryExpression *binaryExpr3(new ASTBinaryExpression(Token("-", Token::Type::HYPHEN), identifierExpr1, binaryExpr2));
+
+    block1->pushStatement(binaryExpr3);
+    // llvm::Value *value = binaryExpr3->codegen();
+    // value->print(llvm::outs());
+
+    // fn square(x: int32): int32 { return x * x; }
+    ASTBlock *block2(new ASTBlock("FunctionBlock"));
+    ASTPrototype *prototype1(new ASTPrototype(Token("square", Token::Type::IDENTIFIER), {new ASTVariableStatement(Token("x", Token::Type::IDENTIFIER), Type::getInteger32Ty())}, Type::getInteger32Ty()));
+    globalBlockStack->pushBlock(block2);
+    prototype1->declareArgs(block2);
+    ASTIdentifierExpression *identifierExpr2(new ASTIdentifierExpression(Token("x", Token::Type::IDENTIFIER)));
+    ASTIdentifierExpression *identifierExpr3(new ASTIdentifierExpression(Token("x", Token::Type::IDENTIFIER)));
+    block2->pushStatement(new ASTReturnStatement(new ASTBinaryExpression(Token("*", Token::Type::ASTERISK), identifierExpr2, identifierExpr3)));
+    globalBlockStack->popBlock();
+    block1->pushStatement(new ASTFunction(prototype1, block2));
+
+    // square(a - (-2 * (4 + 2))) - 182
+    ASTCallExpression *callExpr1(new ASTCallExpression(Token("square", Token::Type::IDENTIFIER), {binaryExpr3}));
+    block1->pushStatement(new ASTBinaryExpression(Token("-", Token::Type::HYPHEN), callExpr1, new ASIntTNumberExpression(Token("182", Token::Type::LITERAL_INT))));
   }
 
-  llvm::Value *codegen() override;
-  void newNamedVariable(ASTVariableStatement *variable)
+  globalBlockStack->popBlock();
+  block1->evaluateType();
+  block1->fold();
+  if (isDumpRequested || !emitLLVM)
   {
-    namedVariables[variable->getName()] = variable;
-    currentVariable = variable;
+    PrettyPrint(block1, dumpFormat);
   }
 
-  ASTVariableStatement *namedVariable(std::string variableName)
+  // Everything the code of a function depends on apart from its own tree.
+  std::unique_ptr<FunctionCache> cache;
+  std::string cacheFlags = std::string("gearfuse-cache-4 llvm-") + LLVM_VERSION_STRING + " " +
+                           targetMachine->getTargetTriple().str() + " " + targetCPU + " " + targetFeatures + " O" +
+                           std::to_string(codegenLevel.getSpeedupLevel()) + " s" + std::to_string(codegenLevel.getSizeLevel()) +
+                           (isThinLTO ? " thin" : "") + (globalProfileMode == ProfileMode::Generate ? " profile-generate " + profilePath : "");
+  if (globalProfileMode == ProfileMode::Use)
   {
-    currentVariable = namedVariables[variableName];
-    return currentVariable;
+    std::unique_ptr<llvm::MemoryBuffer> profile = std::move(*llvm::MemoryBuffer::getFile(profilePath));
+    llvm::SHA1 hasher;
+    hasher.update(profile->getBuffer());
+    cacheFlags += " profile-use " + FinalHash(hasher);
   }
-
-  void pushStatement(ASTStatement *statement)
+  if (!cacheDirectory.empty())
   {
-    body.push_back(statement);
+    cache.reset(new FunctionCache(cacheDirectory));
   }
-};
 
-class BlockStack
-{
-protected:
-  std::vector<ASTBlock *> blocks;
+  CodegenOptions codegenOptions;
+  codegenOptions.level = codegenLevel;
+  codegenOptions.isThinLTO = isThinLTO;
+  codegenOptions.cache = cache.get();
+  codegenOptions.cacheFlags = cacheFlags;
 
-public:
-  BlockStack() = default;
-  ASTBlock *getCurrentBlock() { return blocks.back(); }
-  void pushBlock(ASTBlock *block) { blocks.push_back(block); }
-  void popBlock() { blocks.pop_back(); }
+  // Functions are generated apart from the program block, split over the
+  // codegen threads when there is more than one of them. Cached functions
+  // always go through the partitions, they are optimised one by one and
+  // linked after the rest of the module.
+  std::vector<ASTFunction *> functions = block1->takeFunctions();
+  std::vector<CodegenPartition> partitions = PartitionFunctions(functions, numOfPartitions);
+  if (partitions.size() == 1 && !cache)
+  {
+    globalIsSingleModule = true;
+    for (int i = 0; i < partitions[0].functions.size(); i++)
+    {
+      partitions[0].functions[i]->codegen();
+    }
 
-  ASTVariableStatement *namedVariable(std::string variableName)
+    partitions.clear();
+  }
+
+  // Objects can only be kept apart when they are written out, running needs
+  // a single module. An executable linked with ThinLTO keeps every partition
+  // as a module of the thin link instead.
+  std::string objectPath = emitObjectOnly ? (outputPath.empty() ? "main.o" : outputPath) : outputPath + ".o";
+  bool isSplit = splitObjects && !isThinLTO && !runInProcess && (emitObjectOnly || !outputPath.empty());
+  bool isThinLinked = isThinLTO && !emitObjectOnly;
+  std::vector<std::string> objectPaths = {objectPath};
+  std::vector<std::unique_ptr<llvm::TargetMachine>> partitionTargetMachines;
+  for (int i = 0; i < partitions.size(); i++)
   {
-    for (int i = blocks.size() - 1; i >= 0; i--)
+    if (isSplit)
     {
-      ASTVariableStatement *variable = blocks[i]->namedVariable(variableName);
-      if (variable)
+      partitions[i].objectPath = llvm::sys::path::stem(objectPath).str() + "." + std::to_string(i + 1) + ".o";
+      if (llvm::sys::path::has_parent_path(objectPath))
       {
-        return variable;
+        partitions[i].objectPath = llvm::sys::path::parent_path(objectPath).str() + "/" + partitions[i].objectPath;
       }
+
+      objectPaths.push_back(partitions[i].objectPath);
     }
 
-    return nullptr;
+    partitionTargetMachines.emplace_back(CreateTargetMachine(targetCPU, targetFeatures, optimizationLevel));
+    if (!partitionTargetMachines.back())
+    {
+      return 1;
+    }
   }
-};
 
-BlockStack *globalBlockStack(new BlockStack());
-llvm::Value *ASTBlock::codegen()
-{
-  globalBlockStack->pushBlock(this);
+  std::vector<std::thread> workers = CodegenPartitions(partitions, partitionTargetMachines, codegenOptions);
 
-  llvm::Value *FnIR;
-  for (int i = 0; i < body.size(); i++)
+  std::unique_ptr<FunctionProfiler> profiler;
+  if (globalProfileMode != ProfileMode::None)
   {
-    FnIR = body[i]->codegen();
+    profiler.reset(new FunctionProfiler(globalProfileMode, globalProfileData, function, HashTree(block1, "")));
+    profiler->enterFunction(*builder);
+    globalFunctionProfiler = profiler.get();
   }
 
-  globalBlockStack->popBlock();
+  // The value of the last statement is the exit code of the program.
+  llvm::Value *result = block1->codegen();
+  if (globalProfileMode == ProfileMode::Generate)
+  {
+    std::vector<std::string> profiledFunctions = {"main"};
+    for (int i = 0; i < functions.size(); i++)
+    {
+      profiledFunctions.push_back(functions[i]->getName());
+    }
 
-  return FnIR;
-}
+    builder->CreateCall(CreateProfileWriter(module.get(), profilePath, profiledFunctions));
+  }
 
-class ASTAssignVariableStatement : public ASTVariableStatement
-{
-protected:
-  ASTExpression *expression;
+  if (result && result->getType() == builder->getInt32Ty())
+  {
+    builder->CreateRet(result);
+  }
+  else
+  {
+    builder->CreateRet(builder->getInt32(0));
+  }
 
-public:
-  ASTAssignVariableStatement(ASTExpression *expression,
-                             Token token,
-                             Type *type,
-                             ASTNodeID ID = ASTNode::ASTAssignVariableStatementID,
-                             std::string showKind = "AssignVariableStatement") : expression(expression),
-                                                                                 ASTVariableStatement(token, type, ID, showKind)
+  if (profiler)
   {
-    globalBlockStack->getCurrentBlock()->newNamedVariable(this);
-  };
+    profiler->finishFunction();
+    globalFunctionProfiler = nullptr;
+  }
 
-  virtual void evaluateType() override
+  bool isVerified = !llvm::verifyModule(*module, &llvm::errs());
+  if (isVerified && reportOptimization)
   {
-    if (!getType()->isEquals(expression->getType()))
-    {
-      expression->setType(getType());
-    }
+    ReportOptimizationLevels(module.get(), targetMachine.get());
   }
 
-  std::vector<ASTNode *> getChildrenShow() override
+  // Partitions are optimised by their workers, only the rest is left here.
+  if (isVerified)
   {
-    std::vector<ASTNode *> children;
-    children.push_back(expression);
-    return std::move(children);
+    OptimizeModule(module.get(), codegenLevel, targetMachine.get(), isThinLTO);
   }
 
-  virtual llvm::StoreInst *codegen() override
+  bool isPartitionFailed = false;
+  for (int i = 0; i < workers.size(); i++)
   {
-    llvm::Value *expressionValue = expression->codegen();
+    workers[i].join();
+    isPartitionFailed |= partitions[i].isFailed;
+  }
 
-    if (!expressionValue)
-    {
-      return nullptr;
-    }
+  if (cache)
+  {
+    llvm::errs() << "cache: " << cache->getHits() << " of " << cache->getHits() + cache->getMisses() << " functions reused\n";
+  }
 
-    llvm::Function *function = builder->GetInsertBlock()->getParent();
-    value = CreateEntryBlockAlloca(function, type->getLLVMTy(), token.value);
-    return builder->CreateStore(expressionValue, value);
+  if (!isVerified || isPartitionFailed || globalHasErrors || (!isSplit && !isThinLinked && !LinkPartitions(partitions)))
+  {
+    return 1;
   }
-};
 
-class ASTIdentifierExpression : public ASTExpression
-{
-protected:
-  Token token;
-  ASTVariableStatement *foundVariable;
+  if (!isSplit && !isThinLinked)
+  {
+    InternalizeFunctions(module.get());
+  }
 
-public:
-  ASTIdentifierExpression(Token token) : token(token), ASTExpression(ASTNode::ASTIdentifierExpressionID, "IdentifierExpression", token.value)
+  if (emitLLVM)
   {
-    foundVariable = globalBlockStack->namedVariable(token.value);
-    if (foundVariable)
-    {
-      setType(foundVariable->getType());
-    }
-  };
+    module->print(llvm::outs(), nullptr);
+  }
 
-  llvm::LoadInst *codegen() override
+  // Executables with parallel loops are linked with the runtime, objects
+  // leave it to whoever links them.
+  std::vector<std::string> libraries;
+  std::vector<std::string> runtimeObjectPaths;
+  if (globalHasParallelLoops && !emitObjectOnly && !outputPath.empty())
   {
-    if (!foundVariable)
+    std::string runtimeObjectPath = GetRuntimeObject(cacheDirectory);
+    if (runtimeObjectPath.empty())
     {
-      return nullptr;
+      return 1;
     }
 
-    llvm::AllocaInst *value = foundVariable->getAlocatedValue();
-    if (!value)
+    runtimeObjectPaths.push_back(runtimeObjectPath);
+    libraries = runtimeLibraries;
+  }
+
+  if (emitObjectOnly && isThinLTO)
+  {
+    std::error_code errorCode;
+    llvm::raw_fd_ostream output(objectPath, errorCode, llvm::sys::fs::OF_None);
+    if (errorCode)
     {
-      return nullptr;
+      llvm::errs() << "could not open " << objectPath << ": " << errorCode.message() << "\n";
+      return 1;
     }
 
-    return builder->CreateLoad(value->getAllocatedType(), value, token.value.c_str());
+    output << WriteThinLTOBitcode(module.get());
   }
-};
-
-class ASTCallExpression : public ASTExpression
-{
-};
-
-void PrettyPrint(ASTNode *node, std::string indent = "", bool is_last = true)
-{
-  if (node == nullptr)
+  else if (emitObjectOnly)
   {
-    return;
+    if (!EmitObjectFile(module.get(), targetMachine.get(), objectPath))
+    {
+      return 1;
+    }
   }
-
-  // └── : ├── : │
-  std::string token_marker = is_last ? "|- " : "+ ";
-  // std::string token_marker = is_last ? "└──" : "├──";
-
-  std::cout << "\033[0;91;1m" << indent << token_marker << node->showKind << "\033[0;92;1m " << node->showValue << "\033[0m" << std::endl;
-  std::string last_indent = indent;
-  indent += is_last ? "   " : "|  ";
-  // indent += is_last ? "   " : "│  ";
-
-  std::vector<ASTNode *> children = node->getChildrenShow();
-  for (int i = 0; i < children.size(); i++)
+  else if (isThinLinked)
   {
-    PrettyPrint(children[i], indent, i == children.size() - 1);
-  }
-}
-
-int main()
-{
-  // std::vector<Type *> testTys;
-  // Type *type1 = Type::getFloat32Ty();
-  // Type *type2 = Type::getInteger64Ty();
-  // Type *type3 = getTypeFromTwoTypes(type1, type2);
-
-  // testTys.push_back(type1);
-  // testTys.push_back(type2);
-  // testTys.push_back(type3);
-  // TestTypes(std::move(testTys));
-
-  // binaryExpr2->evaluateType();
-  // PrettyPrint(binaryExpr2);
-  // llvm::Value *value = binaryExpr2->codegen();
-  // value->print(llvm::outs());
-
-  llvm::Function *function = llvm::Function::Create(llvm::FunctionType::get(builder->getInt32Ty(), false), llvm::GlobalValue::ExternalLinkage, "main", module.get());
-  llvm::BasicBlock *basicBlock = llvm::BasicBlock::Create(*context, "entry", function);
-  builder->SetInsertPoint(basicBlock);
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> inputs;
+    inputs.push_back(llvm::MemoryBuffer::getMemBufferCopy(WriteThinLTOBitcode(module.get()), "main.gc"));
+    for (int i = 0; i < partitions.size(); i++)
+    {
+      inputs.push_back(llvm::MemoryBuffer::getMemBufferCopy(partitions[i].bitcode, "main.gc.part" + std::to_string(i)));
+    }
 
-  ASTBlock *block1(new ASTBlock("ProgramBlock"));
-  globalBlockStack->pushBlock(block1);
+    for (int i = 0; i < inputFiles.size(); i++)
+    {
+      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> input = llvm::MemoryBuffer::getFile(inputFiles[i]);
+      if (!input)
+      {
+        llvm::errs() << "could not read " << inputFiles[i] << ": " << input.getError().message() << "\n";
+        return 1;
+      }
 
-  ASIntTNumberExpression *intExpr4(new ASIntTNumberExpression(Token("2", Token::Type::LITERAL_INT)));
-  ASTAssignVariableStatement *variableStm1(new ASTAssignVariableStatement(intExpr4, Token("a", Token::Type::IDENTIFIER), Type::getInteger32Ty()));
-  block1->pushStatement(variableStm1);
+      inputs.push_back(std::move(*input));
+    }
 
-  ASIntTNumberExpression *intExpr1(new ASIntTNumberExpression(Token("4", Token::Type::LITERAL_INT)));
-  ASIntTNumberExpression *intExpr2(new ASIntTNumberExpression(Token("2", Token::Type::LITERAL_INT)));
-  ASIntTNumberExpression *intExpr3(new ASIntTNumberExpression(Token("2", Token::Type::LITERAL_INT)));
-  ASTUnaryExpression *unaryExpr1(new ASTUnaryExpression(Token("-", Token::Type::HYPHEN), intExpr3));
-  ASTIdentifierExpression *identifierExpr1(new ASTIdentifierExpression(Token("a", Token::Type::IDENTIFIER)));
+    // The runtime object is shared by every link, it is not removed.
+    std::vector<std::string> thinObjectPaths;
+    std::vector<std::string> linkedObjectPaths = runtimeObjectPaths;
+    bool isLinked = ThinLink(inputs, targetCPU, targetFeatures, optimizationLevel, numOfThinLinkThreads, outputPath,
+                             cacheDirectory.empty() ? "" : cacheDirectory + "/thinlto", thinObjectPaths, EnableLoopRemarks);
+    linkedObjectPaths.insert(linkedObjectPaths.end(), thinObjectPaths.begin(), thinObjectPaths.end());
+    isLinked = isLinked && LinkExecutable(linkedObjectPaths, outputPath, libraries);
+    for (int i = 0; i < thinObjectPaths.size(); i++)
+    {
+      llvm::sys::fs::remove(thinObjectPaths[i]);
+    }
 
-  ASTBinaryExpression *binaryExpr1(new ASTBinaryExpression(Token("+", Token::Type::PLUS), intExpr1, intExpr2));
-  ASTBinaryExpression *binaryExpr2(new ASTBinaryExpression(Token("*", Token::Type::ASTERISK), unaryExpr1, binaryExpr1));
-  ASTBinaryExpression *binaryExpr3(new ASTBinaryExpression(Token("-", Token::Type::HYPHEN), identifierExpr1, binaryExpr2));
+    if (!isLinked)
+    {
+      return 1;
+    }
+  }
+  else if (!outputPath.empty())
+  {
+    std::vector<std::string> linkedObjectPaths = objectPaths;
+    linkedObjectPaths.insert(linkedObjectPaths.end(), runtimeObjectPaths.begin(), runtimeObjectPaths.end());
+    bool isLinked = EmitObjectFile(module.get(), targetMachine.get(), objectPath) && LinkExecutable(linkedObjectPaths, outputPath, libraries);
+    for (int i = 0; i < objectPaths.size(); i++)
+    {
+      llvm::sys::fs::remove(objectPaths[i]);
+    }
 
-  block1->pushStatement(binaryExpr3);
-  // llvm::Value *value = binaryExpr3->codegen();
-  // value->print(llvm::outs());
+    if (!isLinked)
+    {
+      return 1;
+    }
+  }
 
-  globalBlockStack->popBlock();
-  PrettyPrint(block1);
+  if (runTiered)
+  {
+    llvm::OptimizationLevel tierUpLevel = optimizationLevel == llvm::OptimizationLevel::O3 ? llvm::OptimizationLevel::O3 : llvm::OptimizationLevel::O2;
+    return RunModuleTiered(std::move(module), std::move(context), targetMachine.get(), tierUpLevel, tierUpThreshold);
+  }
+  else if (runInProcess)
+  {
+    return RunModule(std::move(module), std::move(context), targetMachine.get());
+  }
 
   return 1;
 }
\ No newline at end of file
@@ -0,0 +1,138 @@
+#!/usr/bin/env bash
+# Runs the sample programs (--sample=) and checks what they return and the
+# code generated for them.
+#
+#   compiler/tests/samples.sh <path to the compiler>
+set -e
+
+compiler=$(realpath "${1:?usage: samples.sh <compiler>}")
+export GEARFUSE_RUNTIME_DIR=${GEARFUSE_RUNTIME_DIR:-$(realpath "$(dirname "$0")/../Runtime")}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+failures=0
+
+check() {
+  local description=$1
+  shift
+  if "$@"; then
+    echo "ok    $description"
+  else
+    echo "FAIL  $description"
+    failures=$((failures + 1))
+  fi
+}
+
+not() {
+  ! "$@"
+}
+
+# exits <code> <arguments>: whether the compiler exits with the code, which
+# is the result of the program with --run. A program that traps takes the
+# compiler down with SIGILL, 132, the subshell keeps bash from reporting it.
+exits() {
+  local expected=$1
+  shift
+  local code
+  code=$("$compiler" "$@" >/dev/null 2>&1; echo $?) 2>/dev/null
+  [[ $code == "$expected" ]]
+}
+
+# runs <code> <arguments>: whether the executable the compiler links exits
+# with the code. The exit code of the compiler does not tell whether it
+# linked, only whether the executable is there.
+runs() {
+  local expected=$1
+  shift
+  rm -f program
+  "$compiler" "$@" -o program >/dev/null 2>&1 || true
+  [[ -x program ]] || return 1
+  local code=0
+  ./program || code=$?
+  [[ $code == "$expected" ]]
+}
+
+# reports <pattern> <arguments>: whether the compiler fails with an error
+# matching the pattern.
+reports() {
+  local pattern=$1
+  shift
+  local output
+  if output=$("$compiler" "$@" 2>&1 >/dev/null); then
+    return 1
+  fi
+  grep -q -- "$pattern" <<<"$output"
+}
+
+# calls <function> <callee> <arguments>: whether the function calls the
+# callee in the IR the compiler emits.
+calls() {
+  local function=$1 callee=$2
+  shift 2
+  "$compiler" --emit-llvm "$@" 2>/dev/null | awk "/^define .*@$function\\(/,/^}/" | grep -q "call .*@$callee("
+}
+
+# count <function> <pattern> <arguments>: how many lines of the function in
+# the IR the compiler emits match the pattern.
+count() {
+  local function=$1 pattern=$2
+  shift 2
+  "$compiler" --emit-llvm "$@" 2>/dev/null | awk "/^define .*@$function\\(/,/^}/" | grep -c -- "$pattern" || true
+}
+
+# remarks <arguments>: how many loop remarks the compiler prints with
+# --report-loops.
+remarks() {
+  "$compiler" --report-loops "$@" 2>&1 >/dev/null | grep -c "^loop:" || true
+}
+
+check "the default program returns 14" exits 14 --run
+check "branchy returns 65 at -O2" exits 65 --sample=branchy -O2 --run
+
+check "comptime returns 88" exits 88 --sample=comptime --run
+check "comptime returns 88 at -O2" exits 88 --sample=comptime -O2 --run
+check "comptime folds fib(20)" not calls main fib --sample=comptime
+check "comptime leaves spin past the step limit" calls main spin --sample=comptime
+check "comptime leaves depth past the depth limit" calls main depth --sample=comptime
+
+check "loops returns 253" exits 253 --sample=loops --run
+check "loops returns 253 at -O2" exits 253 --sample=loops -O2 --run
+check "loops copies only the array not in memory" test "$(count main 'for_array = alloca' --sample=loops)" = 1
+check "loops are reported by the thin link backends" test "$(remarks --sample=loops -O2 -flto=thin -o loops)" -gt 0
+
+check "classes returns 76" exits 76 --sample=classes --run
+check "classes returns 76 at -O2" exits 76 --sample=classes -O2 --run
+check "classes calls area through the table of a shape" test "$(count areaOf 'call .*%area_method(' --sample=classes)" = 1
+check "classes calls the area of a final class directly" calls squareArea Square.area --sample=classes
+check "classes rejects a base constructor that takes arguments" reports "Square can not be constructed, the constructor of its base Rect takes arguments" --sample=classes-base-arguments
+
+check "stack returns 83" exits 83 --sample=stack --run
+check "stack returns 83 at -O2" exits 83 --sample=stack -O2 --run
+check "stack moves a calloc of 4096 bytes to the frame" test "$(count callocSmall 'new.stack = alloca' --sample=stack -O2)" = 1
+check "stack leaves no calloc of 4096 bytes" not calls callocSmall calloc --sample=stack -O2
+check "stack keeps a calloc of 4104 bytes" calls callocLarge calloc --sample=stack -O2
+check "stack moves a malloc to the frame" test "$(count mallocSmall 'new.stack = alloca' --sample=stack -O2)" = 1
+check "stack leaves no malloc" not calls mallocSmall malloc --sample=stack -O2
+check "stack keeps allocations merged by a select" test "$(count merged 'call ptr @calloc(' --sample=stack -O2)" = 2
+check "stack moves the array a tail call reads to the frame" not calls tailSum calloc --sample=stack -O2
+check "stack clears tail on the call that reads the moved array" test "$(count tailSum 'tail call .*@total(' --sample=stack -O2)" = 0
+check "stack keeps the array a musttail call reads" calls mustTailSum calloc --sample=stack -O2
+check "stack keeps the musttail call" test "$(count mustTailSum 'musttail call .*@total(' --sample=stack -O2)" = 1
+
+check "slices returns 76" exits 76 --sample=slices --run
+check "slices returns 76 at -O2" exits 76 --sample=slices -O2 --run
+check "slices lays the particles out by field" test "$(count main '%field_address[0-9]* = getelementptr inbounds { \[16 x i64\], \[16 x i64\] }' --sample=slices)" = 4
+check "slices only copies the innermost loop of a nest" test "$(count cube "^for_body" --sample=slices)" = 4
+check "slices traps on an index past the end" exits 132 --sample=slices-out-of-range --run
+check "slices traps on an index past the end at -O2" exits 132 --sample=slices-out-of-range -O2 --run
+
+check "parallel returns 192" exits 192 --sample=parallel --run
+check "parallel returns 192 at -O2" exits 192 --sample=parallel -O2 --run
+check "parallel links with the runtime" runs 192 --sample=parallel -O2 --cache-dir=cache
+check "parallel links again with the same runtime" runs 192 --sample=parallel --cache-dir=cache
+check "parallel builds the runtime once" test "$(ls cache/runtime | wc -l)" = 1
+check "parallel links with the runtime after the thin link" runs 192 --sample=parallel -O2 -flto=thin
+check "parallel rejects a body assigning a variable outside of it" reports "can not be outlined, the body assigns total" --sample=parallel-assign
+
+echo "$failures failed"
+[[ $failures == 0 ]]